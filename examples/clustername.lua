@@ -1,2 +1,4 @@
 db = "127.0.0.1:2528"
 db2 = "127.0.0.1:2529"
+-- db4 = { address = "127.0.0.1:2530", trace = true }	-- send the trace context of skynet.trace() to db4, it must support tracing
+-- db3 = "unix:/tmp/skynet_db3.sock"	-- co-located node, connect through AF_UNIX socket
@@ -18,6 +18,8 @@
 
 #define TEMP_LENGTH 0x8200
 #define MULTI_PART 0x8000
+#define TRACE_FLAG 0x40
+#define TRACE_SIZE 8
 
 static void
 fill_uint32(uint8_t * buf, uint32_t n) {
@@ -69,34 +71,53 @@ fill_header(lua_State *L, uint8_t *buf, int sz) {
 		BYTE 2/3 ; 2:multipart, 3:multipart end
 		DWORD SESSION
 		PADDING msgpart(sz)
+
+	traced request (type 0/1/0x80/0x81 with TRACE_FLAG 0x40)
+		WORD sz + 8
+		BYTE type | 0x40
+		... the same as above
+		DWORD trace
+		DWORD span
+		old nodes without TRACE_FLAG support reject it, clusterd only sends it to the nodes with trace = true in clustername
  */
 static int
-packreq_number(lua_State *L, int session, void * msg, uint32_t sz) {
+packreq_number(lua_State *L, int session, void * msg, uint32_t sz, uint32_t trace, uint32_t span) {
 	uint32_t addr = (uint32_t)lua_tointeger(L,1);
 	uint8_t buf[TEMP_LENGTH];
+	int tsz = trace ? TRACE_SIZE : 0;
 	if (sz < MULTI_PART) {
-		fill_header(L, buf, sz+9);
+		fill_header(L, buf, sz+9+tsz);
 		buf[2] = 0;
 		fill_uint32(buf+3, addr);
 		fill_uint32(buf+7, (uint32_t)session);
 		memcpy(buf+11,msg,sz);
+		if (tsz) {
+			buf[2] |= TRACE_FLAG;
+			fill_uint32(buf+11+sz, trace);
+			fill_uint32(buf+15+sz, span);
+		}
 
-		lua_pushlstring(L, (const char *)buf, sz+11);
+		lua_pushlstring(L, (const char *)buf, sz+11+tsz);
 		return 0;
 	} else {
 		int part = (sz - 1) / MULTI_PART + 1;
-		fill_header(L, buf, 13);
+		fill_header(L, buf, 13+tsz);
 		buf[2] = 1;
 		fill_uint32(buf+3, addr);
 		fill_uint32(buf+7, (uint32_t)session);
 		fill_uint32(buf+11, sz);
-		lua_pushlstring(L, (const char *)buf, 15);
+		if (tsz) {
+			buf[2] |= TRACE_FLAG;
+			fill_uint32(buf+15, trace);
+			fill_uint32(buf+19, span);
+		}
+		lua_pushlstring(L, (const char *)buf, 15+tsz);
 		return part;
 	}
 }
 
 static int
-packreq_string(lua_State *L, int session, void * msg, uint32_t sz) {
+packreq_string(lua_State *L, int session, void * msg, uint32_t sz, uint32_t trace, uint32_t span) {
 	size_t namelen = 0;
 	const char *name = lua_tolstring(L, 1, &namelen);
 	if (name == NULL || namelen < 1 || namelen > 255) {
@@ -105,26 +126,37 @@ packreq_string(lua_State *L, int session, void * msg, uint32_t sz) {
 	}
 
 	uint8_t buf[TEMP_LENGTH];
+	int tsz = trace ? TRACE_SIZE : 0;
 	if (sz < MULTI_PART) {
-		fill_header(L, buf, sz+6+namelen);
+		fill_header(L, buf, sz+6+namelen+tsz);
 		buf[2] = 0x80;
 		buf[3] = (uint8_t)namelen;
 		memcpy(buf+4, name, namelen);
 		fill_uint32(buf+4+namelen, (uint32_t)session);
 		memcpy(buf+8+namelen,msg,sz);
+		if (tsz) {
+			buf[2] |= TRACE_FLAG;
+			fill_uint32(buf+8+namelen+sz, trace);
+			fill_uint32(buf+12+namelen+sz, span);
+		}
 
-		lua_pushlstring(L, (const char *)buf, sz+8+namelen);
+		lua_pushlstring(L, (const char *)buf, sz+8+namelen+tsz);
 		return 0;
 	} else {
 		int part = (sz - 1) / MULTI_PART + 1;
-		fill_header(L, buf, 10+namelen);
+		fill_header(L, buf, 10+namelen+tsz);
 		buf[2] = 0x81;
 		buf[3] = (uint8_t)namelen;
 		memcpy(buf+4, name, namelen);
 		fill_uint32(buf+4+namelen, (uint32_t)session);
 		fill_uint32(buf+8+namelen, sz);
+		if (tsz) {
+			buf[2] |= TRACE_FLAG;
+			fill_uint32(buf+12+namelen, trace);
+			fill_uint32(buf+16+namelen, span);
+		}
 
-		lua_pushlstring(L, (const char *)buf, 12+namelen);
+		lua_pushlstring(L, (const char *)buf, 12+namelen+tsz);
 		return part;
 	}
 }
@@ -166,12 +198,16 @@ lpackrequest(lua_State *L) {
 		skynet_free(msg);
 		return luaL_error(L, "Invalid request session %d", session);
 	}
+	// optional trace context, See skynet.tracecontext()
+	uint32_t trace = (uint32_t)luaL_optinteger(L,5,0);
+	uint32_t span = (uint32_t)luaL_optinteger(L,6,0);
+	lua_settop(L,4);
 	int addr_type = lua_type(L,1);
 	int multipak;
 	if (addr_type == LUA_TNUMBER) {
-		multipak = packreq_number(L, session, msg, sz);
+		multipak = packreq_number(L, session, msg, sz, trace, span);
 	} else {
-		multipak = packreq_string(L, session, msg, sz);
+		multipak = packreq_string(L, session, msg, sz, trace, span);
 	}
 	int current_session = session;
 	if (++session < 0) {
@@ -196,6 +232,8 @@ lpackrequest(lua_State *L) {
 		int session
 		string msg
 		boolean padding
+		uint32_t trace (0 if not traced)
+		uint32_t span
  */
 
 static inline uint32_t
@@ -285,25 +323,55 @@ unpackmreq_string(lua_State *L, const uint8_t * buf, int sz) {
 }
 
 static int
-lunpackrequest(lua_State *L) {
-	size_t ssz;
-	const char *msg = luaL_checklstring(L,1,&ssz);
-	int sz = (int)ssz;
-	switch (msg[0]) {
+unpackreq(lua_State *L, int type, const uint8_t * msg, int sz) {
+	switch (type) {
 	case 0:
-		return unpackreq_number(L, (const uint8_t *)msg, sz);
+		return unpackreq_number(L, msg, sz);
 	case 1:
-		return unpackmreq_number(L, (const uint8_t *)msg, sz);
+		return unpackmreq_number(L, msg, sz);
 	case 2:
 	case 3:
-		return unpackmreq_part(L, (const uint8_t *)msg, sz);
-	case '\x80':
-		return unpackreq_string(L, (const uint8_t *)msg, sz);
-	case '\x81':
-		return unpackmreq_string(L, (const uint8_t *)msg, sz);
+		return unpackmreq_part(L, msg, sz);
+	case 0x80:
+		return unpackreq_string(L, msg, sz);
+	case 0x81:
+		return unpackmreq_string(L, msg, sz);
 	default:
-		return luaL_error(L, "Invalid req package type %d", msg[0]);
+		return luaL_error(L, "Invalid req package type %d", type);
+	}
+}
+
+static int
+lunpackrequest(lua_State *L) {
+	size_t ssz;
+	const uint8_t *msg = (const uint8_t *)luaL_checklstring(L,1,&ssz);
+	int sz = (int)ssz;
+	if (sz < 1) {
+		return luaL_error(L, "Invalid cluster message (size=%d)", sz);
+	}
+	int type = msg[0];
+	uint32_t trace = 0;
+	uint32_t span = 0;
+	if ((type & TRACE_FLAG) && (type & 0x7f) <= 1 + TRACE_FLAG) {
+		// type 0/1/0x80/0x81 with trace context at the end
+		if (sz < 1 + TRACE_SIZE) {
+			return luaL_error(L, "Invalid cluster message (size=%d)", sz);
+		}
+		sz -= TRACE_SIZE;
+		trace = unpack_uint32(msg + sz);
+		span = unpack_uint32(msg + sz + 4);
+		type &= ~TRACE_FLAG;
+	}
+	int n = unpackreq(L, type, msg, sz);
+	if (trace == 0) {
+		return n;
+	}
+	if (n < 4) {
+		lua_pushnil(L);	// no padding
 	}
+	lua_pushinteger(L, trace);
+	lua_pushinteger(L, span);
+	return 6;
 }
 
 /*
@@ -393,6 +393,51 @@ filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
 	return ret;
 }
 
+// 合并的数据消息 SKYNET_SOCKET_TYPE_BATCH
+// 所有完整的包都压入队列，有包时返回 queue, more
+static int
+filter_batch(lua_State *L, struct skynet_socket_event *ev, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		int ret = filter_data(L, ev[i].id, (uint8_t *)ev[i].buffer, ev[i].size);
+		if (ret == 5) {
+			// 只有一个完整的包，同样放入队列，保证顺序
+			void * msg = lua_touserdata(L, -2);
+			int sz = lua_tointeger(L, -1);
+			push_data(L, ev[i].id, msg, sz, 0);
+		}
+		lua_settop(L, 1);
+	}
+	skynet_free(ev);
+	struct queue *q = lua_touserdata(L, 1);
+	if (q == NULL || q->head == q->tail) {
+		return 1;
+	}
+	lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
+	return 2;
+}
+
+// socket线程已经切好的完整的包 SKYNET_SOCKET_TYPE_FRAME
+// 只有一个包时返回 queue, data, fd, msg, sz，否则全部压入队列，返回 queue, more
+static int
+filter_frame(lua_State *L, struct skynet_socket_event *ev, int n) {
+	if (n == 1) {
+		lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
+		lua_pushinteger(L, ev[0].id);
+		lua_pushlightuserdata(L, ev[0].buffer);
+		lua_pushinteger(L, ev[0].size);
+		skynet_free(ev);
+		return 5;
+	}
+	int i;
+	for (i=0;i<n;i++) {
+		push_data(L, ev[i].id, ev[i].buffer, ev[i].size, 0);
+	}
+	skynet_free(ev);
+	lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
+	return 2;
+}
+
 static void
 pushstring(lua_State *L, const char * msg, int size) {
 	if (msg) {
@@ -440,6 +485,14 @@ lfilter(lua_State *L) {
 		// ignore listen id (message->id)
 		assert(size == -1);	// never padding string
 		return filter_data(L, message->id, (uint8_t *)buffer, message->ud);
+	case SKYNET_SOCKET_TYPE_BATCH:
+		// 一批事件中多个连接的数据，见 socketdriver.coalesce
+		assert(size == -1);
+		return filter_batch(L, (struct skynet_socket_event *)buffer, message->ud);
+	case SKYNET_SOCKET_TYPE_FRAME:
+		// socket线程已经分好包，见 socketdriver.frame
+		assert(size == -1);
+		return filter_frame(L, (struct skynet_socket_event *)buffer, message->ud);
 	case SKYNET_SOCKET_TYPE_CONNECT:
 		// ignore listen fd connect
 		return 1;
@@ -1,888 +1,515 @@
-#include "skynet.h"
-#include "lua-seri.h"
-
-#define KNRM  "\x1B[0m"
-#define KRED  "\x1B[31m"
-
-#include <lua.h>
-#include <lauxlib.h>
-#include <stdlib.h>
-#include <string.h>
-#include <assert.h>
-
-struct snlua {
-	lua_State * L;
-	struct skynet_context * ctx;
-	const char * preload;
-};
-
-// 自定义错误处理函数
-static int
-traceback (lua_State *L) {
-	const char *msg = lua_tostring(L, 1);
-	if (msg)
-		luaL_traceback(L, L, msg, 1);
-	else {
-		lua_pushliteral(L, "(no error message)");
-	}
-	return 1;
-}
-
-// 回调函数
-// typedef int (*skynet_cb)(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
-// 
-static int
-_cb(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
-	lua_State *L = ud;
-	int trace = 1;
-	int r;
-	int top = lua_gettop(L);
-	if (top == 0) {
-		// 如果lua栈为空，第一次运行
-		// 先压入c函数traceback
-		lua_pushcfunction(L, traceback);
-		// 再把注册表变量_cb压入栈中
-		lua_rawgetp(L, LUA_REGISTRYINDEX, _cb);
-	} else {
-		// 如果栈不为空，则必须有2个元素，第一次运行压入栈中的traceback和_cb
-		assert(top == 2);
-	}
-	// 复制回调函数再压入栈中
-	lua_pushvalue(L,2);
-
-	// 依次压入参数值
-	lua_pushinteger(L, type);
-	lua_pushlightuserdata(L, (void *)msg);
-	lua_pushinteger(L,sz);
-	lua_pushinteger(L, session);
-	lua_pushinteger(L, source);
-
-	// 执行lua回调方法
-	// skynet.lua 中的 raw_dispatch_message(prototype, msg, sz, session, source)
-	r = lua_pcall(L, 5, 0 , trace);
-
-	if (r == LUA_OK) {
-		return 0;
-	}
-	const char * self = skynet_command(context, "REG", NULL);
-	switch (r) {
-	case LUA_ERRRUN:
-		skynet_error(context, "lua call [%x to %s : %d msgsz = %d] error : " KRED "%s" KNRM, source , self, session, sz, lua_tostring(L,-1));
-		break;
-	case LUA_ERRMEM:
-		skynet_error(context, "lua memory error : [%x to %s : %d]", source , self, session);
-		break;
-	case LUA_ERRERR:
-		skynet_error(context, "lua error in error : [%x to %s : %d]", source , self, session);
-		break;
-	case LUA_ERRGCMM:
-		skynet_error(context, "lua gc error : [%x to %s : %d]", source , self, session);
-		break;
-	};
-
-	// 弹出回调函数副本，保留traceback和_cb
-	lua_pop(L,1);
-
-	return 0;
-}
-
-static int
-forward_cb(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
-	_cb(context, ud, type, session, source, msg, sz);
-	// don't delete msg in forward mode.
-	return 1;
-}
-
-// c.callback(cb, forward)
-static int
-lcallback(lua_State *L) {
-	// 获取第一个上值，skynet_context
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	// 获取第二个参数值
-	int forward = lua_toboolean(L, 2);
-
-	// 检查第一个参数是否为函数类型
-	luaL_checktype(L,1,LUA_TFUNCTION);
-	// 设置栈顶为1
-	lua_settop(L,1);
-	// 把栈顶函数元素设置为注册表变量_cb
-	lua_rawsetp(L, LUA_REGISTRYINDEX, _cb);
-
-	// 把注册表变量状态机的主线程压入栈中
-	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
-	// 从栈中获取状态机
-	lua_State *gL = lua_tothread(L,-1);
-
-	// 注册回调函数
-	if (forward) {
-		skynet_callback(context, gL, forward_cb);
-	} else {
-		skynet_callback(context, gL, _cb);
-	}
-
-	return 0;
-}
-
-// c.command(cmd, parm)
-// 比如 local addr = c.command("QUERY", name)
-// name 为 string，addr 为 string
-static int
-lcommand(lua_State *L) {
-	// 获取第一个上值，skynet_context
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	// 获取第一个参数值
-	const char * cmd = luaL_checkstring(L,1);
-	const char * result;
-	const char * parm = NULL;
-	if (lua_gettop(L) == 2) {
-		// 如果栈顶为2，获取第二个参数
-		// 检测栈元素类型是否为string，并返回这个字符串
-		parm = luaL_checkstring(L,2);
-	}
-
-	// 调用相应的指令方法
-	result = skynet_command(context, cmd, parm);
-	if (result) {
-		// 如果有返回值，压入值作为lua返回值
-		lua_pushstring(L, result);
-		return 1;
-	}
-	return 0;
-}
-
-// c.intcommand(cmd, parm)
-// 比如 local session = c.intcommand("TIMEOUT", ti)
-// parm 为 integer，session 也为 integer
-static int
-lintcommand(lua_State *L) {
-	// 获取第一个上值，skynet_context
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	// 获取第一个参数值
-	const char * cmd = luaL_checkstring(L,1);
-	const char * result;
-	const char * parm = NULL;
-	char tmp[64];	// for integer parm
-	if (lua_gettop(L) == 2) {
-		// 如果栈顶为2，获取第二个参数
-		if (lua_isnumber(L, 2)) {
-			int32_t n = (int32_t)luaL_checkinteger(L,2);
-			sprintf(tmp, "%d", n);
-			parm = tmp;
-		} else {
-			parm = luaL_checkstring(L, 2);
-		}
-	}
-
-	result = skynet_command(context, cmd, parm);
-	if (result) {
-		// 如果有返回值，压入栈作为lua返回值
-		char *endptr = NULL;
-		lua_Integer r = strtoll(result, NULL, 0);
-		if (endptr == NULL || *endptr != '\0') {
-			// may be a real number
-			double n = strtod(result, &endptr);
-			if (endptr == NULL || *endptr != '\0') {
-				return luaL_error(L, "Invalid result %s", result);
-			} else {
-				lua_pushinteger(L, n);
-			}
-		} else {
-			lua_pushinteger(L, r);
-		}
-		return 1;
-	}
-	return 0;
-}
-
-// c.genid
-static int
-lgenid(lua_State *L) { 
-	// 获取第一个上值，skynet_context
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	// 获取分配的新的session值，并压入栈作为lua返回值
-	int session = skynet_send(context, 0, 0, PTYPE_TAG_ALLOCSESSION , 0 , NULL, 0);
-	lua_pushinteger(L, session);
-	return 1;
-}
-
-// 获取地址名字符串
-static const char *
-get_dest_string(lua_State *L, int index) {
-	const char * dest_string = lua_tostring(L, index);
-	if (dest_string == NULL) {
-		luaL_error(L, "dest address type (%s) must be a string or number.", lua_typename(L, lua_type(L,index)));
-	}
-	return dest_string;
-}
-
-/*
-	uint32 address
-	 string address
-	integer type
-	integer session
-	string message
-	 lightuserdata message_ptr
-	 integer len
- */
-// local session = c.send(addr, p.id , nil , p.pack(...))
-static int
-lsend(lua_State *L) {
-	// 获取第一个上值，skynet_context
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	// 获取第一个参数值，目的地地址
-	// 先尝试获取整数型地址
-	uint32_t dest = (uint32_t)lua_tointeger(L, 1);
-	const char * dest_string = NULL;
-	if (dest == 0) {
-		// 如果非整数型地址，获取地址名字符串
-		if (lua_type(L,1) == LUA_TNUMBER) {
-			return luaL_error(L, "Invalid service address 0");
-		}
-		dest_string = get_dest_string(L, 1);
-	}
-
-	// 获取第二个参数值，消息类型
-	int type = luaL_checkinteger(L, 2);
-	int session = 0;
-	if (lua_isnil(L,3)) {
-		// 如果第三个参数为nil，则自动分配新的session
-		type |= PTYPE_TAG_ALLOCSESSION;
-	} else {
-		// 否则获取session值
-		session = luaL_checkinteger(L,3);
-	}
-
-	// 获取第四个参数值
-	int mtype = lua_type(L,4);
-	switch (mtype) {
-	case LUA_TSTRING: {
-		// 如果是字符串
-		size_t len = 0;
-		void * msg = (void *)lua_tolstring(L,4,&len);
-		if (len == 0) {
-			msg = NULL;
-		}
-		if (dest_string) {
-			session = skynet_sendname(context, 0, dest_string, type, session , msg, len);
-		} else {
-			session = skynet_send(context, 0, dest, type, session , msg, len);
-		}
-		break;
-	}
-	case LUA_TLIGHTUSERDATA: {
-		// 如果是轻量级用户数据 msg, sz
-		void * msg = lua_touserdata(L,4);
-		int size = luaL_checkinteger(L,5);
-		if (dest_string) {
-			session = skynet_sendname(context, 0, dest_string, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		} else {
-			session = skynet_send(context, 0, dest, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		}
-		break;
-	}
-	default:
-		luaL_error(L, "skynet.send invalid param %s", lua_typename(L, lua_type(L,4)));
-	}
-	if (session < 0) {
-		// send to invalid address
-		// todo: maybe throw an error would be better
-		return 0;
-	}
-	// session值压栈作为lua返回值
-	lua_pushinteger(L,session);
-	return 1;
-}
-
-// c.redirect(address, 0, skynet.PTYPE_ERROR, session, "")
-static int
-lredirect(lua_State *L) {
-	// 获取第一个上值，skynet_context
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	// 获取第一个参数值，目的地地址
-	// 先尝试获取整数型地址
-	uint32_t dest = (uint32_t)lua_tointeger(L,1);
-	const char * dest_string = NULL;
-	if (dest == 0) {
-		// 如果非整数型地址，获取地址名字符串
-		dest_string = get_dest_string(L, 1);
-	}
-	// 获取第二个参数值，源地址
-	uint32_t source = (uint32_t)luaL_checkinteger(L,2);
-	// 获取第二个参数值，类型
-	int type = luaL_checkinteger(L,3);
-	// 获取第二个参数值，session
-	int session = luaL_checkinteger(L,4);
-
-	// 同lsend方法
-	int mtype = lua_type(L,5);
-	switch (mtype) {
-	case LUA_TSTRING: {
-		size_t len = 0;
-		void * msg = (void *)lua_tolstring(L,5,&len);
-		if (len == 0) {
-			msg = NULL;
-		}
-		if (dest_string) {
-			session = skynet_sendname(context, source, dest_string, type, session , msg, len);
-		} else {
-			session = skynet_send(context, source, dest, type, session , msg, len);
-		}
-		break;
-	}
-	case LUA_TLIGHTUSERDATA: {
-		void * msg = lua_touserdata(L,5);
-		int size = luaL_checkinteger(L,6);
-		if (dest_string) {
-			session = skynet_sendname(context, source, dest_string, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		} else {
-			session = skynet_send(context, source, dest, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		}
-		break;
-	}
-	default:
-		luaL_error(L, "skynet.redirect invalid param %s", lua_typename(L,mtype));
-	}
-	// 没有lua返回值
-	return 0;
-}
-
-static int
-lerror(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	int n = lua_gettop(L);
-	if (n <= 1) {
-		lua_settop(L, 1);
-		const char * s = luaL_tolstring(L, 1, NULL);
-		skynet_error(context, "%s", s);
-		return 0;
-	}
-	luaL_Buffer b;
-	luaL_buffinit(L, &b);
-	int i;
-	for (i=1; i<=n; i++) {
-		luaL_tolstring(L, i, NULL);
-		luaL_addvalue(&b);
-		if (i<n) {
-			luaL_addchar(&b, ' ');
-		}
-	}
-	luaL_pushresult(&b);
-	skynet_error(context, "%s", lua_tostring(L, -1));
-	return 0;
-}
-
-// c.tostring
-// skynet.tostring
-// userdata(msg) + integer(sz) -> string(str)
-static int
-ltostring(lua_State *L) {
-	if (lua_isnoneornil(L,1)) {
-		return 0;
-	}
-	char * msg = lua_touserdata(L,1);
-	int sz = luaL_checkinteger(L,2);
-	lua_pushlstring(L,msg,sz);
-	return 1;
-}
-
-static int
-lharbor(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	uint32_t handle = (uint32_t)luaL_checkinteger(L,1);
-	int harbor = 0;
-	int remote = skynet_isremote(context, handle, &harbor);
-	lua_pushinteger(L,harbor);
-	lua_pushboolean(L, remote);
-
-	return 2;
-}
-
-// c.packstring
-// skynet.packstring
-// userdata(str) + integer(sz) -> string(str)
-static int
-lpackstring(lua_State *L) {
-	luaseri_pack(L);
-	char * str = (char *)lua_touserdata(L, -2);
-	int sz = lua_tointeger(L, -1);
-	lua_pushlstring(L, str, sz);
-	skynet_free(str);
-	return 1;
-}
-
-// c.trash
-// skynet.trash
-static int
-ltrash(lua_State *L) {
-	int t = lua_type(L,1);
-	switch (t) {
-	case LUA_TSTRING: {
-		break;
-	}
-	case LUA_TLIGHTUSERDATA: {
-		void * msg = lua_touserdata(L,1);
-		luaL_checkinteger(L,2);
-		skynet_free(msg);
-		break;
-	}
-	default:
-		luaL_error(L, "skynet.trash invalid param %s", lua_typename(L,t));
-	}
-
-	return 0;
-}
-
-// c.now
-// skynet.now
-static int
-lnow(lua_State *L) {
-	uint64_t ti = skynet_now();
-	lua_pushinteger(L, ti);
-	return 1;
-}
-
-// require "skynet.core"
-int
-luaopen_skynet_core(lua_State *L) {
-	// 检查调用它的内核是否是创建这个 Lua 状态机的内核，以及调用它的代码是否使用了相同的 Lua 版本，同时也检查调用它的内核与创建该 Lua 状态机的内核 是否使用了同一片地址空间。
-	luaL_checkversion(L);
-
-	luaL_Reg l[] = {
-		{ "send" , lsend },
-		{ "genid", lgenid },
-		{ "redirect", lredirect },
-		{ "command" , lcommand },
-		{ "intcommand", lintcommand },
-		{ "error", lerror },
-		{ "tostring", ltostring },
-		{ "harbor", lharbor },
-		{ "pack", luaseri_pack },
-		{ "unpack", luaseri_unpack },
-		{ "packstring", lpackstring },
-		{ "trash" , ltrash },
-		{ "callback", lcallback },
-		{ "now", lnow },
-		{ NULL, NULL },
-	};
-
-	// 创建一张新的表，并预分配足够保存下数组 l 内容的空间（但不填充）
-	luaL_newlibtable(L, l);
-
-	// 把注册表变量skynet_context压入栈中，作为所有注册函数的上值
-	lua_getfield(L, LUA_REGISTRYINDEX, "skynet_context");
-	// 如果snlua服务的init_cb方法中正常执行，获取到的ctx应该不为空
-	struct skynet_context *ctx = lua_touserdata(L,-1);
-	if (ctx == NULL) {
-		return luaL_error(L, "Init skynet context first");
-	}
-
-	// 把数组 l 中的所有函数注册到栈顶的表中
-	// nup = 1 一个上值，skynet_context
-	// 先压表，后压上值，注册完毕，上值从栈中弹出
-	luaL_setfuncs(L,l,1);
-
-	return 1;
-}
-=======
-#include "skynet.h"
-#include "lua-seri.h"
-
-#define KNRM  "\x1B[0m"
-#define KRED  "\x1B[31m"
-
-#include <lua.h>
-#include <lauxlib.h>
-#include <stdlib.h>
-#include <string.h>
-#include <assert.h>
-
-struct snlua {
-	lua_State * L;
-	struct skynet_context * ctx;
-	const char * preload;
-};
-
-static int
-traceback (lua_State *L) {
-	const char *msg = lua_tostring(L, 1);
-	if (msg)
-		luaL_traceback(L, L, msg, 1);
-	else {
-		lua_pushliteral(L, "(no error message)");
-	}
-	return 1;
-}
-
-static int
-_cb(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
-	lua_State *L = ud;
-	int trace = 1;
-	int r;
-	int top = lua_gettop(L);
-	if (top == 0) {
-		lua_pushcfunction(L, traceback);
-		lua_rawgetp(L, LUA_REGISTRYINDEX, _cb);
-	} else {
-		assert(top == 2);
-	}
-	lua_pushvalue(L,2);
-
-	lua_pushinteger(L, type);
-	lua_pushlightuserdata(L, (void *)msg);
-	lua_pushinteger(L,sz);
-	lua_pushinteger(L, session);
-	lua_pushinteger(L, source);
-
-	r = lua_pcall(L, 5, 0 , trace);
-
-	if (r == LUA_OK) {
-		return 0;
-	}
-	const char * self = skynet_command(context, "REG", NULL);
-	switch (r) {
-	case LUA_ERRRUN:
-		skynet_error(context, "lua call [%x to %s : %d msgsz = %d] error : " KRED "%s" KNRM, source , self, session, sz, lua_tostring(L,-1));
-		break;
-	case LUA_ERRMEM:
-		skynet_error(context, "lua memory error : [%x to %s : %d]", source , self, session);
-		break;
-	case LUA_ERRERR:
-		skynet_error(context, "lua error in error : [%x to %s : %d]", source , self, session);
-		break;
-	case LUA_ERRGCMM:
-		skynet_error(context, "lua gc error : [%x to %s : %d]", source , self, session);
-		break;
-	};
-
-	lua_pop(L,1);
-
-	return 0;
-}
-
-static int
-forward_cb(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
-	_cb(context, ud, type, session, source, msg, sz);
-	// don't delete msg in forward mode.
-	return 1;
-}
-
-static int
-lcallback(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	int forward = lua_toboolean(L, 2);
-	luaL_checktype(L,1,LUA_TFUNCTION);
-	lua_settop(L,1);
-	lua_rawsetp(L, LUA_REGISTRYINDEX, _cb);
-
-	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
-	lua_State *gL = lua_tothread(L,-1);
-
-	if (forward) {
-		skynet_callback(context, gL, forward_cb);
-	} else {
-		skynet_callback(context, gL, _cb);
-	}
-
-	return 0;
-}
-
-static int
-lcommand(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	const char * cmd = luaL_checkstring(L,1);
-	const char * result;
-	const char * parm = NULL;
-	if (lua_gettop(L) == 2) {
-		parm = luaL_checkstring(L,2);
-	}
-
-	result = skynet_command(context, cmd, parm);
-	if (result) {
-		lua_pushstring(L, result);
-		return 1;
-	}
-	return 0;
-}
-
-static int
-lintcommand(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	const char * cmd = luaL_checkstring(L,1);
-	const char * result;
-	const char * parm = NULL;
-	char tmp[64];	// for integer parm
-	if (lua_gettop(L) == 2) {
-		if (lua_isnumber(L, 2)) {
-			int32_t n = (int32_t)luaL_checkinteger(L,2);
-			sprintf(tmp, "%d", n);
-			parm = tmp;
-		} else {
-			parm = luaL_checkstring(L,2);
-		}
-	}
-
-	result = skynet_command(context, cmd, parm);
-	if (result) {
-		char *endptr = NULL; 
-		lua_Integer r = strtoll(result, &endptr, 0);
-		if (endptr == NULL || *endptr != '\0') {
-			// may be real number
-			double n = strtod(result, &endptr);
-			if (endptr == NULL || *endptr != '\0') {
-				return luaL_error(L, "Invalid result %s", result);
-			} else {
-				lua_pushnumber(L, n);
-			}
-		} else {
-			lua_pushinteger(L, r);
-		}
-		return 1;
-	}
-	return 0;
-}
-
-static int
-lgenid(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	int session = skynet_send(context, 0, 0, PTYPE_TAG_ALLOCSESSION , 0 , NULL, 0);
-	lua_pushinteger(L, session);
-	return 1;
-}
-
-static const char *
-get_dest_string(lua_State *L, int index) {
-	const char * dest_string = lua_tostring(L, index);
-	if (dest_string == NULL) {
-		luaL_error(L, "dest address type (%s) must be a string or number.", lua_typename(L, lua_type(L,index)));
-	}
-	return dest_string;
-}
-
-/*
-	uint32 address
-	 string address
-	integer type
-	integer session
-	string message
-	 lightuserdata message_ptr
-	 integer len
- */
-static int
-lsend(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	uint32_t dest = (uint32_t)lua_tointeger(L, 1);
-	const char * dest_string = NULL;
-	if (dest == 0) {
-		if (lua_type(L,1) == LUA_TNUMBER) {
-			return luaL_error(L, "Invalid service address 0");
-		}
-		dest_string = get_dest_string(L, 1);
-	}
-
-	int type = luaL_checkinteger(L, 2);
-	int session = 0;
-	if (lua_isnil(L,3)) {
-		type |= PTYPE_TAG_ALLOCSESSION;
-	} else {
-		session = luaL_checkinteger(L,3);
-	}
-
-	int mtype = lua_type(L,4);
-	switch (mtype) {
-	case LUA_TSTRING: {
-		size_t len = 0;
-		void * msg = (void *)lua_tolstring(L,4,&len);
-		if (len == 0) {
-			msg = NULL;
-		}
-		if (dest_string) {
-			session = skynet_sendname(context, 0, dest_string, type, session , msg, len);
-		} else {
-			session = skynet_send(context, 0, dest, type, session , msg, len);
-		}
-		break;
-	}
-	case LUA_TLIGHTUSERDATA: {
-		void * msg = lua_touserdata(L,4);
-		int size = luaL_checkinteger(L,5);
-		if (dest_string) {
-			session = skynet_sendname(context, 0, dest_string, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		} else {
-			session = skynet_send(context, 0, dest, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		}
-		break;
-	}
-	default:
-		luaL_error(L, "skynet.send invalid param %s", lua_typename(L, lua_type(L,4)));
-	}
-	if (session < 0) {
-		// send to invalid address
-		// todo: maybe throw an error would be better
-		return 0;
-	}
-	lua_pushinteger(L,session);
-	return 1;
-}
-
-static int
-lredirect(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	uint32_t dest = (uint32_t)lua_tointeger(L,1);
-	const char * dest_string = NULL;
-	if (dest == 0) {
-		dest_string = get_dest_string(L, 1);
-	}
-	uint32_t source = (uint32_t)luaL_checkinteger(L,2);
-	int type = luaL_checkinteger(L,3);
-	int session = luaL_checkinteger(L,4);
-
-	int mtype = lua_type(L,5);
-	switch (mtype) {
-	case LUA_TSTRING: {
-		size_t len = 0;
-		void * msg = (void *)lua_tolstring(L,5,&len);
-		if (len == 0) {
-			msg = NULL;
-		}
-		if (dest_string) {
-			session = skynet_sendname(context, source, dest_string, type, session , msg, len);
-		} else {
-			session = skynet_send(context, source, dest, type, session , msg, len);
-		}
-		break;
-	}
-	case LUA_TLIGHTUSERDATA: {
-		void * msg = lua_touserdata(L,5);
-		int size = luaL_checkinteger(L,6);
-		if (dest_string) {
-			session = skynet_sendname(context, source, dest_string, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		} else {
-			session = skynet_send(context, source, dest, type | PTYPE_TAG_DONTCOPY, session, msg, size);
-		}
-		break;
-	}
-	default:
-		luaL_error(L, "skynet.redirect invalid param %s", lua_typename(L,mtype));
-	}
-	return 0;
-}
-
-static int
-lerror(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	int n = lua_gettop(L);
-	if (n <= 1) {
-		lua_settop(L, 1);
-		const char * s = luaL_tolstring(L, 1, NULL);
-		skynet_error(context, "%s", s);
-		return 0;
-	}
-	luaL_Buffer b;
-	luaL_buffinit(L, &b);
-	int i;
-	for (i=1; i<=n; i++) {
-		luaL_tolstring(L, i, NULL);
-		luaL_addvalue(&b);
-		if (i<n) {
-			luaL_addchar(&b, ' ');
-		}
-	}
-	luaL_pushresult(&b);
-	skynet_error(context, "%s", lua_tostring(L, -1));
-	return 0;
-}
-
-static int
-ltostring(lua_State *L) {
-	if (lua_isnoneornil(L,1)) {
-		return 0;
-	}
-	char * msg = lua_touserdata(L,1);
-	int sz = luaL_checkinteger(L,2);
-	lua_pushlstring(L,msg,sz);
-	return 1;
-}
-
-static int
-lharbor(lua_State *L) {
-	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
-	uint32_t handle = (uint32_t)luaL_checkinteger(L,1);
-	int harbor = 0;
-	int remote = skynet_isremote(context, handle, &harbor);
-	lua_pushinteger(L,harbor);
-	lua_pushboolean(L, remote);
-
-	return 2;
-}
-
-static int
-lpackstring(lua_State *L) {
-	luaseri_pack(L);
-	char * str = (char *)lua_touserdata(L, -2);
-	int sz = lua_tointeger(L, -1);
-	lua_pushlstring(L, str, sz);
-	skynet_free(str);
-	return 1;
-}
-
-static int
-ltrash(lua_State *L) {
-	int t = lua_type(L,1);
-	switch (t) {
-	case LUA_TSTRING: {
-		break;
-	}
-	case LUA_TLIGHTUSERDATA: {
-		void * msg = lua_touserdata(L,1);
-		luaL_checkinteger(L,2);
-		skynet_free(msg);
-		break;
-	}
-	default:
-		luaL_error(L, "skynet.trash invalid param %s", lua_typename(L,t));
-	}
-
-	return 0;
-}
-
-static int
-lnow(lua_State *L) {
-	uint64_t ti = skynet_now();
-	lua_pushinteger(L, ti);
-	return 1;
-}
-
-int
-luaopen_skynet_core(lua_State *L) {
-	luaL_checkversion(L);
-
-	luaL_Reg l[] = {
-		{ "send" , lsend },
-		{ "genid", lgenid },
-		{ "redirect", lredirect },
-		{ "command" , lcommand },
-		{ "intcommand", lintcommand },
-		{ "error", lerror },
-		{ "tostring", ltostring },
-		{ "harbor", lharbor },
-		{ "pack", luaseri_pack },
-		{ "unpack", luaseri_unpack },
-		{ "packstring", lpackstring },
-		{ "trash" , ltrash },
-		{ "callback", lcallback },
-		{ "now", lnow },
-		{ NULL, NULL },
-	};
-
-	luaL_newlibtable(L, l);
-
-	lua_getfield(L, LUA_REGISTRYINDEX, "skynet_context");
-	struct skynet_context *ctx = lua_touserdata(L,-1);
-	if (ctx == NULL) {
-		return luaL_error(L, "Init skynet context first");
-	}
-
-	luaL_setfuncs(L,l,1);
-
-	return 1;
-}
\ No newline at end of file
+#include "skynet.h"
+#include "lua-seri.h"
+
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+struct snlua {
+	lua_State * L;
+	struct skynet_context * ctx;
+	const char * preload;
+};
+
+// 自定义错误处理函数
+static int
+traceback (lua_State *L) {
+	const char *msg = lua_tostring(L, 1);
+	if (msg)
+		luaL_traceback(L, L, msg, 1);
+	else {
+		lua_pushliteral(L, "(no error message)");
+	}
+	return 1;
+}
+
+// 回调函数
+// typedef int (*skynet_cb)(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
+// 
+static int
+_cb(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
+	lua_State *L = ud;
+	int trace = 1;
+	int r;
+	int top = lua_gettop(L);
+	if (top == 0) {
+		// 如果lua栈为空，第一次运行
+		// 先压入c函数traceback
+		lua_pushcfunction(L, traceback);
+		// 再把注册表变量_cb压入栈中
+		lua_rawgetp(L, LUA_REGISTRYINDEX, _cb);
+	} else {
+		// 如果栈不为空，则必须有2个元素，第一次运行压入栈中的traceback和_cb
+		assert(top == 2);
+	}
+	// 复制回调函数再压入栈中
+	lua_pushvalue(L,2);
+
+	// 依次压入参数值
+	lua_pushinteger(L, type);
+	lua_pushlightuserdata(L, (void *)msg);
+	lua_pushinteger(L,sz);
+	lua_pushinteger(L, session);
+	lua_pushinteger(L, source);
+
+	// 执行lua回调方法
+	// skynet.lua 中的 raw_dispatch_message(prototype, msg, sz, session, source)
+	r = lua_pcall(L, 5, 0 , trace);
+
+	if (r == LUA_OK) {
+		return 0;
+	}
+	const char * self = skynet_command(context, "REG", NULL);
+	switch (r) {
+	case LUA_ERRRUN:
+		skynet_error(context, "lua call [%x to %s : %d msgsz = %d] error : " KRED "%s" KNRM, source , self, session, sz, lua_tostring(L,-1));
+		break;
+	case LUA_ERRMEM:
+		skynet_error(context, "lua memory error : [%x to %s : %d]", source , self, session);
+		break;
+	case LUA_ERRERR:
+		skynet_error(context, "lua error in error : [%x to %s : %d]", source , self, session);
+		break;
+	case LUA_ERRGCMM:
+		skynet_error(context, "lua gc error : [%x to %s : %d]", source , self, session);
+		break;
+	};
+
+	// 弹出回调函数副本，保留traceback和_cb
+	lua_pop(L,1);
+
+	return 0;
+}
+
+static int
+forward_cb(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
+	_cb(context, ud, type, session, source, msg, sz);
+	// don't delete msg in forward mode.
+	return 1;
+}
+
+// c.callback(cb, forward)
+static int
+lcallback(lua_State *L) {
+	// 获取第一个上值，skynet_context
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 获取第二个参数值
+	int forward = lua_toboolean(L, 2);
+
+	// 检查第一个参数是否为函数类型
+	luaL_checktype(L,1,LUA_TFUNCTION);
+	// 设置栈顶为1
+	lua_settop(L,1);
+	// 把栈顶函数元素设置为注册表变量_cb
+	lua_rawsetp(L, LUA_REGISTRYINDEX, _cb);
+
+	// 把注册表变量状态机的主线程压入栈中
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	// 从栈中获取状态机
+	lua_State *gL = lua_tothread(L,-1);
+
+	// 注册回调函数
+	if (forward) {
+		skynet_callback(context, gL, forward_cb);
+	} else {
+		skynet_callback(context, gL, _cb);
+	}
+
+	return 0;
+}
+
+// c.command(cmd, parm)
+// 比如 local addr = c.command("QUERY", name)
+// name 为 string，addr 为 string
+static int
+lcommand(lua_State *L) {
+	// 获取第一个上值，skynet_context
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 获取第一个参数值
+	const char * cmd = luaL_checkstring(L,1);
+	const char * result;
+	const char * parm = NULL;
+	if (lua_gettop(L) == 2) {
+		// 如果栈顶为2，获取第二个参数
+		// 检测栈元素类型是否为string，并返回这个字符串
+		parm = luaL_checkstring(L,2);
+	}
+
+	// 调用相应的指令方法
+	result = skynet_command(context, cmd, parm);
+	if (result) {
+		// 如果有返回值，压入值作为lua返回值
+		lua_pushstring(L, result);
+		return 1;
+	}
+	return 0;
+}
+
+// c.intcommand(cmd, parm)
+// 比如 local session = c.intcommand("TIMEOUT", ti)
+// parm 为 integer，session 也为 integer
+static int
+lintcommand(lua_State *L) {
+	// 获取第一个上值，skynet_context
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 获取第一个参数值
+	const char * cmd = luaL_checkstring(L,1);
+	const char * result;
+	const char * parm = NULL;
+	char tmp[64];	// for integer parm
+	if (lua_gettop(L) == 2) {
+		// 如果栈顶为2，获取第二个参数
+		if (lua_isnumber(L, 2)) {
+			int32_t n = (int32_t)luaL_checkinteger(L,2);
+			sprintf(tmp, "%d", n);
+			parm = tmp;
+		} else {
+			parm = luaL_checkstring(L, 2);
+		}
+	}
+
+	result = skynet_command(context, cmd, parm);
+	if (result) {
+		// 如果有返回值，压入栈作为lua返回值
+		char *endptr = NULL;
+		lua_Integer r = strtoll(result, &endptr, 0);
+		if (endptr == NULL || *endptr != '\0') {
+			// may be a real number
+			double n = strtod(result, &endptr);
+			if (endptr == NULL || *endptr != '\0') {
+				return luaL_error(L, "Invalid result %s", result);
+			} else {
+				lua_pushnumber(L, n);
+			}
+		} else {
+			lua_pushinteger(L, r);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+// c.genid
+static int
+lgenid(lua_State *L) { 
+	// 获取第一个上值，skynet_context
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 获取分配的新的session值，并压入栈作为lua返回值
+	int session = skynet_send(context, 0, 0, PTYPE_TAG_ALLOCSESSION , 0 , NULL, 0);
+	lua_pushinteger(L, session);
+	return 1;
+}
+
+// 获取地址名字符串
+static const char *
+get_dest_string(lua_State *L, int index) {
+	const char * dest_string = lua_tostring(L, index);
+	if (dest_string == NULL) {
+		luaL_error(L, "dest address type (%s) must be a string or number.", lua_typename(L, lua_type(L,index)));
+	}
+	return dest_string;
+}
+
+/*
+	uint32 address
+	 string address
+	integer type
+	integer session
+	string message
+	 lightuserdata message_ptr
+	 integer len
+ */
+// local session = c.send(addr, p.id , nil , p.pack(...))
+static int
+lsend(lua_State *L) {
+	// 获取第一个上值，skynet_context
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 获取第一个参数值，目的地地址
+	// 先尝试获取整数型地址
+	uint32_t dest = (uint32_t)lua_tointeger(L, 1);
+	const char * dest_string = NULL;
+	if (dest == 0) {
+		// 如果非整数型地址，获取地址名字符串
+		if (lua_type(L,1) == LUA_TNUMBER) {
+			return luaL_error(L, "Invalid service address 0");
+		}
+		dest_string = get_dest_string(L, 1);
+	}
+
+	// 获取第二个参数值，消息类型
+	int type = luaL_checkinteger(L, 2);
+	int session = 0;
+	if (lua_isnil(L,3)) {
+		// 如果第三个参数为nil，则自动分配新的session
+		type |= PTYPE_TAG_ALLOCSESSION;
+	} else {
+		// 否则获取session值
+		session = luaL_checkinteger(L,3);
+	}
+
+	// 获取第四个参数值
+	int mtype = lua_type(L,4);
+	switch (mtype) {
+	case LUA_TSTRING: {
+		// 如果是字符串
+		size_t len = 0;
+		void * msg = (void *)lua_tolstring(L,4,&len);
+		if (len == 0) {
+			msg = NULL;
+		}
+		if (dest_string) {
+			session = skynet_sendname(context, 0, dest_string, type, session , msg, len);
+		} else {
+			session = skynet_send(context, 0, dest, type, session , msg, len);
+		}
+		break;
+	}
+	case LUA_TLIGHTUSERDATA: {
+		// 如果是轻量级用户数据 msg, sz
+		void * msg = lua_touserdata(L,4);
+		int size = luaL_checkinteger(L,5);
+		if (dest_string) {
+			session = skynet_sendname(context, 0, dest_string, type | PTYPE_TAG_DONTCOPY, session, msg, size);
+		} else {
+			session = skynet_send(context, 0, dest, type | PTYPE_TAG_DONTCOPY, session, msg, size);
+		}
+		break;
+	}
+	default:
+		luaL_error(L, "skynet.send invalid param %s", lua_typename(L, lua_type(L,4)));
+	}
+	if (session < 0) {
+		// send to invalid address
+		// todo: maybe throw an error would be better
+		return 0;
+	}
+	// session值压栈作为lua返回值
+	lua_pushinteger(L,session);
+	return 1;
+}
+
+// c.redirect(address, 0, skynet.PTYPE_ERROR, session, "")
+static int
+lredirect(lua_State *L) {
+	// 获取第一个上值，skynet_context
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 获取第一个参数值，目的地地址
+	// 先尝试获取整数型地址
+	uint32_t dest = (uint32_t)lua_tointeger(L,1);
+	const char * dest_string = NULL;
+	if (dest == 0) {
+		// 如果非整数型地址，获取地址名字符串
+		dest_string = get_dest_string(L, 1);
+	}
+	// 获取第二个参数值，源地址
+	uint32_t source = (uint32_t)luaL_checkinteger(L,2);
+	// 获取第二个参数值，类型
+	int type = luaL_checkinteger(L,3);
+	// 获取第二个参数值，session
+	int session = luaL_checkinteger(L,4);
+
+	// 同lsend方法
+	int mtype = lua_type(L,5);
+	switch (mtype) {
+	case LUA_TSTRING: {
+		size_t len = 0;
+		void * msg = (void *)lua_tolstring(L,5,&len);
+		if (len == 0) {
+			msg = NULL;
+		}
+		if (dest_string) {
+			session = skynet_sendname(context, source, dest_string, type, session , msg, len);
+		} else {
+			session = skynet_send(context, source, dest, type, session , msg, len);
+		}
+		break;
+	}
+	case LUA_TLIGHTUSERDATA: {
+		void * msg = lua_touserdata(L,5);
+		int size = luaL_checkinteger(L,6);
+		if (dest_string) {
+			session = skynet_sendname(context, source, dest_string, type | PTYPE_TAG_DONTCOPY, session, msg, size);
+		} else {
+			session = skynet_send(context, source, dest, type | PTYPE_TAG_DONTCOPY, session, msg, size);
+		}
+		break;
+	}
+	default:
+		luaL_error(L, "skynet.redirect invalid param %s", lua_typename(L,mtype));
+	}
+	// 没有lua返回值
+	return 0;
+}
+
+static int
+lerror(lua_State *L) {
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	// 以 lua 调用点(源文件和行号)作为日志限流的 key
+	uintptr_t site = 0;
+	lua_Debug ar;
+	if (lua_getstack(L, 1, &ar) && lua_getinfo(L, "Sl", &ar)) {
+		site = (uintptr_t)ar.source * 31 + ar.currentline;
+	}
+	int n = lua_gettop(L);
+	if (n <= 1) {
+		lua_settop(L, 1);
+		const char * s = luaL_tolstring(L, 1, NULL);
+		skynet_error_site(context, site, "%s", s);
+		return 0;
+	}
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	int i;
+	for (i=1; i<=n; i++) {
+		luaL_tolstring(L, i, NULL);
+		luaL_addvalue(&b);
+		if (i<n) {
+			luaL_addchar(&b, ' ');
+		}
+	}
+	luaL_pushresult(&b);
+	skynet_error_site(context, site, "%s", lua_tostring(L, -1));
+	return 0;
+}
+
+// c.tostring
+// skynet.tostring
+// userdata(msg) + integer(sz) -> string(str)
+static int
+ltostring(lua_State *L) {
+	if (lua_isnoneornil(L,1)) {
+		return 0;
+	}
+	char * msg = lua_touserdata(L,1);
+	int sz = luaL_checkinteger(L,2);
+	lua_pushlstring(L,msg,sz);
+	return 1;
+}
+
+static int
+lharbor(lua_State *L) {
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	uint32_t handle = (uint32_t)luaL_checkinteger(L,1);
+	int harbor = 0;
+	int remote = skynet_isremote(context, handle, &harbor);
+	lua_pushinteger(L,harbor);
+	lua_pushboolean(L, remote);
+
+	return 2;
+}
+
+// c.packstring
+// skynet.packstring
+// userdata(str) + integer(sz) -> string(str)
+static int
+lpackstring(lua_State *L) {
+	luaseri_pack(L);
+	char * str = (char *)lua_touserdata(L, -2);
+	int sz = lua_tointeger(L, -1);
+	lua_pushlstring(L, str, sz);
+	skynet_free(str);
+	return 1;
+}
+
+// c.trash
+// skynet.trash
+static int
+ltrash(lua_State *L) {
+	int t = lua_type(L,1);
+	switch (t) {
+	case LUA_TSTRING: {
+		break;
+	}
+	case LUA_TLIGHTUSERDATA: {
+		void * msg = lua_touserdata(L,1);
+		luaL_checkinteger(L,2);
+		skynet_free(msg);
+		break;
+	}
+	default:
+		luaL_error(L, "skynet.trash invalid param %s", lua_typename(L,t));
+	}
+
+	return 0;
+}
+
+// c.now
+// skynet.now
+static int
+lnow(lua_State *L) {
+	uint64_t ti = skynet_now();
+	lua_pushinteger(L, ti);
+	return 1;
+}
+
+// c.trace()			返回当前的 trace, span
+// c.trace(true)		开启新的调用链，返回 trace, span
+// c.trace(trace, parent)	加入已有的调用链，返回 trace, span
+// 未开启追踪(没有配置 tracefile)时返回 0, 0
+static int
+ltrace(lua_State *L) {
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	if (lua_type(L, 1) == LUA_TNUMBER) {
+		uint32_t trace = (uint32_t)luaL_checkinteger(L, 1);
+		uint32_t parent = (uint32_t)luaL_optinteger(L, 2, 0);
+		if (trace) {
+			skynet_trace_begin(context, trace, parent);
+		}
+	} else if (lua_toboolean(L, 1)) {
+		skynet_trace_begin(context, 0, 0);
+	}
+	uint32_t span = 0;
+	uint32_t trace = skynet_trace_current(context, &span);
+	lua_pushinteger(L, trace);
+	lua_pushinteger(L, span);
+	return 2;
+}
+
+// require "skynet.core"
+int
+luaopen_skynet_core(lua_State *L) {
+	// 检查调用它的内核是否是创建这个 Lua 状态机的内核，以及调用它的代码是否使用了相同的 Lua 版本，同时也检查调用它的内核与创建该 Lua 状态机的内核 是否使用了同一片地址空间。
+	luaL_checkversion(L);
+
+	luaL_Reg l[] = {
+		{ "send" , lsend },
+		{ "genid", lgenid },
+		{ "redirect", lredirect },
+		{ "command" , lcommand },
+		{ "intcommand", lintcommand },
+		{ "error", lerror },
+		{ "tostring", ltostring },
+		{ "harbor", lharbor },
+		{ "pack", luaseri_pack },
+		{ "unpack", luaseri_unpack },
+		{ "packstring", lpackstring },
+		{ "trash" , ltrash },
+		{ "callback", lcallback },
+		{ "now", lnow },
+		{ "trace", ltrace },
+		{ NULL, NULL },
+	};
+
+	// 创建一张新的表，并预分配足够保存下数组 l 内容的空间（但不填充）
+	luaL_newlibtable(L, l);
+
+	// 把注册表变量skynet_context压入栈中，作为所有注册函数的上值
+	lua_getfield(L, LUA_REGISTRYINDEX, "skynet_context");
+	// 如果snlua服务的init_cb方法中正常执行，获取到的ctx应该不为空
+	struct skynet_context *ctx = lua_touserdata(L,-1);
+	if (ctx == NULL) {
+		return luaL_error(L, "Init skynet context first");
+	}
+
+	// 把数组 l 中的所有函数注册到栈顶的表中
+	// nup = 1 一个上值，skynet_context
+	// 先压表，后压上值，注册完毕，上值从栈中弹出
+	luaL_setfuncs(L,l,1);
+
+	return 1;
+}
@@ -11,8 +11,12 @@
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "skynet_socket.h"
+#include "socket_server.h"
 
 #define BACKLOG 32
 // 2 ** 12 == 4096
@@ -617,9 +621,15 @@ lconnect(lua_State *L) {
 	const char * addr = luaL_checklstring(L,1,&sz);
 	char tmp[sz];
 	int port = 0;
-	const char * host = address_port(L, tmp, addr, 2, &port);
-	if (port == 0) {
-		return luaL_error(L, "Invalid port");
+	const char * host;
+	if (strncmp(addr, "unix:", 5) == 0) {
+		// unix:path ，没有端口
+		host = addr;
+	} else {
+		host = address_port(L, tmp, addr, 2, &port);
+		if (port == 0) {
+			return luaL_error(L, "Invalid port");
+		}
 	}
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
 	// skynet_socket_connect 	skynet_socket
@@ -669,7 +679,8 @@ lshutdown(lua_State *L) {
 static int
 llisten(lua_State *L) {
 	const char * host = luaL_checkstring(L,1);
-	int port = luaL_checkinteger(L,2);
+	// unix:path 监听 unix 套接字，端口被忽略
+	int port = strncmp(host, "unix:", 5) == 0 ? luaL_optinteger(L,2,0) : luaL_checkinteger(L,2);
 	int backlog = luaL_optinteger(L,3,BACKLOG);
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
 	// skynet_socket_listen	skynet_socket
@@ -769,6 +780,50 @@ lsend(lua_State *L) {
 	return 1;
 }
 
+// driver.sendfile(fd, filename, offset, sz)
+// socket.sendfile socket.lua
+// 文件由socket线程用 sendfile 发送，不经过lua内存，sz 默认为 offset 之后的全部
+static int
+lsendfile(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	const char * filename = luaL_checkstring(L, 2);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	lua_Integer sz = luaL_optinteger(L, 4, -1);
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size < 0) {
+		close(fd);
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	if (offset < 0 || offset > size) {
+		close(fd);
+		return luaL_error(L, "Invalid offset %d (size = %d)", (int)offset, (int)size);
+	}
+	if (sz < 0 || sz > size - offset) {
+		sz = size - offset;
+	}
+	if (sz > INT32_MAX) {
+		close(fd);
+		return luaL_error(L, "File %s is too large", filename);
+	}
+	// fd 由 socket_server 接管
+	int err = skynet_socket_sendfile(ctx, id, fd, offset, (int)sz);
+	lua_pushboolean(L, !err);
+	if (err) {
+		return 1;
+	}
+	lua_pushinteger(L, sz);
+	return 2;
+}
+
 // driver.lsend
 // socket.lwrite socket.lua
 // socket_lwrite(fd, v) socketchannel.lua
@@ -782,6 +837,27 @@ lsendlow(lua_State *L) {
 	return 0;
 }
 
+// driver.broadcast({id, ...}, data [, sz])
+// gateserver.broadcast gateserver.lua
+// 同一份数据发送给多个socket，只复制一次，返回加入发送队列的socket数量
+static int
+lbroadcast(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = (int)lua_rawlen(L, 1);
+	int *id = lua_newuserdata(L, (n > 0 ? n : 1) * sizeof(int));
+	int i;
+	for (i=0;i<n;i++) {
+		lua_rawgeti(L, 1, i+1);
+		id[i] = luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+	}
+	int sz = 0;
+	void *buffer = get_buffer(L, 2, &sz);
+	lua_pushinteger(L, skynet_socket_broadcast(ctx, id, n, buffer, sz));
+	return 1;
+}
+
 // driver.bind
 // socket.bind socket.lua
 static int
@@ -825,6 +901,52 @@ lnodelay(lua_State *L) {
 	return 0;
 }
 
+// driver.coalesce(fd, enable)
+// the data of fd (and the connections accepted by it) are delivered as SKYNET_SOCKET_TYPE_BATCH,
+// only netpack (gateserver) understands it
+static int
+lcoalesce(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int enable = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+	skynet_socket_coalesce(ctx, id, enable);
+	return 0;
+}
+
+// driver.frame(fd, header, max)
+// the socket thread splits the stream of fd (and the connections accepted by it) into packages
+// by a big-endian length header of 2 or 4 bytes (0 to disable), delivered as SKYNET_SOCKET_TYPE_FRAME.
+// a package longer than max (default 64K) closes the connection.
+// only netpack (gateserver) understands it
+static int
+lframe(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int header = luaL_optinteger(L, 2, 2);
+	if (header != 0 && header != 2 && header != 4) {
+		return luaL_error(L, "Invalid frame header size %d", header);
+	}
+	int max = luaL_optinteger(L, 3, 0);
+	skynet_socket_frame(ctx, id, header, max);
+	return 0;
+}
+
+// driver.watermark(fd, high, low, limit)
+// socket.watermark(fd, high, low, limit) socket.lua
+static int
+lwatermark(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	lua_Integer high = luaL_checkinteger(L, 2);
+	lua_Integer low = luaL_optinteger(L, 3, 0);
+	lua_Integer limit = luaL_optinteger(L, 4, 0);
+	if (low > high) {
+		return luaL_error(L, "Invalid watermark, low (%d) > high (%d)", (int)low, (int)high);
+	}
+	skynet_socket_watermark(ctx, id, high, low, limit);
+	return 0;
+}
+
 // driver.udp(host, port)
 // socket.udp(callback, host, port) socket.lua
 static int
@@ -928,6 +1050,125 @@ ludp_address(lua_State *L) {
 	return 2;
 }
 
+// driver.udp_batch(msg, n)
+// 拆开 udp_batch 合并的 n 个数据报，释放 msg
+// return { data1, address1, data2, address2, ... }
+static int
+ludp_batch(lua_State *L) {
+	char * msg = lua_touserdata(L,1);
+	int n = luaL_checkinteger(L,2);
+	lua_createtable(L, n*2, 0);
+	char * ptr = msg;
+	int i;
+	for (i=0;i<n;i++) {
+		uint32_t sz;
+		memcpy(&sz, ptr, sizeof(sz));
+		ptr += sizeof(sz);
+		struct skynet_socket_message m;
+		m.type = SKYNET_SOCKET_TYPE_UDP;
+		m.id = 0;
+		m.ud = (int)sz;
+		m.buffer = ptr;
+		int addrsz = 0;
+		const char * address = skynet_socket_udp_address(&m, &addrsz);
+		if (address == NULL) {
+			skynet_free(msg);
+			return luaL_error(L, "Invalid udp batch");
+		}
+		lua_pushlstring(L, ptr, sz);
+		lua_rawseti(L, -2, i*2+1);
+		lua_pushlstring(L, address, addrsz);
+		lua_rawseti(L, -2, i*2+2);
+		ptr += sz + addrsz;
+	}
+	skynet_free(msg);
+	return 1;
+}
+
+// driver.stat()
+// return { write_syscall = , write_bytes = , accept = , accept_error = , accept_drop = }
+static int
+lstat(lua_State *L) {
+	struct skynet_socket_stat stat;
+	skynet_socket_stat(&stat);
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, (lua_Integer)stat.write_syscall);
+	lua_setfield(L, -2, "write_syscall");
+	lua_pushinteger(L, (lua_Integer)stat.write_bytes);
+	lua_setfield(L, -2, "write_bytes");
+	lua_pushinteger(L, (lua_Integer)stat.accept);
+	lua_setfield(L, -2, "accept");
+	lua_pushinteger(L, (lua_Integer)stat.accept_error);
+	lua_setfield(L, -2, "accept_error");
+	lua_pushinteger(L, (lua_Integer)stat.accept_drop);
+	lua_setfield(L, -2, "accept_drop");
+	return 1;
+}
+
+static void
+push_info(lua_State *L, struct socket_info *si) {
+	lua_createtable(L, 0, 16);
+	lua_pushinteger(L, si->id);
+	lua_setfield(L, -2, "id");
+	lua_pushstring(L, si->type);
+	lua_setfield(L, -2, "type");
+	lua_pushinteger(L, (lua_Integer)si->opaque);
+	lua_setfield(L, -2, "address");
+	lua_pushinteger(L, (lua_Integer)si->recv_bytes);
+	lua_setfield(L, -2, "recv_bytes");
+	lua_pushinteger(L, (lua_Integer)si->recv_packets);
+	lua_setfield(L, -2, "recv_packets");
+	lua_pushinteger(L, (lua_Integer)si->send_bytes);
+	lua_setfield(L, -2, "send_bytes");
+	lua_pushinteger(L, (lua_Integer)si->send_packets);
+	lua_setfield(L, -2, "send_packets");
+	lua_pushinteger(L, (lua_Integer)si->wb_size);
+	lua_setfield(L, -2, "wbuffer");
+	lua_pushinteger(L, (lua_Integer)si->idle_ms);
+	lua_setfield(L, -2, "idle");
+	if (si->name[0]) {
+		lua_pushstring(L, si->name);
+		lua_setfield(L, -2, "peer");
+	}
+	if (si->tcp_info) {
+		lua_pushinteger(L, si->rtt);
+		lua_setfield(L, -2, "rtt");
+		lua_pushinteger(L, si->rttvar);
+		lua_setfield(L, -2, "rttvar");
+		lua_pushinteger(L, si->retransmits);
+		lua_setfield(L, -2, "retransmits");
+		lua_pushinteger(L, si->cwnd);
+		lua_setfield(L, -2, "cwnd");
+		lua_pushinteger(L, si->unacked);
+		lua_setfield(L, -2, "unacked");
+	}
+}
+
+// driver.info([id])
+// return the info table of socket id, or an array of all sockets when id is nil
+static int
+linfo(lua_State *L) {
+	int id = (int)luaL_optinteger(L, 1, -1);
+	struct socket_info *si = skynet_socket_info(id);
+	if (id >= 0) {
+		if (si == NULL) {
+			return 0;
+		}
+		push_info(L, si);
+		skynet_socket_info_release(si);
+		return 1;
+	}
+	lua_newtable(L);
+	struct socket_info *p;
+	int n = 0;
+	for (p = si; p; p = p->next) {
+		push_info(L, p);
+		lua_rawseti(L, -2, ++n);
+	}
+	skynet_socket_info_release(si);
+	return 1;
+}
+
 // require "socketdriver"
 int
 luaopen_socketdriver(lua_State *L) {
@@ -944,6 +1185,7 @@ luaopen_socketdriver(lua_State *L) {
 		{ "header", lheader },
 
 		{ "unpack", lunpack },
+		{ "udp_batch", ludp_batch },
 		{ NULL, NULL },
 	};
 	// 创建一张新的表，并把列表 l 中的函数注册进去
@@ -955,13 +1197,20 @@ luaopen_socketdriver(lua_State *L) {
 		{ "listen", llisten },
 		{ "send", lsend },
 		{ "lsend", lsendlow },
+		{ "broadcast", lbroadcast },
 		{ "bind", lbind },
 		{ "start", lstart },
 		{ "nodelay", lnodelay },
+		{ "coalesce", lcoalesce },
+		{ "frame", lframe },
+		{ "sendfile", lsendfile },
+		{ "watermark", lwatermark },
 		{ "udp", ludp },
 		{ "udp_connect", ludp_connect },
 		{ "udp_send", ludp_send },
 		{ "udp_address", ludp_address },
+		{ "stat", lstat },
+		{ "info", linfo },
 		{ NULL, NULL },
 	};
 	// 把注册表变量skynet_context压入栈中
@@ -61,6 +61,7 @@ local watching_session = {}				-- session -> service
 local dead_service = {}					-- service -> true/nil
 local error_queue = {}					-- index -> session
 local fork_queue = {}					-- index -> co
+local dispatch_finish = nil				-- 每条消息(包括fork)处理完之后调用
 
 -- suspend is function
 local suspend
@@ -540,6 +541,13 @@ function skynet.dispatch_unknown_response(unknown)
 	return prev
 end
 
+-- func() 在每条消息以及其中fork的协程处理完之后调用，socket.cork 用它合并写入
+function skynet.dispatch_finish(func)
+	local prev = dispatch_finish
+	dispatch_finish = func
+	return prev
+end
+
 -- fork一个新协程处理逻辑
 function skynet.fork(func,...)
 	local args = table.pack(...)
@@ -631,6 +639,17 @@ function skynet.dispatch_message(...)
 			end
 		end
 	end
+	if dispatch_finish then
+		local finish_succ, finish_err = pcall(dispatch_finish)
+		if not finish_succ then
+			if succ then
+				succ = false
+				err = tostring(finish_err)
+			else
+				err = tostring(err) .. "\n" .. tostring(finish_err)
+			end
+		end
+	end
 	assert(succ, tostring(err))
 end
 
@@ -675,6 +694,23 @@ end
 
 skynet.error = c.error
 
+-- 调用链追踪，需要在配置中设置 tracefile
+-- 在处理消息的过程中开启一条新的调用链，之后通过 skynet.call/skynet.send/skynet.ret 发出的消息都会自动携带调用链
+-- 返回 trace, span ，未开启追踪时返回 0, 0
+function skynet.trace()
+	return c.trace(true)
+end
+
+-- 返回当前消息所属的 trace, span
+function skynet.tracecontext()
+	return c.trace()
+end
+
+-- 当前消息加入已有的调用链 (比如来自其他节点的请求)
+function skynet.settrace(trace, parent)
+	return c.trace(trace, parent)
+end
+
 ----- register protocol
 -- 默认注册了PTYPE_LUA、PTYPE_RESPONSE、PTYPE_ERROR三类消息协议
 do
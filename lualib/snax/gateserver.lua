@@ -13,6 +13,18 @@ local nodelay = false
 
 local connection = {}
 
+-- 空闲超时：所有连接共用一个 1 秒一格的时间轮，只有一个定时器
+local WHEEL_SIZE = 256
+local timeout		-- 空闲超时，秒，nil 表示不超时
+local active = {}	-- fd -> 最后一次收到数据的时间，skynet.now()
+local wheel = {}	-- 每格一个 fd 集合
+local wheel_time	-- 时间轮已经转到的时间，秒
+
+-- 令牌桶限速，每个连接最多积累 1 秒的量
+local packet_rate	-- 每秒最多收到的包数，nil 表示不限制
+local byte_rate		-- 每秒最多收到的字节数，nil 表示不限制
+local bucket = {}	-- fd -> { time, packet, byte }，单位为 1/100 个包(字节)
+
 function gateserver.openclient(fd)
 	if connection[fd] then
 		socketdriver.start(fd)
@@ -27,6 +39,92 @@ function gateserver.closeclient(fd)
 	end
 end
 
+-- send one message (string, or lightuserdata and sz such as netpack.pack) to many clients.
+-- the data is copied once and shared by all of them. fds is a list of fd, nil for all opened clients.
+-- returns the number of clients the message is queued for.
+function gateserver.broadcast(fds, msg, sz)
+	if fds == nil then
+		fds = {}
+		for fd, c in pairs(connection) do
+			if c then
+				fds[#fds+1] = fd
+			end
+		end
+	end
+	return socketdriver.broadcast(fds, msg, sz)
+end
+
+local function wheel_link(fd, expire)
+	local slot = expire % WHEEL_SIZE
+	local s = wheel[slot]
+	if not s then
+		s = {}
+		wheel[slot] = s
+	end
+	s[fd] = true
+end
+
+-- 格子到期时检查其中的连接，没有超时的按新的到期时间重新放入
+local function wheel_tick()
+	local now = skynet.now() // 100
+	if now - wheel_time > WHEEL_SIZE then
+		wheel_time = now - WHEEL_SIZE
+	end
+	while wheel_time < now do
+		wheel_time = wheel_time + 1
+		local slot = wheel_time % WHEEL_SIZE
+		local s = wheel[slot]
+		if s then
+			wheel[slot] = nil
+			for fd in pairs(s) do
+				local t = active[fd]
+				if t then
+					local expire = t // 100 + timeout
+					if expire <= wheel_time then
+						skynet.error(string.format("gateserver: drop fd (%d) idle timeout", fd))
+						gateserver.closeclient(fd)
+					else
+						wheel_link(fd, expire)
+					end
+				end
+			end
+		end
+	end
+	skynet.timeout(100, wheel_tick)
+end
+
+-- 收到一个 sz 字节的包，超过限速时返回 false
+local function limit(fd, sz)
+	local b = bucket[fd]
+	if not b then
+		return true
+	end
+	local now = skynet.now()
+	local elapsed = now - b.time
+	if elapsed > 0 then
+		b.time = now
+		if packet_rate then
+			b.packet = math.min(b.packet + elapsed * packet_rate, packet_rate * 100)
+		end
+		if byte_rate then
+			b.byte = math.min(b.byte + elapsed * byte_rate, byte_rate * 100)
+		end
+	end
+	if packet_rate then
+		b.packet = b.packet - 100
+		if b.packet < 0 then
+			return false
+		end
+	end
+	if byte_rate then
+		b.byte = b.byte - sz * 100
+		if b.byte < 0 then
+			return false
+		end
+	end
+	return true
+end
+
 function gateserver.start(handler)
 	assert(handler.message)
 	assert(handler.connect)
@@ -37,8 +135,28 @@ function gateserver.start(handler)
 		local port = assert(conf.port)
 		maxclient = conf.maxclient or 1024
 		nodelay = conf.nodelay
+		if conf.packet_rate and conf.packet_rate > 0 then
+			packet_rate = conf.packet_rate
+		end
+		if conf.byte_rate and conf.byte_rate > 0 then
+			byte_rate = conf.byte_rate
+		end
+		if conf.timeout and conf.timeout > 0 then
+			-- 空闲超时，秒
+			timeout = conf.timeout
+			wheel_time = skynet.now() // 100
+			skynet.timeout(100, wheel_tick)
+		end
 		skynet.error(string.format("Listen on %s:%d", address, port))
-		socket = socketdriver.listen(address, port)
+		socket = socketdriver.listen(address, port, conf.backlog)
+		if conf.coalesce then
+			-- 一批事件中读到的数据合并成一条消息
+			socketdriver.coalesce(socket, true)
+		end
+		if conf.frame then
+			-- 由socket线程按2字节包头分包，conf.frame_max 为包的最大长度 (默认 64K)
+			socketdriver.frame(socket, 2, conf.frame_max)
+		end
 		socketdriver.start(socket)
 		if handler.open then
 			return handler.open(source, conf)
@@ -54,7 +172,19 @@ function gateserver.start(handler)
 
 	local function dispatch_msg(fd, msg, sz)
 		if connection[fd] then
-			handler.message(fd, msg, sz)
+			if timeout then
+				active[fd] = skynet.now()
+			end
+			if limit(fd, sz + 2) then
+				handler.message(fd, msg, sz)
+			else
+				skynet.trash(msg, sz)
+				skynet.error(string.format("gateserver: drop fd (%d) rate limit", fd))
+				gateserver.closeclient(fd)
+			end
+		elseif connection[fd] == false then
+			-- 已经关闭的连接，剩余的数据直接丢弃
+			skynet.trash(msg, sz)
 		else
 			skynet.error(string.format("Drop message from fd (%d) : %s", fd, netpack.tostring(msg,sz)))
 		end
@@ -99,6 +229,18 @@ function gateserver.start(handler)
 		end
 		connection[fd] = true
 		client_number = client_number + 1
+		if timeout then
+			local now = skynet.now()
+			active[fd] = now
+			wheel_link(fd, now // 100 + timeout)
+		end
+		if packet_rate or byte_rate then
+			bucket[fd] = {
+				time = skynet.now(),
+				packet = (packet_rate or 0) * 100,
+				byte = (byte_rate or 0) * 100,
+			}
+		end
 		handler.connect(fd, msg)
 	end
 
@@ -106,6 +248,8 @@ function gateserver.start(handler)
 		local c = connection[fd]
 		if c ~= nil then
 			connection[fd] = nil
+			active[fd] = nil
+			bucket[fd] = nil
 			client_number = client_number - 1
 		end
 	end
@@ -19,6 +19,17 @@ local socket_pool = setmetatable( -- store all socket object
 
 local socket_message = {}
 
+-- corked sockets, id -> { buffer = {string}, size = , limit = }
+local corked = {}
+local corked_dirty = {}	-- id -> true, corked sockets with pending data
+local DEFAULT_CORK_LIMIT = 64 * 1024
+
+-- the socket is gone, drop the pending data of socket.cork
+local function drop_corked(id)
+	corked[id] = nil
+	corked_dirty[id] = nil
+end
+
 local function wakeup(s)
 	local co = s.co
 	if co then
@@ -87,6 +98,7 @@ end
 
 -- SKYNET_SOCKET_TYPE_CLOSE = 3
 socket_message[3] = function(id)
+	drop_corked(id)
 	local s = socket_pool[id]
 	if s == nil then
 		return
@@ -107,6 +119,7 @@ end
 
 -- SKYNET_SOCKET_TYPE_ERROR = 5
 socket_message[5] = function(id, _, err)
+	drop_corked(id)
 	local s = socket_pool[id]
 	if s == nil then
 		skynet.error("socket: error on unknown", id, err)
@@ -131,25 +144,34 @@ socket_message[6] = function(id, size, data, address)
 		driver.drop(data, size)
 		return
 	end
+	if size < 0 then
+		-- -size packages received by one recvmmsg (udp_batch)
+		local batch = driver.udp_batch(data, -size)
+		for i = 1, #batch, 2 do
+			s.callback(batch[i], batch[i+1])
+		end
+		return
+	end
 	local str = skynet.tostring(data, size)
 	skynet_core.trash(data, size)
 	s.callback(str, address)
 end
 
 local function default_warning(id, size)
-	local s = socket_pool[id]
-		local last = s.warningsize or 0
-		if last + 64 < size then	-- if size increase 64K
-			s.warningsize = size
-			skynet.error(string.format("WARNING: %d K bytes need to send out (fd = %d)", size, id))
-		end
-		s.warningsize = size
+	if size > 0 then
+		skynet.error(string.format("WARNING: %d K bytes need to send out (fd = %d)", size, id))
+	else
+		skynet.error(string.format("WARNING: send buffer drained (fd = %d)", id))
+	end
 end
 
 -- SKYNET_SOCKET_TYPE_WARNING
+-- size > 0 : send buffer (size K bytes) is over the high watermark, pause sending
+-- size == 0 : send buffer drained to the low watermark, resume sending
 socket_message[7] = function(id, size)
 	local s = socket_pool[id]
 	if s then
+		s.paused = size > 0
 		local warning = s.warning or default_warning
 		warning(id, size)
 	end
@@ -192,6 +214,7 @@ local function connect(id, func)
 	end
 end
 
+-- addr may be "unix:/path/to/sock" (or "unix:@name" for linux abstract namespace) to connect an AF_UNIX stream socket
 function socket.open(addr, port)
 	local id = driver.connect(addr,port)
 	return connect(id)
@@ -224,15 +247,18 @@ local function close_fd(id, func)
 end
 
 function socket.shutdown(id)
+	socket.uncork(id)
 	close_fd(id, driver.shutdown)
 end
 
 function socket.close_fd(id)
 	assert(socket_pool[id] == nil,"Use socket.close instead")
+	drop_corked(id)
 	driver.close(id)
 end
 
 function socket.close(id)
+	socket.uncork(id)
 	local s = socket_pool[id]
 	if s == nil then
 		return
@@ -346,16 +372,120 @@ function socket.block(id)
 	return s.connected
 end
 
-socket.write = assert(driver.send)
+local function flush_corked(id, c)
+	corked_dirty[id] = nil
+	if c.size == 0 then
+		return true
+	end
+	local buffer = c.buffer
+	c.buffer = {}
+	c.size = 0
+	-- driver.send concats the table into one buffer, one request to the socket thread
+	return driver.send(id, buffer)
+end
+
+local prev_finish	-- the dispatch_finish hook installed before socket.cork
+local finish_installed = false
+
+local function flush_all()
+	for id in pairs(corked_dirty) do
+		local c = corked[id]
+		if c then
+			flush_corked(id, c)
+		else
+			corked_dirty[id] = nil
+		end
+	end
+	if prev_finish then
+		prev_finish()
+	end
+end
+
+local function cork_write(id, c, data, sz)
+	local t = type(data)
+	if t == "string" then
+		local buffer = c.buffer
+		buffer[#buffer+1] = data
+		c.size = c.size + #data
+	elseif t == "table" then
+		local buffer = c.buffer
+		for i = 1, #data do
+			local str = data[i]
+			buffer[#buffer+1] = str
+			c.size = c.size + #str
+		end
+	else
+		-- userdata can't be merged, flush pending data first to keep the order
+		flush_corked(id, c)
+		return driver.send(id, data, sz)
+	end
+	if c.size >= c.limit then
+		return flush_corked(id, c)
+	end
+	corked_dirty[id] = true
+	return true
+end
+
+function socket.write(id, data, sz)
+	local c = corked[id]
+	if c then
+		return cork_write(id, c, data, sz)
+	end
+	return driver.send(id, data, sz)
+end
+
+-- Writes to a corked socket are merged and sent as one request when the current message
+-- (including the coroutines forked in it) is handled, or on socket.flush,
+-- or at once when the pending size reaches limit (default 64K).
+function socket.cork(id, limit)
+	local c = corked[id]
+	if c then
+		c.limit = limit or c.limit
+		return
+	end
+	corked[id] = { buffer = {}, size = 0, limit = limit or DEFAULT_CORK_LIMIT }
+	if not finish_installed then
+		finish_installed = true
+		prev_finish = skynet.dispatch_finish(flush_all)
+	end
+end
+
+function socket.uncork(id)
+	local c = corked[id]
+	if c then
+		flush_corked(id, c)
+		corked[id] = nil
+	end
+end
+
+function socket.flush(id)
+	local c = corked[id]
+	if c then
+		return flush_corked(id, c)
+	end
+	return true
+end
+
 socket.lwrite = assert(driver.lsend)
+-- socket.sendfile(id, filename [, offset [, sz]]) send the file by sendfile in socket thread, in order with socket.write
+-- return true, bytes or false, error
+function socket.sendfile(id, filename, offset, sz)
+	local c = corked[id]
+	if c then
+		flush_corked(id, c)
+	end
+	return driver.sendfile(id, filename, offset, sz)
+end
 socket.header = assert(driver.header)
 
 function socket.invalid(id)
 	return socket_pool[id] == nil
 end
 
+-- backlog is the length of the listen queue (default 32, capped by net.core.somaxconn)
+-- host "unix:/path/to/sock" listens on an AF_UNIX stream socket, port is ignored
 function socket.listen(host, port, backlog)
-	if port == nil then
+	if port == nil and host:sub(1,5) ~= "unix:" then
 		host, port = string.match(host, "([^:]+):(.+)$")
 		port = tonumber(port)
 	end
@@ -397,6 +527,8 @@ function socket.abandon(id)
 	if s and s.buffer then
 		driver.clear(s.buffer,buffer_pool)
 	end
+	-- the pending data belongs to this service, send it before the socket is forwarded
+	socket.uncork(id)
 	socket_pool[id] = nil
 end
 
@@ -438,11 +570,27 @@ end
 
 socket.sendto = assert(driver.udp_send)
 socket.udp_address = assert(driver.udp_address)
+-- { write_syscall = , write_bytes = } of all sockets, write_bytes / write_syscall is the average bytes flushed per syscall
+socket.stat = assert(driver.stat)
+-- socket.info(id) returns the traffic and tcp info of socket id, socket.info() returns an array of all sockets
+socket.info = assert(driver.info)
 
+-- callback(id, size) : size > 0 means pause (size K bytes to send out), size == 0 means resume
 function socket.warning(id, callback)
 	local obj = socket_pool[id]
 	assert(obj)
 	obj.warning = callback
 end
 
+-- set send buffer watermark of the socket, the default is 1M high, 0 low and no limit
+-- the connection is closed when the send buffer grows over limit (0 for no limit)
+function socket.watermark(id, high, low, limit)
+	driver.watermark(id, high, low, limit)
+end
+
+function socket.paused(id)
+	local s = socket_pool[id]
+	return s ~= nil and s.paused == true
+end
+
 return socket
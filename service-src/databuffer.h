@@ -88,6 +88,25 @@ databuffer_read(struct databuffer *db, struct messagepool *mp, void * buffer, in
 	}
 }
 
+// 长度为 sz 的包正好是头部消息剩下的全部数据时，直接取走这块内存
+// 数据移到开头(跳过已读的包头)，不需要重新分配和复制，其他情况返回 NULL
+static void *
+databuffer_take(struct databuffer *db, struct messagepool *mp, int sz) {
+	struct message *current = db->head;
+	if (current == NULL || current->size - db->offset != sz) {
+		return NULL;
+	}
+	char * buffer = current->buffer;
+	if (db->offset > 0) {
+		memmove(buffer, buffer + db->offset, sz);
+	}
+	current->buffer = NULL;
+	db->size -= sz;
+	db->offset = 0;
+	_return_message(db, mp);
+	return buffer;
+}
+
 static void
 databuffer_push(struct databuffer *db, struct messagepool *mp, void *data, int sz) {
 	struct message * m;
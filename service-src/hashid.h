@@ -2,119 +2,169 @@
 #define skynet_hashid_h
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+// socket id 到连接下标的映射
+// 开放地址法，线性探测，键值对连续存放，探测时访问相邻的内存
+// 装载因子不超过 1/2，满了以后容量翻倍，没有上限
+// 下标在 [0, cap) 中分配，删除后回收；插入可能增加 cap，调用者需要同步扩大自己的数组
+
 struct hashid_node {
-	int id;
-	struct hashid_node *next;
+	int id;		// -1 为空
+	int index;
 };
 
 struct hashid {
-	int hashmod;
-	int cap;
+	int bits;	// 桶数量为 1 << bits
+	int cap;	// 可以分配的下标数量，桶数量的一半
 	int count;
-	struct hashid_node *id;
-	struct hashid_node **hash;
+	int free_n;	// 空闲下标数量
+	int *free;	// 空闲下标栈，先分配小的下标
+	struct hashid_node *hash;
 };
 
+// 斐波那契散列，连续的 socket id 也能均匀分布
+static inline int
+hashid_slot(struct hashid *hi, int id) {
+	return (int)(((uint32_t)id * 2654435769u) >> (32 - hi->bits));
+}
+
 static void
-hashid_init(struct hashid *hi, int max) {
+hashid_alloc(struct hashid *hi, int bits) {
+	int n = 1 << bits;
 	int i;
-	int hashcap;
-	hashcap = 16;
-	while (hashcap < max) {
-		hashcap *= 2;
+	hi->bits = bits;
+	hi->cap = n / 2;
+	hi->hash = skynet_malloc(n * sizeof(struct hashid_node));
+	for (i=0;i<n;i++) {
+		hi->hash[i].id = -1;
+		hi->hash[i].index = -1;
 	}
-	hi->hashmod = hashcap - 1;
-	hi->cap = max;
-	hi->count = 0;
-	hi->id = skynet_malloc(max * sizeof(struct hashid_node));
-	for (i=0;i<max;i++) {
-		hi->id[i].id = -1;
-		hi->id[i].next = NULL;
+}
+
+// 把下标 [from, to) 放入空闲栈
+static void
+hashid_free_range(struct hashid *hi, int from, int to) {
+	int i;
+	for (i=to-1;i>=from;i--) {
+		hi->free[hi->free_n++] = i;
 	}
-	hi->hash = skynet_malloc(hashcap * sizeof(struct hashid_node *));
-	memset(hi->hash, 0, hashcap * sizeof(struct hashid_node *));
+}
+
+// 预分配至少 n 个下标
+static void
+hashid_init(struct hashid *hi, int n) {
+	int bits = 4;
+	while ((1 << bits) < n * 2) {
+		++bits;
+	}
+	hashid_alloc(hi, bits);
+	hi->count = 0;
+	hi->free_n = 0;
+	hi->free = skynet_malloc(hi->cap * sizeof(int));
+	hashid_free_range(hi, 0, hi->cap);
 }
 
 static void
 hashid_clear(struct hashid *hi) {
-	skynet_free(hi->id);
+	skynet_free(hi->free);
 	skynet_free(hi->hash);
-	hi->id = NULL;
+	hi->free = NULL;
 	hi->hash = NULL;
-	hi->hashmod = 1;
+	hi->bits = 0;
 	hi->cap = 0;
 	hi->count = 0;
+	hi->free_n = 0;
+}
+
+static void
+hashid_put(struct hashid *hi, int id, int index) {
+	int mask = (1 << hi->bits) - 1;
+	int h = hashid_slot(hi, id);
+	while (hi->hash[h].id >= 0) {
+		h = (h + 1) & mask;
+	}
+	hi->hash[h].id = id;
+	hi->hash[h].index = index;
+}
+
+// 桶数量翻倍并重新散列，已分配的下标不变
+static void
+hashid_grow(struct hashid *hi) {
+	struct hashid_node *old = hi->hash;
+	int n = 1 << hi->bits;
+	int cap = hi->cap;
+	int i;
+	hashid_alloc(hi, hi->bits + 1);
+	for (i=0;i<n;i++) {
+		if (old[i].id >= 0) {
+			hashid_put(hi, old[i].id, old[i].index);
+		}
+	}
+	skynet_free(old);
+	assert(hi->free_n == 0);
+	skynet_free(hi->free);
+	hi->free = skynet_malloc(hi->cap * sizeof(int));
+	hashid_free_range(hi, cap, hi->cap);
 }
 
 static int
 hashid_lookup(struct hashid *hi, int id) {
-	int h = id & hi->hashmod;
-	struct hashid_node * c = hi->hash[h];
-	while(c) {
+	int mask = (1 << hi->bits) - 1;
+	int h = hashid_slot(hi, id);
+	for (;;) {
+		struct hashid_node *c = &hi->hash[h];
 		if (c->id == id)
-			return c - hi->id;
-		c = c->next;
+			return c->index;
+		if (c->id < 0)
+			return -1;
+		h = (h + 1) & mask;
 	}
-	return -1;
 }
 
 static int
 hashid_remove(struct hashid *hi, int id) {
-	int h = id & hi->hashmod;
-	struct hashid_node * c = hi->hash[h];
-	if (c == NULL)
-		return -1;
-	if (c->id == id) {
-		hi->hash[h] = c->next;
-		goto _clear;
+	int mask = (1 << hi->bits) - 1;
+	int i = hashid_slot(hi, id);
+	while (hi->hash[i].id != id) {
+		if (hi->hash[i].id < 0)
+			return -1;
+		i = (i + 1) & mask;
 	}
-	while(c->next) {
-		if (c->next->id == id) {
-			struct hashid_node * temp = c->next;
-			c->next = temp->next;
-			c = temp;
-			goto _clear;
-		}
-		c = c->next;
+	int index = hi->hash[i].index;
+	// 后移删除，探测链上后面的节点补到空位上，不需要墓碑
+	int j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		struct hashid_node *c = &hi->hash[j];
+		if (c->id < 0)
+			break;
+		int k = hashid_slot(hi, c->id);
+		// k 在循环区间 (i, j] 中时，节点 j 不能移动到 i
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		hi->hash[i] = *c;
+		i = j;
 	}
-	return -1;
-_clear:
-	c->id = -1;
-	c->next = NULL;
+	hi->hash[i].id = -1;
+	hi->hash[i].index = -1;
 	--hi->count;
-	return c - hi->id;
+	hi->free[hi->free_n++] = index;
+	return index;
 }
 
+// id 不能已经存在，返回分配的下标
 static int
 hashid_insert(struct hashid * hi, int id) {
-	struct hashid_node *c = NULL;
-	int i;
-	for (i=0;i<hi->cap;i++) {
-		int index = (i+id) % hi->cap;
-		if (hi->id[index].id == -1) {
-			c = &hi->id[index];
-			break;
-		}
+	if (hi->count == hi->cap) {
+		hashid_grow(hi);
 	}
-	assert(c);
+	int index = hi->free[--hi->free_n];
+	hashid_put(hi, id, index);
 	++hi->count;
-	c->id = id;
-	assert(c->next == NULL);
-	int h = id & hi->hashmod;
-	if (hi->hash[h]) {
-		c->next = hi->hash[h];
-	}
-	hi->hash[h] = c;
-	
-	return c - hi->id;
-}
-
-static inline int
-hashid_full(struct hashid *hi) {
-	return hi->count == hi->cap;
+	return index;
 }
 
 #endif
@@ -10,7 +10,10 @@
 #include <stdio.h>
 #include <stdarg.h>
 
-#define BACKLOG 32
+#define BACKLOG 32	// 默认监听队列长度，可以由启动参数指定
+#define INIT_CONNECTION 64	// 连接表的初始容量，随连接数增长
+#define WHEEL_SIZE 256	// 空闲超时的时间轮格数，必须是2的幂
+#define WHEEL_TICK 100	// 时间轮每格 1 秒 (100 个 1/100 秒)
 
 struct connection {
 	int id;	// skynet_socket id
@@ -18,6 +21,16 @@ struct connection {
 	uint32_t client;
 	char remote_name[32];
 	struct databuffer buffer;
+	int drop;		// 已经因为空闲或者超过限速被关闭，之后收到的数据直接丢弃
+	// 空闲超时
+	uint64_t active;	// 最后一次收到数据的时间，skynet_now()
+	int wheel_slot;		// 所在的时间轮格子，-1 表示不在时间轮中
+	int wheel_prev;		// 时间轮链表，conn 的下标，-1 表示没有
+	int wheel_next;
+	// 令牌桶，单位为 1/100 个包(字节)，最多积累 1 秒的量
+	int64_t packet_token;
+	int64_t byte_token;
+	uint64_t token_time;
 };
 
 struct gate {
@@ -27,8 +40,17 @@ struct gate {
 	uint32_t broker;
 	int client_tag;
 	int header_size;
-	int max_connection;
+	int max_connection;	// 连接数上限，连接表按需增长，不预先分配
+	int backlog;
+	int coalesce;
+	int frame;
+	int timeout;		// 空闲超时，秒，0 表示不超时
+	int packet_rate;	// 每个连接每秒最多收到的包数，0 表示不限制
+	int byte_rate;		// 每个连接每秒最多收到的字节数，0 表示不限制
+	uint64_t wheel_time;	// 时间轮已经转到的时间，秒
+	int wheel[WHEEL_SIZE];	// 每格的链表头，conn 的下标，-1 表示空
 	struct hashid hash;
+	int conn_cap;	// conn 数组的长度，和 hash.cap 同步
 	struct connection *conn;
 	// todo: save message pool ptr for release
 	struct messagepool mp;
@@ -46,7 +68,7 @@ void
 gate_release(struct gate *g) {
 	int i;
 	struct skynet_context *ctx = g->ctx;
-	for (i=0;i<g->max_connection;i++) {
+	for (i=0;i<g->conn_cap;i++) {
 		struct connection *c = &g->conn[i];
 		if (c->id >=0) {
 			skynet_socket_close(ctx, c->id);
@@ -61,6 +83,129 @@ gate_release(struct gate *g) {
 	skynet_free(g);
 }
 
+// 连接表增长后，conn 数组扩大到同样的长度
+static void
+expand_connection(struct gate *g) {
+	int cap = g->hash.cap;
+	if (cap <= g->conn_cap)
+		return;
+	g->conn = skynet_realloc(g->conn, cap * sizeof(struct connection));
+	memset(g->conn + g->conn_cap, 0, (cap - g->conn_cap) * sizeof(struct connection));
+	int i;
+	for (i=g->conn_cap;i<cap;i++) {
+		g->conn[i].id = -1;
+		g->conn[i].wheel_slot = -1;
+	}
+	g->conn_cap = cap;
+}
+
+// 把连接放入到期时间所在的格子
+static void
+wheel_link(struct gate *g, int index, uint64_t expire) {
+	struct connection *c = &g->conn[index];
+	int slot = (int)(expire & (WHEEL_SIZE-1));
+	c->wheel_slot = slot;
+	c->wheel_prev = -1;
+	c->wheel_next = g->wheel[slot];
+	if (c->wheel_next >= 0) {
+		g->conn[c->wheel_next].wheel_prev = index;
+	}
+	g->wheel[slot] = index;
+}
+
+static void
+wheel_unlink(struct gate *g, int index) {
+	struct connection *c = &g->conn[index];
+	if (c->wheel_slot < 0)
+		return;
+	if (c->wheel_prev >= 0) {
+		g->conn[c->wheel_prev].wheel_next = c->wheel_next;
+	} else {
+		g->wheel[c->wheel_slot] = c->wheel_next;
+	}
+	if (c->wheel_next >= 0) {
+		g->conn[c->wheel_next].wheel_prev = c->wheel_prev;
+	}
+	c->wheel_slot = -1;
+}
+
+// 关闭连接，之后收到的数据都丢弃，连接在收到 close 消息时回收
+static void
+_drop(struct gate *g, struct connection *c, const char * reason) {
+	skynet_error(g->ctx, "gate: drop connection %d (%s)", c->id, reason);
+	c->drop = 1;
+	databuffer_clear(&c->buffer, &g->mp);
+	skynet_socket_close(g->ctx, c->id);
+}
+
+// 时间轮转到当前时间，检查到期格子中的连接
+// 收到数据时只更新 active，不移动连接；格子到期时没有超时的连接按新的到期时间重新放入
+static void
+gate_tick(struct gate *g) {
+	uint64_t now = skynet_now() / WHEEL_TICK;
+	if (now - g->wheel_time > WHEEL_SIZE) {
+		// 落后超过一圈，只需要检查每个格子一次
+		g->wheel_time = now - WHEEL_SIZE;
+	}
+	while (g->wheel_time < now) {
+		++g->wheel_time;
+		int slot = (int)(g->wheel_time & (WHEEL_SIZE-1));
+		int index = g->wheel[slot];
+		g->wheel[slot] = -1;
+		while (index >= 0) {
+			struct connection *c = &g->conn[index];
+			int next = c->wheel_next;
+			c->wheel_slot = -1;
+			uint64_t expire = c->active / WHEEL_TICK + g->timeout;
+			if (expire <= g->wheel_time) {
+				_drop(g, c, "idle timeout");
+			} else {
+				wheel_link(g, index, expire);
+			}
+			index = next;
+		}
+	}
+}
+
+// 令牌桶按经过的时间补充令牌，最多积累 1 秒的量
+static void
+token_refill(struct gate *g, struct connection *c, uint64_t now) {
+	int64_t elapsed = (int64_t)(now - c->token_time);
+	if (elapsed <= 0)
+		return;
+	c->token_time = now;
+	c->packet_token += elapsed * g->packet_rate;
+	if (c->packet_token > (int64_t)g->packet_rate * 100) {
+		c->packet_token = (int64_t)g->packet_rate * 100;
+	}
+	c->byte_token += elapsed * g->byte_rate;
+	if (c->byte_token > (int64_t)g->byte_rate * 100) {
+		c->byte_token = (int64_t)g->byte_rate * 100;
+	}
+}
+
+// 收到 sz 字节的数据，超过字节限速时返回 0
+static int
+limit_bytes(struct gate *g, struct connection *c, int sz) {
+	uint64_t now = skynet_now();
+	c->active = now;
+	if (g->byte_rate == 0)
+		return 1;
+	token_refill(g, c, now);
+	c->byte_token -= (int64_t)sz * 100;
+	return c->byte_token >= 0;
+}
+
+// 收到一个完整的包，超过包数限速时返回 0
+static int
+limit_packet(struct gate *g, struct connection *c) {
+	if (g->packet_rate == 0)
+		return 1;
+	token_refill(g, c, skynet_now());
+	c->packet_token -= 100;
+	return c->packet_token >= 0;
+}
+
 static void
 _parm(char *msg, int sz, int command_sz) {
 	while (command_sz < sz) {
@@ -165,18 +310,28 @@ _report(struct gate * g, const char * data, ...) {
 	skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT,  0, tmp, n);
 }
 
+// 取出一个完整的包
+// 包在 socket 线程的一块数据的末尾时(一次读到一个包的常见情况)直接转交这块内存，否则复制
+static void *
+_read_packet(struct gate *g, struct connection * c, int size) {
+	void * temp = databuffer_take(&c->buffer, &g->mp, size);
+	if (temp == NULL) {
+		temp = skynet_malloc(size);
+		databuffer_read(&c->buffer,&g->mp,temp, size);
+	}
+	return temp;
+}
+
 static void
 _forward(struct gate *g, struct connection * c, int size) {
 	struct skynet_context * ctx = g->ctx;
 	if (g->broker) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,temp, size);
+		void * temp = _read_packet(g, c, size);
 		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, 1, temp, size);
 		return;
 	}
 	if (c->agent) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,temp, size);
+		void * temp = _read_packet(g, c, size);
 		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, 1 , temp, size);
 	} else if (g->watchdog) {
 		char * tmp = skynet_malloc(size + 32);
@@ -200,6 +355,10 @@ dispatch_message(struct gate *g, struct connection *c, int id, void * data, int
 				skynet_socket_close(ctx, id);
 				skynet_error(ctx, "Recv socket message > 16M");
 				return;
+			} else if (!limit_packet(g, c)) {
+				// 在 _forward 分配内存之前丢弃
+				_drop(g, c, "too many packets");
+				return;
 			} else {
 				_forward(g, c, size);
 				databuffer_reset(&c->buffer);
@@ -208,20 +367,89 @@ dispatch_message(struct gate *g, struct connection *c, int id, void * data, int
 	}
 }
 
+// 分帧模式下socket线程切好的完整的包，直接转发，不经过 databuffer
+static void
+_forward_frame(struct gate *g, struct connection * c, void * data, int size) {
+	struct skynet_context * ctx = g->ctx;
+	if (g->broker) {
+		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, 1, data, size);
+		return;
+	}
+	if (c->agent) {
+		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, 1 , data, size);
+	} else if (g->watchdog) {
+		char * tmp = skynet_malloc(size + 32);
+		int n = snprintf(tmp,32,"%d data ",c->id);
+		memcpy(tmp+n, data, size);
+		skynet_free(data);
+		skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT | PTYPE_TAG_DONTCOPY, 1, tmp, size + n);
+	} else {
+		skynet_free(data);
+	}
+}
+
+static void
+dispatch_data(struct gate *g, int uid, void * data, int sz) {
+	int id = hashid_lookup(&g->hash, uid);
+	if (id>=0) {
+		struct connection *c = &g->conn[id];
+		if (c->drop) {
+			skynet_free(data);
+			return;
+		}
+		if (!limit_bytes(g, c, sz)) {
+			skynet_free(data);
+			_drop(g, c, "too many bytes");
+			return;
+		}
+		dispatch_message(g, c, uid, data, sz);
+	} else {
+		skynet_error(g->ctx, "Drop unknown connection %d message", uid);
+		skynet_socket_close(g->ctx, uid);
+		skynet_free(data);
+	}
+}
+
 static void
 dispatch_socket_message(struct gate *g, const struct skynet_socket_message * message, int sz) {
 	struct skynet_context * ctx = g->ctx;
 	switch(message->type) {
-	case SKYNET_SOCKET_TYPE_DATA: {
-		int id = hashid_lookup(&g->hash, message->id);
-		if (id>=0) {
-			struct connection *c = &g->conn[id];
-			dispatch_message(g, c, message->id, message->buffer, message->ud);
-		} else {
-			skynet_error(ctx, "Drop unknown connection %d message", message->id);
-			skynet_socket_close(ctx, message->id);
-			skynet_free(message->buffer);
+	case SKYNET_SOCKET_TYPE_DATA:
+		dispatch_data(g, message->id, message->buffer, message->ud);
+		break;
+	case SKYNET_SOCKET_TYPE_BATCH: {
+		// 一批事件中多个连接的数据
+		struct skynet_socket_event *ev = (struct skynet_socket_event *)message->buffer;
+		int i;
+		for (i=0;i<message->ud;i++) {
+			dispatch_data(g, ev[i].id, ev[i].buffer, ev[i].size);
+		}
+		skynet_free(ev);
+		break;
+	}
+	case SKYNET_SOCKET_TYPE_FRAME: {
+		// socket线程切好的完整的包
+		struct skynet_socket_event *ev = (struct skynet_socket_event *)message->buffer;
+		int i;
+		for (i=0;i<message->ud;i++) {
+			int id = hashid_lookup(&g->hash, ev[i].id);
+			if (id>=0) {
+				struct connection *c = &g->conn[id];
+				if (c->drop) {
+					skynet_free(ev[i].buffer);
+				} else if (!limit_bytes(g, c, ev[i].size + g->header_size) || !limit_packet(g, c)) {
+					skynet_free(ev[i].buffer);
+					_drop(g, c, "rate limit");
+				} else {
+					_forward_frame(g, c, ev[i].buffer, ev[i].size);
+				}
+			} else {
+				skynet_error(ctx, "Drop unknown connection %d message", ev[i].id);
+				skynet_socket_close(ctx, ev[i].id);
+				skynet_free(ev[i].buffer);
+			}
 		}
+		skynet_free(ev);
 		break;
 	}
 	case SKYNET_SOCKET_TYPE_CONNECT: {
@@ -241,9 +469,11 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		int id = hashid_remove(&g->hash, message->id);
 		if (id>=0) {
 			struct connection *c = &g->conn[id];
+			wheel_unlink(g, id);
 			databuffer_clear(&c->buffer,&g->mp);
 			memset(c, 0, sizeof(*c));
 			c->id = -1;
+			c->wheel_slot = -1;
 			_report(g, "%d close", message->id);
 		}
 		break;
@@ -251,14 +481,23 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 	case SKYNET_SOCKET_TYPE_ACCEPT:
 		// report accept, then it will be get a SKYNET_SOCKET_TYPE_CONNECT message
 		assert(g->listen_id == message->id);
-		if (hashid_full(&g->hash)) {
+		if (g->hash.count >= g->max_connection) {
 			skynet_socket_close(ctx, message->ud);
 		} else {
-			struct connection *c = &g->conn[hashid_insert(&g->hash, message->ud)];
+			int id = hashid_insert(&g->hash, message->ud);
+			expand_connection(g);
+			struct connection *c = &g->conn[id];
 			if (sz >= sizeof(c->remote_name)) {
 				sz = sizeof(c->remote_name) - 1;
 			}
 			c->id = message->ud;
+			c->drop = 0;
+			c->active = c->token_time = skynet_now();
+			c->packet_token = (int64_t)g->packet_rate * 100;
+			c->byte_token = (int64_t)g->byte_rate * 100;
+			if (g->timeout > 0) {
+				wheel_link(g, id, c->active / WHEEL_TICK + g->timeout);
+			}
 			memcpy(c->remote_name, message+1, sz);
 			c->remote_name[sz] = '\0';
 			_report(g, "%d open %d %s:0",c->id, c->id, c->remote_name);
@@ -301,6 +540,11 @@ _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t sour
 		// recv socket message from skynet_socket
 		dispatch_socket_message(g, msg, (int)(sz-sizeof(struct skynet_socket_message)));
 		break;
+	case PTYPE_RESPONSE:
+		// 时间轮定时器，整个 gate 只有这一个
+		gate_tick(g);
+		skynet_command(ctx, "TIMEOUT", "100");
+		break;
 	}
 	return 0;
 }
@@ -326,10 +570,18 @@ start_listen(struct gate *g, char * listen_addr) {
 		portstr[0] = '\0';
 		host = listen_addr;
 	}
-	g->listen_id = skynet_socket_listen(ctx, host, port, BACKLOG);
+	g->listen_id = skynet_socket_listen(ctx, host, port, g->backlog);
 	if (g->listen_id < 0) {
 		return 1;
 	}
+	if (g->coalesce) {
+		skynet_socket_coalesce(ctx, g->listen_id, 1);
+	}
+	if (g->frame) {
+		// socket线程按包头分包
+		// 和不分帧时的限制一致，见 dispatch_message
+		skynet_socket_frame(ctx, g->listen_id, g->header_size, 0xffffff);
+	}
 	skynet_socket_start(ctx, g->listen_id);
 	return 0;
 }
@@ -344,7 +596,15 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 	char binding[sz];
 	int client_tag = 0;
 	char header;
-	int n = sscanf(parm, "%c %s %s %d %d", &header, watchdog, binding, &client_tag, &max);
+	int backlog = 0;
+	int coalesce = 0;
+	int frame = 0;
+	int timeout = 0;
+	int packet_rate = 0;
+	int byte_rate = 0;
+	// header watchdog binding client_tag max [backlog] [coalesce] [frame] [timeout] [packet_rate] [byte_rate]
+	int n = sscanf(parm, "%c %s %s %d %d %d %d %d %d %d %d", &header, watchdog, binding, &client_tag, &max, &backlog, &coalesce, &frame,
+		&timeout, &packet_rate, &byte_rate);
 	if (n<4) {
 		skynet_error(ctx, "Invalid gate parm %s",parm);
 		return 1;
@@ -373,17 +633,26 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 
 	g->ctx = ctx;
 
-	hashid_init(&g->hash, max);
-	g->conn = skynet_malloc(max * sizeof(struct connection));
-	memset(g->conn, 0, max *sizeof(struct connection));
+	hashid_init(&g->hash, max < INIT_CONNECTION ? max : INIT_CONNECTION);
 	g->max_connection = max;
-	int i;
-	for (i=0;i<max;i++) {
-		g->conn[i].id = -1;
-	}
-	
+	expand_connection(g);
+
 	g->client_tag = client_tag;
 	g->header_size = header=='S' ? 2 : 4;
+	g->backlog = backlog > 0 ? backlog : BACKLOG;
+	g->coalesce = coalesce;
+	g->frame = frame;
+	g->timeout = timeout > 0 ? timeout : 0;
+	g->packet_rate = packet_rate > 0 ? packet_rate : 0;
+	g->byte_rate = byte_rate > 0 ? byte_rate : 0;
+	int i;
+	for (i=0;i<WHEEL_SIZE;i++) {
+		g->wheel[i] = -1;
+	}
+	g->wheel_time = skynet_now() / WHEEL_TICK;
+	if (g->timeout > 0) {
+		skynet_command(ctx, "TIMEOUT", "100");
+	}
 
 	skynet_callback(ctx,g,_cb);
 
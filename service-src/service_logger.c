@@ -4,42 +4,200 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+// 批量写模式下，单条日志行头部 "[:xxxxxxxx] " 加上换行的长度
+#define LINE_HEADER_SIZE 13
 
 struct logger {
 	FILE * handle;
 	char * filename;
 	int close;
+	// 批量写模式，buffer 为 NULL 时逐行写入
+	char * buffer;			// 日志缓冲区
+	size_t buffer_size;		// 缓冲区大小 (logbuffer)
+	size_t buffer_len;		// 缓冲区中待写入的长度
+	// 日志文件滚动，只在输出到文件时有效
+	uint64_t file_size;		// 当前文件大小
+	uint64_t rotate_size;		// 文件超过该大小时滚动 (logrotatesize)，0 不滚动
+	uint64_t rotate_time;		// 文件打开超过该时间时滚动 (logrotatetime 秒)，单位 1/100 秒，0 不滚动
+	uint64_t open_time;		// 文件打开的时间，skynet_now()
+	// 丢弃策略
+	int backlog;			// 消息队列积压超过该长度时丢弃日志 (logbacklog)，0 不丢弃
+	uint64_t dropped;		// 上一次输出之后丢弃的行数
+	uint64_t dropped_total;		// 丢弃的总行数
 };
 
 struct logger *
 logger_create(void) {
 	struct logger * inst = skynet_malloc(sizeof(*inst));
+	memset(inst, 0, sizeof(*inst));
 	inst->handle = NULL;
 	inst->close = 0;
 	inst->filename = NULL;
+	inst->buffer = NULL;
 
 	return inst;
 }
 
+// 把缓冲区一次性写入文件
+static void
+logger_write(struct logger * inst) {
+	const char * ptr = inst->buffer;
+	size_t sz = inst->buffer_len;
+	int fd = fileno(inst->handle);
+	while (sz > 0) {
+		ssize_t n = write(fd, ptr, sz);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "logger write error : %s\n", strerror(errno));
+			break;
+		}
+		ptr += n;
+		sz -= n;
+	}
+	inst->file_size += inst->buffer_len;
+	inst->buffer_len = 0;
+}
+
+// 重新打开日志文件，打开失败时继续使用原来的 handle
+// 成功时从新文件的长度重新计算滚动的大小和时间
+static int
+logger_reopen(struct logger * inst) {
+	FILE * f = fopen(inst->filename, "a");
+	if (f == NULL) {
+		fprintf(stderr, "logger reopen %s error : %s\n", inst->filename, strerror(errno));
+		return 1;
+	}
+	if (inst->close) {
+		fclose(inst->handle);
+	}
+	inst->handle = f;
+	inst->close = 1;
+	long size = 0;
+	if (fseek(f, 0, SEEK_END) == 0) {
+		size = ftell(f);
+	}
+	inst->file_size = size > 0 ? (uint64_t)size : 0;
+	inst->open_time = skynet_now();
+	return 0;
+}
+
+// 滚动日志文件，当前文件重命名为 filename.YYYYmmdd-HHMMSS
+static void
+logger_rotate(struct skynet_context * ctx, struct logger * inst) {
+	uint64_t now = skynet_now();
+	time_t ti = (time_t)(strtoul(skynet_command(ctx, "STARTTIME", NULL), NULL, 10) + now / 100);
+	struct tm tm;
+	localtime_r(&ti, &tm);
+	size_t sz = strlen(inst->filename);
+	char newname[sz + 32];
+	int n = snprintf(newname, sizeof(newname), "%s.", inst->filename);
+	strftime(newname + n, sizeof(newname) - n, "%Y%m%d-%H%M%S", &tm);
+	int i;
+	size_t len = strlen(newname);
+	for (i=1; access(newname, F_OK) == 0 && i < 100; i++) {
+		snprintf(newname + len, sizeof(newname) - len, ".%d", i);
+	}
+	if (rename(inst->filename, newname) != 0) {
+		fprintf(stderr, "logger rotate %s error : %s\n", inst->filename, strerror(errno));
+	}
+	if (logger_reopen(inst)) {
+		// 继续写已经改名的文件，下一个滚动周期再试，不在每次写入时重试
+		inst->file_size = 0;
+		inst->open_time = now;
+	}
+}
+
+static void
+logger_flush(struct skynet_context * ctx, struct logger * inst) {
+	if (inst->buffer_len > 0) {
+		logger_write(inst);
+	}
+	if (inst->close && ((inst->rotate_size && inst->file_size >= inst->rotate_size)
+		|| (inst->rotate_time && skynet_now() - inst->open_time >= inst->rotate_time))) {
+		logger_rotate(ctx, inst);
+	}
+}
+
 void
 logger_release(struct logger * inst) {
+	if (inst->buffer && inst->buffer_len > 0) {
+		logger_write(inst);
+	}
 	if (inst->close) {
 		fclose(inst->handle);
 	}
+	skynet_free(inst->buffer);
 	skynet_free(inst->filename);
 	skynet_free(inst);
 }
 
+// 追加一行到缓冲区，缓冲区放不下时先写入文件
+static void
+logger_append(struct skynet_context * ctx, struct logger * inst, uint32_t source, const void * msg, size_t sz) {
+	if (inst->buffer_len + sz + LINE_HEADER_SIZE > inst->buffer_size) {
+		logger_flush(ctx, inst);
+		if (sz + LINE_HEADER_SIZE > inst->buffer_size) {
+			// too large, write directly
+			fprintf(inst->handle, "[:%08x] ",source);
+			fwrite(msg, sz , 1, inst->handle);
+			fprintf(inst->handle, "\n");
+			fflush(inst->handle);
+			inst->file_size += sz + LINE_HEADER_SIZE;
+			return;
+		}
+	}
+	char * ptr = inst->buffer + inst->buffer_len;
+	snprintf(ptr, LINE_HEADER_SIZE, "[:%08x] ", source);
+	memcpy(ptr + LINE_HEADER_SIZE - 1, msg, sz);
+	ptr[LINE_HEADER_SIZE - 1 + sz] = '\n';
+	inst->buffer_len += sz + LINE_HEADER_SIZE;
+}
+
+// 批量写模式
+// 日志先追加到缓冲区，消息队列为空(一批日志处理完毕)或者缓冲区满时，才调用一次 write
+static void
+logger_batch(struct skynet_context * context, struct logger * inst, uint32_t source, const void * msg, size_t sz) {
+	int mqlen = strtol(skynet_command(context, "STAT", "mqlen"), NULL, 10);
+	if (inst->backlog && mqlen > inst->backlog) {
+		++inst->dropped;
+		++inst->dropped_total;
+		return;
+	}
+	if (inst->dropped) {
+		char tmp[128];
+		int n = snprintf(tmp, sizeof(tmp), "logger backlog overflow, %llu lines dropped (total %llu)",
+			(unsigned long long)inst->dropped, (unsigned long long)inst->dropped_total);
+		inst->dropped = 0;
+		logger_append(context, inst, skynet_current_handle(), tmp, n);
+	}
+	logger_append(context, inst, source, msg, sz);
+	if (mqlen == 0) {
+		logger_flush(context, inst);
+	}
+}
+
 static int
 logger_cb(struct skynet_context * context, void *ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
 	struct logger * inst = ud;
 	switch (type) {
 	case PTYPE_SYSTEM:
 		if (inst->filename) {
-			inst->handle = freopen(inst->filename, "a", inst->handle);
+			if (inst->buffer) {
+				logger_flush(context, inst);
+			}
+			logger_reopen(inst);
 		}
 		break;
 	case PTYPE_TEXT:
+		if (inst->buffer) {
+			logger_batch(context, inst, source, msg, sz);
+			break;
+		}
 		fprintf(inst->handle, "[:%08x] ",source);
 		fwrite(msg, sz , 1, inst->handle);
 		fprintf(inst->handle, "\n");
@@ -50,6 +208,15 @@ logger_cb(struct skynet_context * context, void *ud, int type, int session, uint
 	return 0;
 }
 
+static uint64_t
+optint(struct skynet_context * ctx, const char * key) {
+	const char * str = skynet_command(ctx, "GETENV", key);
+	if (str == NULL) {
+		return 0;
+	}
+	return strtoull(str, NULL, 10);
+}
+
 int
 logger_init(struct logger * inst, struct skynet_context *ctx, const char * parm) {
 	if (parm) {
@@ -64,6 +231,18 @@ logger_init(struct logger * inst, struct skynet_context *ctx, const char * parm)
 		inst->handle = stdout;
 	}
 	if (inst->handle) {
+		size_t buffer_size = (size_t)optint(ctx, "logbuffer");
+		if (buffer_size > 0) {
+			if (buffer_size < 4096) {
+				buffer_size = 4096;
+			}
+			inst->buffer = skynet_malloc(buffer_size);
+			inst->buffer_size = buffer_size;
+			inst->rotate_size = optint(ctx, "logrotatesize");
+			inst->rotate_time = optint(ctx, "logrotatetime") * 100;
+			inst->backlog = (int)optint(ctx, "logbacklog");
+			inst->open_time = skynet_now();
+		}
 		skynet_callback(ctx, inst, logger_cb);
 		skynet_command(ctx, "REG", ".logger");
 		return 0;
@@ -5,6 +5,7 @@ local cluster = require "cluster.core"
 
 local config_name = skynet.getenv "cluster"
 local node_address = {}
+local node_trace = {}	-- node -> true, the node accepts the trace context, See examples/clustername.lua
 local node_session = {}
 local command = {}
 
@@ -14,11 +15,20 @@ local function read_response(sock)
 	return cluster.unpackresponse(msg)	-- session, ok, data, padding
 end
 
+-- "host:port" or "unix:/path/to/sock" (co-located nodes, port is 0)
+local function split_address(address)
+	if address:sub(1,5) == "unix:" then
+		return address, 0
+	end
+	local host, port = string.match(address, "([^:]+):(.*)$")
+	return host, tonumber(port)
+end
+
 local function open_channel(t, key)
-	local host, port = string.match(node_address[key], "([^:]+):(.*)$")
+	local host, port = split_address(node_address[key])
 	local c = sc.channel {
 		host = host,
-		port = tonumber(port),
+		port = port,
 		response = read_response,
 		nodelay = true,
 	}
@@ -36,7 +46,14 @@ local function loadconfig()
 	local tmp = {}
 	assert(load(source, "@"..config_name, "t", tmp))()
 	for name,address in pairs(tmp) do
+		local trace = false
+		if type(address) == "table" then
+			-- { address = "host:port", trace = true }
+			trace = address.trace == true
+			address = address.address
+		end
 		assert(type(address) == "string")
+		node_trace[name] = trace
 		if node_address[name] ~= address then
 			-- address changed
 			if rawget(node_channel, name) then
@@ -55,16 +72,21 @@ end
 function command.listen(source, addr, port)
 	local gate = skynet.newservice("gate")
 	if port == nil then
-		addr, port = string.match(node_address[addr], "([^:]+):(.*)$")
+		addr, port = split_address(node_address[addr])
 	end
 	skynet.call(gate, "lua", "open", { address = addr, port = port })
 	skynet.ret(skynet.pack(nil))
 end
 
-local function send_request(source, node, addr, msg, sz)
+local function send_request(trace, span, source, node, addr, msg, sz)
 	local session = node_session[node] or 1
 	-- msg is a local pointer, cluster.packrequest will free it
-	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz)
+	-- the trace context of the caller rides along the request, See skynet.trace()
+	-- only to the nodes opted in by trace = true, old nodes reject the traced request
+	if not node_trace[node] then
+		trace, span = 0, 0
+	end
+	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz, trace, span)
 	node_session[node] = new_session
 
 	-- node_channel[node] may yield or throw error
@@ -74,7 +96,13 @@ local function send_request(source, node, addr, msg, sz)
 end
 
 function command.req(...)
-	local ok, msg, sz = pcall(send_request, ...)
+	-- read trace context before yield
+	local trace, span = skynet.tracecontext()
+	local ok, msg, sz = pcall(send_request, trace, span, ...)
+	if trace ~= 0 then
+		-- the response comes from socket, resume the trace of the caller
+		skynet.settrace(trace, span)
+	end
 	if ok then
 		if type(msg) == "table" then
 			skynet.ret(cluster.concat(msg))
@@ -117,9 +145,9 @@ local large_request = {}
 function command.socket(source, subcmd, fd, msg)
 	if subcmd == "data" then
 		local sz
-		local addr, session, msg, padding = cluster.unpackrequest(msg)
+		local addr, session, msg, padding, trace, span = cluster.unpackrequest(msg)
 		if padding then
-			local req = large_request[session] or { addr = addr }
+			local req = large_request[session] or { addr = addr, trace = trace, span = span }
 			large_request[session] = req
 			table.insert(req, msg)
 			return
@@ -130,6 +158,8 @@ function command.socket(source, subcmd, fd, msg)
 				table.insert(req, msg)
 				msg,sz = cluster.concat(req)
 				addr = req.addr
+				trace = req.trace
+				span = req.span
 			end
 			if not msg then
 				local response = cluster.packresponse(session, false, "Invalid large req")
@@ -137,6 +167,10 @@ function command.socket(source, subcmd, fd, msg)
 				return
 			end
 		end
+		if trace then
+			-- join the trace from the remote node
+			skynet.settrace(trace, span)
+		end
 		local ok, response
 		if addr == 0 then
 			local name = skynet.unpack(msg, sz)
@@ -154,6 +154,7 @@ function COMMAND.help()
 		cmem = "Show C memory info",
 		shrtbl = "Show shared short string table info",
 		ping = "ping address",
+		netstat = "netstat [id] : show socket traffic and tcp info",
 		call = "call address ...",
 	}
 end
@@ -313,6 +314,22 @@ function COMMAND.shrtbl()
 	return { n = n, total = total, longest = longest, space = space }
 end
 
+function COMMAND.netstat(id)
+	if id then
+		local info = socket.info(assert(tonumber(id), "Invalid socket id"))
+		if info then
+			info.address = skynet.address(info.address)
+		end
+		return info
+	end
+	local tmp = {}
+	for _, info in ipairs(socket.info()) do
+		info.address = skynet.address(info.address)
+		tmp[info.id] = info
+	end
+	return tmp
+end
+
 function COMMAND.ping(address)
 	address = adjust_address(address)
 	local ti = skynet.now()
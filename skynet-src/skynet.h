@@ -27,6 +27,8 @@
 struct skynet_context;
 
 void skynet_error(struct skynet_context * context, const char *msg, ...);
+// same as skynet_error, but rate limited by site instead of the address of msg, read skynet-src/skynet_error.h
+void skynet_error_site(struct skynet_context * context, uintptr_t site, const char *msg, ...);
 const char * skynet_command(struct skynet_context * context, const char * cmd , const char * parm);
 uint32_t skynet_queryname(struct skynet_context * context, const char * name);
 int skynet_send(struct skynet_context * context, uint32_t source, uint32_t destination , int type, int session, void * msg, size_t sz);
@@ -41,4 +43,8 @@ uint32_t skynet_current_handle(void);
 uint64_t skynet_now(void);
 void skynet_debug_memory(const char *info);	// for debug use, output current service memory to stderr
 
+// cross-service call tracing, read skynet-src/skynet_trace.h
+uint32_t skynet_trace_begin(struct skynet_context * context, uint32_t trace, uint32_t parent);
+uint32_t skynet_trace_current(struct skynet_context * context, uint32_t *span);
+
 #endif
@@ -2,56 +2,119 @@
 #include "skynet_env.h"
 #include "spinlock.h"
 
-#include <lua.h>
-#include <lauxlib.h>
-
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+// 环境变量，创建之后不再修改也不释放，skynet_getenv 返回的字符串一直有效
+struct env_entry {
+	uint32_t hash;
+	const char * key;
+	const char * value;
+};
+
+// 环境变量表的不可变快照，开放寻址哈希表
+// skynet_getenv 无锁读取当前快照，skynet_setenv 复制一份加入新变量后原子替换
+struct env_snapshot {
+	int size;			// 槽位数，2的幂
+	int count;			// 变量个数
+	struct env_snapshot *prev;	// 被替换掉的旧快照
+	struct env_entry *slot[1];
+};
+
 struct skynet_env {
-	struct spinlock lock;	// 回旋锁
-	lua_State *L;		// lua状态机
+	struct spinlock lock;		// 回旋锁，串行化 skynet_setenv
+	struct env_snapshot *current;	// 当前快照
 };
 
 static struct skynet_env *E = NULL;	//skynet环境实例
 
-// 从lua状态机获取环境变量
-const char * 
-skynet_getenv(const char *key) {
-	// 加锁
-	SPIN_LOCK(E)
+static uint32_t
+env_hash(const char *key) {
+	uint32_t h = 2166136261u;
+	const unsigned char *p = (const unsigned char *)key;
+	while (*p) {
+		h = (h ^ *p++) * 16777619u;
+	}
+	return h;
+}
 
-	lua_State *L = E->L;
-	
-	// 把key对应的全局变量压栈
-	lua_getglobal(L, key);
-	// 获取栈顶lua变量，转化为c字符串
-	const char * result = lua_tostring(L, -1);
-	// 使用完出栈
-	lua_pop(L, 1);
+static struct env_snapshot *
+snapshot_new(int size) {
+	struct env_snapshot *s = skynet_malloc(sizeof(*s) + (size - 1) * sizeof(struct env_entry *));
+	s->size = size;
+	s->count = 0;
+	s->prev = NULL;
+	memset(s->slot, 0, size * sizeof(struct env_entry *));
+	return s;
+}
 
-	// 解锁
-	SPIN_UNLOCK(E)
+static struct env_entry *
+snapshot_find(struct env_snapshot *s, const char *key, uint32_t hash) {
+	int mask = s->size - 1;
+	int i = hash & mask;
+	struct env_entry *e;
+	while ((e = s->slot[i]) != NULL) {
+		if (e->hash == hash && strcmp(e->key, key) == 0) {
+			return e;
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+static void
+snapshot_insert(struct env_snapshot *s, struct env_entry *e) {
+	int mask = s->size - 1;
+	int i = e->hash & mask;
+	while (s->slot[i]) {
+		i = (i + 1) & mask;
+	}
+	s->slot[i] = e;
+	++s->count;
+}
 
-	return result;
+// 获取环境变量，不加锁，可以在任意线程调用
+const char * 
+skynet_getenv(const char *key) {
+	struct env_snapshot *s = E->current;
+	__sync_synchronize();
+	struct env_entry *e = snapshot_find(s, key, env_hash(key));
+	return e ? e->value : NULL;
 }
 
-// 设置环境变量
+// 设置环境变量，同一个key只能设置一次
 void 
 skynet_setenv(const char *key, const char *value) {
+	uint32_t hash = env_hash(key);
+	struct env_entry *e = skynet_malloc(sizeof(*e));
+	e->hash = hash;
+	e->key = skynet_strdup(key);
+	e->value = skynet_strdup(value);
+
 	// 加锁
 	SPIN_LOCK(E)
-	
-	lua_State *L = E->L;
-	
-	// 先判断key对应的全局变量是否为空
-	lua_getglobal(L, key);
-	assert(lua_isnil(L, -1));
-	lua_pop(L,1);
-	// 如果为空，把value值压栈
-	lua_pushstring(L,value);
-	// 弹出栈顶元素，并设置为key对应的全局变量值
-	lua_setglobal(L,key);
+
+	struct env_snapshot *old = E->current;
+	assert(snapshot_find(old, key, hash) == NULL);
+	// 负载因子保持在 1/2 以下
+	int size = old->size;
+	if ((old->count + 1) * 2 > size) {
+		size *= 2;
+	}
+	struct env_snapshot *s = snapshot_new(size);
+	int i;
+	for (i=0;i<old->size;i++) {
+		if (old->slot[i]) {
+			snapshot_insert(s, old->slot[i]);
+		}
+	}
+	snapshot_insert(s, e);
+	// 读者可能还在使用旧快照，没有办法知道何时可以释放，只挂在新快照上。
+	// skynet_setenv 基本只在启动时读取配置时调用，累积的内存很少
+	s->prev = old;
+	__sync_synchronize();
+	E->current = s;
 
 	// 解锁
 	SPIN_UNLOCK(E)
@@ -64,6 +127,6 @@ skynet_env_init() {
 	E = skynet_malloc(sizeof(*E));
 	// 初始化回旋锁
 	SPIN_INIT(E)
-	// 创建新的lua状态机
-	E->L = luaL_newstate();
+	// 创建空的快照
+	E->current = snapshot_new(64);
 }
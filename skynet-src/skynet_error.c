@@ -2,64 +2,206 @@
 #include "skynet_handle.h"
 #include "skynet_mq.h"
 #include "skynet_server.h"
+#include "skynet_error.h"
+#include "spinlock.h"
 
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define LOG_MESSAGE_SIZE 256
+// 限流表的大小，必须是2的幂，哈希冲突的调用点会互相挤占槽位
+#define ERROR_SITE_SIZE 1024
 
-void 
-skynet_error(struct skynet_context * context, const char *msg, ...) {
-	static uint32_t logger = 0;
+// 一个调用点在当前时间窗口(1秒)内的输出统计
+struct error_site {
+	struct spinlock lock;
+	uintptr_t key;			// 调用点，0 表示空槽位
+	const char * fmt;		// C 调用点的格式串，用于输出抑制摘要，可能为 NULL
+	uint32_t source;		// 最后一次被抑制的日志的来源服务
+	uint32_t window;		// 时间窗口，秒
+	uint32_t count;			// 窗口内已经输出的条数
+	uint32_t suppressed;		// 窗口内被抑制的条数
+};
+
+struct error_limit {
+	int limit;
+	struct error_site site[ERROR_SITE_SIZE];
+};
+
+static uint32_t LOGGER = 0;
+static struct error_limit *E = NULL;
+
+void
+skynet_error_init(int limit) {
+	if (limit <= 0) {
+		return;
+	}
+	struct error_limit *e = skynet_malloc(sizeof(*e));
+	memset(e, 0, sizeof(*e));
+	e->limit = limit;
+	int i;
+	for (i=0;i<ERROR_SITE_SIZE;i++) {
+		SPIN_INIT(&e->site[i]);
+	}
+	E = e;
+}
+
+static uint32_t
+logger_handle(void) {
+	// logger 服务在所有服务之前启动，并且不会退出，查找一次之后缓存下来
+	uint32_t logger = LOGGER;
 	if (logger == 0) {
 		logger = skynet_handle_findname("logger");
+		LOGGER = logger;
+	}
+	return logger;
+}
+
+static void
+push_log(uint32_t logger, uint32_t source, char * data, int len) {
+	struct skynet_message smsg;
+	smsg.source = source;
+	smsg.session = 0;
+	smsg.data = data;
+	smsg.sz = len | ((size_t)PTYPE_TEXT << MESSAGE_TYPE_SHIFT);
+	smsg.trace = 0;
+	smsg.span = 0;
+	skynet_context_push(logger, &smsg);
+}
+
+static void
+report_suppressed(uint32_t logger, uint32_t source, uint32_t n, const char * fmt) {
+	char tmp[LOG_MESSAGE_SIZE];
+	int len;
+	if (fmt) {
+		len = snprintf(tmp, sizeof(tmp), "%u similar messages suppressed : %s", n, fmt);
+	} else {
+		len = snprintf(tmp, sizeof(tmp), "%u similar messages suppressed", n);
+	}
+	if (len >= LOG_MESSAGE_SIZE) {
+		len = LOG_MESSAGE_SIZE - 1;
+	}
+	char * data = skynet_malloc(len + 1);
+	memcpy(data, tmp, len + 1);
+	push_log(logger, source, data, len);
+}
+
+// 返回 0 表示这条日志需要被抑制
+static int
+check_limit(uint32_t logger, uint32_t source, uintptr_t key, const char * fmt) {
+	struct error_site *s = &E->site[(key ^ (key >> 12)) & (ERROR_SITE_SIZE-1)];
+	uint32_t window = (uint32_t)time(NULL);
+	uint32_t suppressed = 0;
+	uint32_t suppressed_source = 0;
+	const char * suppressed_fmt = NULL;
+	int pass;
+	SPIN_LOCK(s)
+	if (s->key != key || s->window != window) {
+		suppressed = s->suppressed;
+		suppressed_source = s->source;
+		suppressed_fmt = s->fmt;
+		s->key = key;
+		s->fmt = fmt;
+		s->window = window;
+		s->count = 0;
+		s->suppressed = 0;
+	}
+	if (s->count < (uint32_t)E->limit) {
+		++s->count;
+		pass = 1;
+	} else {
+		++s->suppressed;
+		s->source = source;
+		pass = 0;
+	}
+	SPIN_UNLOCK(s)
+	if (suppressed) {
+		report_suppressed(logger, suppressed_source, suppressed, suppressed_fmt);
 	}
+	return pass;
+}
+
+void
+skynet_error_flush(void) {
+	struct error_limit *e = E;
+	if (e == NULL) {
+		return;
+	}
+	uint32_t logger = logger_handle();
 	if (logger == 0) {
 		return;
 	}
+	uint32_t window = (uint32_t)time(NULL);
+	int i;
+	for (i=0;i<ERROR_SITE_SIZE;i++) {
+		struct error_site *s = &e->site[i];
+		if (s->suppressed == 0 || s->window == window) {
+			continue;
+		}
+		SPIN_LOCK(s)
+		uint32_t suppressed = 0;
+		uint32_t source = s->source;
+		const char * fmt = s->fmt;
+		if (s->window != window) {
+			suppressed = s->suppressed;
+			s->suppressed = 0;
+		}
+		SPIN_UNLOCK(s)
+		if (suppressed) {
+			report_suppressed(logger, source, suppressed, fmt);
+		}
+	}
+}
 
+static void
+verror(struct skynet_context * context, uintptr_t site, const char *fmt, const char *msg, va_list ap) {
+	uint32_t logger = logger_handle();
+	if (logger == 0) {
+		return;
+	}
+	uint32_t source = context ? skynet_context_handle(context) : 0;
+	if (E && !check_limit(logger, source, site, fmt)) {
+		return;
+	}
+
+	// 先格式化到栈上的缓冲区(每个线程独有)，放不下时按 vsnprintf 返回的长度分配一次再格式化
 	char tmp[LOG_MESSAGE_SIZE];
 	char *data = NULL;
-
-	va_list ap;
-
-	va_start(ap,msg);
+	va_list ap2;
+	va_copy(ap2, ap);
 	int len = vsnprintf(tmp, LOG_MESSAGE_SIZE, msg, ap);
-	va_end(ap);
-	if (len >=0 && len < LOG_MESSAGE_SIZE) {
-		data = skynet_strdup(tmp);
-	} else {
-		int max_size = LOG_MESSAGE_SIZE;
-		for (;;) {
-			max_size *= 2;
-			data = skynet_malloc(max_size);
-			va_start(ap,msg);
-			len = vsnprintf(data, max_size, msg, ap);
-			va_end(ap);
-			if (len < max_size) {
-				break;
-			}
-			skynet_free(data);
-		}
-	}
 	if (len < 0) {
-		skynet_free(data);
+		va_end(ap2);
 		perror("vsnprintf error :");
 		return;
 	}
-
-
-	struct skynet_message smsg;
-	if (context == NULL) {
-		smsg.source = 0;
+	data = skynet_malloc(len + 1);
+	if (len < LOG_MESSAGE_SIZE) {
+		memcpy(data, tmp, len + 1);
 	} else {
-		smsg.source = skynet_context_handle(context);
+		vsnprintf(data, len + 1, msg, ap2);
 	}
-	smsg.session = 0;
-	smsg.data = data;
-	smsg.sz = len | ((size_t)PTYPE_TEXT << MESSAGE_TYPE_SHIFT);
-	skynet_context_push(logger, &smsg);
+	va_end(ap2);
+
+	push_log(logger, source, data, len);
 }
 
+void 
+skynet_error(struct skynet_context * context, const char *msg, ...) {
+	va_list ap;
+	va_start(ap,msg);
+	// 格式串通常是字面量，它的地址可以作为调用点
+	verror(context, (uintptr_t)msg, msg, msg, ap);
+	va_end(ap);
+}
+
+void
+skynet_error_site(struct skynet_context * context, uintptr_t site, const char *msg, ...) {
+	va_list ap;
+	va_start(ap,msg);
+	verror(context, site, NULL, msg, ap);
+	va_end(ap);
+}
@@ -0,0 +1,9 @@
+#ifndef SKYNET_ERROR_H
+#define SKYNET_ERROR_H
+
+// 每个调用点每秒最多输出 limit 条日志，超出的日志被抑制，0 为不限制
+void skynet_error_init(int limit);
+// 输出已经结束的时间窗口中被抑制的日志条数，由监视器线程每秒调用一次
+void skynet_error_flush(void);
+
+#endif
@@ -10,6 +10,16 @@ struct skynet_config {
 	const char * bootstrap;		// 启动服务配置，如 snlua bootstrap
 	const char * logger;		// 日志服务配置
 	const char * logservice;	// 日志服务地址
+	const char * trace;			// 调用链追踪导出文件，为空则不开启追踪
+	int errorlimit;				// 每个调用点每秒最多输出的日志条数，0 为不限制
+	int socket_thread;			// socket线程数
+	int reuseport;				// 监听套接字是否设置 SO_REUSEPORT
+	int max_socket;				// socket 仓库容量
+	int socket_event;			// 事件循环一次最多取出的事件数
+	int socket_direct;			// 工作线程是否直接写入套接字
+	int socket_readall;			// 读满缓冲区后是否继续读，直到 EAGAIN
+	int udp_batch;				// udp 一次收发的最大数据报个数
+	int socket_uring;			// 事件循环使用 io_uring
 };
 
 #define THREAD_WORKER 0			// 工作线程
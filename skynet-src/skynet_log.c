@@ -2,8 +2,26 @@
 #include "skynet_timer.h"
 #include "skynet.h"
 #include "skynet_socket.h"
+#include "spinlock.h"
 #include <string.h>
-#include <time.h>
+
+// 每个日志文件的写缓冲区大小，写满后才写入文件
+#define LOG_BUFFER_SIZE (64 * 1024)
+
+// 已打开的日志文件
+struct log_file {
+	FILE * f;
+	char * buffer;		// setvbuf 缓冲区
+	struct log_file * next;
+};
+
+// 日志文件列表，监视器线程定时刷新
+struct log_list {
+	struct spinlock lock;
+	struct log_file * head;
+};
+
+static struct log_list LOGS;
 
 FILE * 
 skynet_log_open(struct skynet_context * ctx, uint32_t handle) {
@@ -15,12 +33,29 @@ skynet_log_open(struct skynet_context * ctx, uint32_t handle) {
 	sprintf(tmp, "%s/%08x.log", logpath, handle);
 	FILE *f = fopen(tmp, "ab");
 	if (f) {
+		struct log_file * lf = skynet_malloc(sizeof(*lf));
+		lf->f = f;
+		lf->buffer = skynet_malloc(LOG_BUFFER_SIZE);
+		// 全缓冲，缓冲区写满或者定时刷新时才写入文件
+		setvbuf(f, lf->buffer, _IOFBF, LOG_BUFFER_SIZE);
+
 		uint32_t starttime = skynet_starttime();
 		uint64_t currenttime = skynet_now();
-		time_t ti = starttime + currenttime/100;
 		skynet_error(ctx, "Open log file %s", tmp);
-		fprintf(f, "open time: %u %s", (uint32_t)currenttime, ctime(&ti));
+		struct skynet_log_record r;
+		r.size = sizeof(starttime);
+		r.source = handle;
+		r.type = SKYNET_LOG_OPEN;
+		r.session = 0;
+		r.time = (uint32_t)currenttime;
+		fwrite(&r, sizeof(r), 1, f);
+		fwrite(&starttime, sizeof(starttime), 1, f);
 		fflush(f);
+
+		SPIN_LOCK(&LOGS)
+		lf->next = LOGS.head;
+		LOGS.head = lf;
+		SPIN_UNLOCK(&LOGS)
 	} else {
 		skynet_error(ctx, "Open log file %s fail", tmp);
 	}
@@ -30,23 +65,107 @@ skynet_log_open(struct skynet_context * ctx, uint32_t handle) {
 void
 skynet_log_close(struct skynet_context * ctx, FILE *f, uint32_t handle) {
 	skynet_error(ctx, "Close log file :%08x", handle);
-	fprintf(f, "close time: %u\n", (uint32_t)skynet_now());
+	struct log_file * lf = NULL;
+	SPIN_LOCK(&LOGS)
+	struct log_file ** prev = &LOGS.head;
+	while (*prev) {
+		if ((*prev)->f == f) {
+			lf = *prev;
+			*prev = lf->next;
+			break;
+		}
+		prev = &(*prev)->next;
+	}
+	SPIN_UNLOCK(&LOGS)
+
+	struct skynet_log_record r;
+	r.size = 0;
+	r.source = handle;
+	r.type = SKYNET_LOG_CLOSE;
+	r.session = 0;
+	r.time = (uint32_t)skynet_now();
+	fwrite(&r, sizeof(r), 1, f);
 	fclose(f);
+	if (lf) {
+		skynet_free(lf->buffer);
+		skynet_free(lf);
+	}
+}
+
+// 刷新所有日志文件的缓冲区
+void
+skynet_log_flush(void) {
+	SPIN_LOCK(&LOGS)
+	struct log_file * lf = LOGS.head;
+	while (lf) {
+		fflush(lf->f);
+		lf = lf->next;
+	}
+	SPIN_UNLOCK(&LOGS)
 }
 
+// 一条 socket 记录: type id ud + payload + extra
 static void
-log_blob(FILE *f, void * buffer, size_t sz) {
-	size_t i;
-	uint8_t * buf = buffer;
-	for (i=0;i!=sz;i++) {
-		fprintf(f, "%02x", buf[i]);
+log_socket_record(FILE * f, uint32_t source, int session, int type, int id, int ud, const void * payload, size_t sz, const void * extra, size_t extra_sz) {
+	int32_t head[3] = { type, id, ud };
+	struct skynet_log_record r;
+	r.size = sizeof(head) + sz + extra_sz;
+	r.source = source;
+	r.type = PTYPE_SOCKET;
+	r.session = session;
+	r.time = (uint32_t)skynet_now();
+	fwrite(&r, sizeof(r), 1, f);
+	fwrite(head, sizeof(head), 1, f);
+	fwrite(payload, 1, sz, f);
+	if (extra_sz) {
+		fwrite(extra, 1, extra_sz, f);
 	}
 }
 
+// udp 消息每个数据报一条记录，ud 为数据报长度，payload 之后是 udp address
+// recvmmsg 合并的消息 ud 为负的数据报个数，buffer 中依次为 uint32 size + data(size) + udp address
 static void
-log_socket(FILE * f, struct skynet_socket_message * message, size_t sz) {
-	fprintf(f, "[socket] %d %d %d ", message->type, message->id, message->ud);
+log_udp(FILE * f, uint32_t source, int session, struct skynet_socket_message * message) {
+	int n = message->ud < 0 ? -message->ud : 1;
+	char * ptr = message->buffer;
+	int i;
+	for (i=0;i<n;i++) {
+		struct skynet_socket_message m = *message;
+		if (message->ud < 0) {
+			uint32_t sz;
+			memcpy(&sz, ptr, sizeof(sz));
+			ptr += sizeof(sz);
+			m.ud = (int)sz;
+			m.buffer = ptr;
+		}
+		int addrsz = 0;
+		const char * address = skynet_socket_udp_address(&m, &addrsz);
+		if (address == NULL) {
+			addrsz = 0;
+		}
+		log_socket_record(f, source, session, m.type, m.id, m.ud, m.buffer, m.ud, address, addrsz);
+		if (address == NULL) {
+			// 无法解析之后的数据报
+			break;
+		}
+		ptr += m.ud + addrsz;
+	}
+}
 
+// SKYNET_SOCKET_TYPE_BATCH / SKYNET_SOCKET_TYPE_FRAME: buffer 为 skynet_socket_event 数组，ud 为个数
+// 每个事件一条记录，id 为事件的 id，ud 为数据长度
+static void
+log_events(FILE * f, uint32_t source, int session, struct skynet_socket_message * message) {
+	struct skynet_socket_event * ev = (struct skynet_socket_event *)message->buffer;
+	int i;
+	for (i=0;i<message->ud;i++) {
+		log_socket_record(f, source, session, message->type, ev[i].id, ev[i].size, ev[i].buffer, ev[i].size, NULL, 0);
+	}
+}
+
+static void
+log_socket(FILE * f, uint32_t source, int session, struct skynet_socket_message * message, size_t sz) {
+	const void * payload;
 	if (message->buffer == NULL) {
 		const char *buffer = (const char *)(message + 1);
 		sz -= sizeof(*message);
@@ -54,24 +173,34 @@ log_socket(FILE * f, struct skynet_socket_message * message, size_t sz) {
 		if (eol) {
 			sz = eol - buffer;
 		}
-		fprintf(f, "[%*s]", (int)sz, (const char *)buffer);
+		payload = buffer;
+	} else if (message->type == SKYNET_SOCKET_TYPE_UDP) {
+		log_udp(f, source, session, message);
+		return;
+	} else if (message->type == SKYNET_SOCKET_TYPE_BATCH || message->type == SKYNET_SOCKET_TYPE_FRAME) {
+		log_events(f, source, session, message);
+		return;
 	} else {
 		sz = message->ud;
-		log_blob(f, message->buffer, sz);
+		payload = message->buffer;
 	}
-	fprintf(f, "\n");
-	fflush(f);
+	log_socket_record(f, source, session, message->type, message->id, message->ud, payload, sz, NULL, 0);
 }
 
 void 
 skynet_log_output(FILE *f, uint32_t source, int type, int session, void * buffer, size_t sz) {
 	if (type == PTYPE_SOCKET) {
-		log_socket(f, buffer, sz);
+		log_socket(f, source, session, buffer, sz);
 	} else {
-		uint32_t ti = (uint32_t)skynet_now();
-		fprintf(f, ":%08x %d %d %u ", source, type, session, ti);
-		log_blob(f, buffer, sz);
-		fprintf(f,"\n");
-		fflush(f);
+		struct skynet_log_record r;
+		r.size = (uint32_t)sz;
+		r.source = source;
+		r.type = type;
+		r.session = session;
+		r.time = (uint32_t)skynet_now();
+		fwrite(&r, sizeof(r), 1, f);
+		if (sz) {
+			fwrite(buffer, 1, sz, f);
+		}
 	}
 }
@@ -7,8 +7,32 @@
 #include <stdio.h>
 #include <stdint.h>
 
+/*
+	The log file (logpath/xxxxxxxx.log) is a sequence of records in host byte order,
+	read it with tools/logdump.lua .
+
+	RECORD := struct skynet_log_record + data(size)
+
+	type == SKYNET_LOG_OPEN	: data is uint32 starttime, source is the handle of service
+	type == SKYNET_LOG_CLOSE	: no data
+	type == PTYPE_SOCKET	: data is int32 socket type, int32 id, int32 ud + payload
+	others			: data is the message
+ */
+
+#define SKYNET_LOG_OPEN -1
+#define SKYNET_LOG_CLOSE -2
+
+struct skynet_log_record {
+	uint32_t size;		// 数据长度
+	uint32_t source;	// 消息源服务handle
+	int32_t type;		// 消息类型
+	int32_t session;	// 消息会话
+	uint32_t time;		// skynet_now()
+};
+
 FILE * skynet_log_open(struct skynet_context * ctx, uint32_t handle);
 void skynet_log_close(struct skynet_context * ctx, FILE *f, uint32_t handle);
 void skynet_log_output(FILE *f, uint32_t source, int type, int session, void * buffer, size_t sz);
+void skynet_log_flush(void);	// flush all the log files, called by monitor thread
 
-#endif
\ No newline at end of file
+#endif
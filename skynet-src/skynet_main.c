@@ -162,6 +162,16 @@ main(int argc, char *argv[]) {
 	config.logger = optstring("logger", NULL);
 	config.logservice = optstring("logservice", "logger");
 	config.profile = optboolean("profile", 1);
+	config.trace = optstring("tracefile", NULL);
+	config.errorlimit = optint("errorlimit", 0);
+	config.socket_thread = optint("socket_thread", 1);
+	config.reuseport = optboolean("reuseport", 0);
+	config.max_socket = optint("max_socket", 65536);
+	config.socket_event = optint("socket_event", 64);
+	config.socket_direct = optboolean("socket_direct", 0);
+	config.socket_readall = optboolean("socket_readall", 0);
+	config.udp_batch = optint("udp_batch", 0);
+	config.socket_uring = optboolean("socket_uring", 0);
 
 	lua_close(L);
 
@@ -9,6 +9,8 @@ struct skynet_message {
 	int session;
 	void * data;
 	size_t sz;
+	uint32_t trace;	// trace id, 0 means not traced, read skynet_trace.h
+	uint32_t span;	// parent span id of the receiver
 };
 
 // type is encoding in skynet_message.sz high 8bit
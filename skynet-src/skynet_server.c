@@ -10,6 +10,7 @@
 #include "skynet_monitor.h"
 #include "skynet_imp.h"
 #include "skynet_log.h"
+#include "skynet_trace.h"
 #include "skynet_timer.h"
 #include "spinlock.h"
 #include "atomic.h"
@@ -50,6 +51,10 @@ struct skynet_context {
 	FILE * logfile;			//日志指针
 	uint64_t cpu_cost;	// in microsec
 	uint64_t cpu_start;	// in microsec
+	uint64_t trace_start;	// 当前消息开始处理的时间，仅在开启追踪时记录
+	uint32_t trace;		// 当前处理消息所属的调用链id，0为未追踪
+	uint32_t trace_span;	// 当前处理消息的span id
+	uint32_t trace_parent;	// 当前处理消息的父span id
 	char result[32];		//skynet_command 指令操作结果缓冲区
 	uint32_t handle;		//唯一句柄，通过skynet_handle_register分配
 	int session_id;			//会话id
@@ -162,6 +167,10 @@ skynet_context_new(const char * name, const char *param) {
 
 	ctx->cpu_cost = 0;
 	ctx->cpu_start = 0;
+	ctx->trace_start = 0;
+	ctx->trace = 0;
+	ctx->trace_span = 0;
+	ctx->trace_parent = 0;
 	ctx->message_count = 0;
 	ctx->profile = G_NODE.profile;
 	// Should set to 0 first to avoid skynet_handle_retireall get an uninitialized handle
@@ -286,6 +295,42 @@ skynet_isremote(struct skynet_context * ctx, uint32_t handle, int * harbor) {
 	return ret;
 }
 
+// 开始处理一条消息，如果消息属于某条调用链，为本次处理分配新的span
+static inline void
+trace_enter(struct skynet_context *ctx, struct skynet_message *msg) {
+	if (!skynet_trace_enable()) {
+		return;
+	}
+	ctx->trace_start = skynet_trace_time();
+	if (msg->trace) {
+		ctx->trace = msg->trace;
+		ctx->trace_parent = msg->span;
+		ctx->trace_span = skynet_trace_newid();
+	}
+}
+
+// 消息处理完毕，记录span
+static inline void
+trace_leave(struct skynet_context *ctx, uint32_t source, int type, int session) {
+	if (ctx->trace == 0) {
+		return;
+	}
+	struct skynet_trace_span span;
+	span.trace = ctx->trace;
+	span.span = ctx->trace_span;
+	span.parent = ctx->trace_parent;
+	span.source = source;
+	span.handle = ctx->handle;
+	span.type = type;
+	span.session = session;
+	span.start = ctx->trace_start;
+	span.stop = skynet_trace_time();
+	skynet_trace_record(&span);
+	ctx->trace = 0;
+	ctx->trace_span = 0;
+	ctx->trace_parent = 0;
+}
+
 // 消息分发
 static void
 dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
@@ -303,6 +348,7 @@ dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 		skynet_log_output(ctx->logfile, msg->source, type, msg->session, msg->data, sz);
 	}
 	++ctx->message_count;
+	trace_enter(ctx, msg);
 	int reserve_msg;
 	if (ctx->profile) {
 		ctx->cpu_start = skynet_thread_time();
@@ -312,6 +358,7 @@ dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 	} else {
 		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
 	}
+	trace_leave(ctx, msg->source, type, msg->session);
 	if (!reserve_msg) {
 		// 返回0执行成功，由接收方释放消息数据内存空间
 		skynet_free(msg->data);
@@ -845,6 +892,14 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 		smsg.session = session;
 		smsg.data = data;
 		smsg.sz = sz;
+		// 在调用链中发出的消息(包括 skynet.ret 的回应)，携带当前的调用链上下文
+		if (context) {
+			smsg.trace = context->trace;
+			smsg.span = context->trace_span;
+		} else {
+			smsg.trace = 0;
+			smsg.span = 0;
+		}
 
 		if (skynet_context_push(destination, &smsg)) {
 			skynet_free(data);
@@ -909,10 +964,46 @@ skynet_context_send(struct skynet_context * ctx, void * msg, size_t sz, uint32_t
 	smsg.session = session;
 	smsg.data = msg;
 	smsg.sz = sz | (size_t)type << MESSAGE_TYPE_SHIFT;
+	smsg.trace = 0;
+	smsg.span = 0;
 
 	skynet_mq_push(ctx->queue, &smsg);
 }
 
+// 开启或加入调用链，只能在服务处理消息的过程中调用
+// trace 为 0 时，如果当前消息不在调用链中，开启一条新的调用链，当前消息作为根span
+// trace 不为 0 时，当前消息加入调用链 trace (一般来自其他节点)，父span为 parent
+// 返回当前的调用链id，未开启追踪时返回 0
+uint32_t
+skynet_trace_begin(struct skynet_context * ctx, uint32_t trace, uint32_t parent) {
+	if (!skynet_trace_enable()) {
+		return 0;
+	}
+	if (trace == 0) {
+		if (ctx->trace == 0) {
+			ctx->trace = skynet_trace_newid();
+			ctx->trace_span = skynet_trace_newid();
+			ctx->trace_parent = 0;
+		}
+	} else {
+		ctx->trace = trace;
+		ctx->trace_parent = parent;
+		if (ctx->trace_span == 0) {
+			ctx->trace_span = skynet_trace_newid();
+		}
+	}
+	return ctx->trace;
+}
+
+// 返回当前消息所属的调用链id，span 返回当前的span id
+uint32_t
+skynet_trace_current(struct skynet_context * ctx, uint32_t *span) {
+	if (span) {
+		*span = ctx->trace_span;
+	}
+	return ctx->trace;
+}
+
 // skynet全局变量初始化
 void 
 skynet_globalinit(void) {
@@ -5,6 +5,7 @@
 #include "skynet_server.h"
 #include "skynet_mq.h"
 #include "skynet_harbor.h"
+#include "skynet_imp.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -14,10 +15,21 @@
 // socket_server 实例
 static struct socket_server * SOCKET_SERVER = NULL;
 
-// 创建 socket_server
+// 创建 socket_server，socket_thread 个socket线程各自运行一个事件循环
 void 
-skynet_socket_init() {
-	SOCKET_SERVER = socket_server_create();
+skynet_socket_init(struct skynet_config *config) {
+	SOCKET_SERVER = socket_server_create_ex(config->socket_thread, config->max_socket, config->socket_event);
+	socket_server_reuseport(SOCKET_SERVER, config->reuseport);
+	socket_server_direct(SOCKET_SERVER, config->socket_direct);
+	socket_server_readall(SOCKET_SERVER, config->socket_readall);
+	socket_server_udp_batch(SOCKET_SERVER, config->udp_batch);
+	socket_server_uring(SOCKET_SERVER, config->socket_uring);
+}
+
+// socket线程的数量
+int
+skynet_socket_thread() {
+	return socket_server_thread(SOCKET_SERVER);
 }
 
 // 退出 socket_server
@@ -75,26 +87,58 @@ forward_message(int type, bool padding, struct socket_message * result) {
 	message.session = 0;
 	message.data = sm;
 	message.sz = sz | ((size_t)PTYPE_SOCKET << MESSAGE_TYPE_SHIFT);
+	message.trace = 0;
+	message.span = 0;
 
 	// 压入对应服务的消息队列
 	// result->opaque是对应服务的handle
 	if (skynet_context_push((uint32_t)result->opaque, &message)) {
 		// todo: report somewhere to close socket
 		// don't call skynet_socket_close here (It will block mainloop)
+		if (type == SKYNET_SOCKET_TYPE_BATCH || type == SKYNET_SOCKET_TYPE_FRAME) {
+			struct skynet_socket_event *ev = (struct skynet_socket_event *)sm->buffer;
+			int i;
+			for (i=0;i<sm->ud;i++) {
+				skynet_free(ev[i].buffer);
+			}
+		}
 		skynet_free(sm->buffer);
 		skynet_free(sm);
 	}
 }
 
-// socket事件循环，在thread_socket中被socket线程循环调用
+// socket写和accept统计
+void
+skynet_socket_stat(struct skynet_socket_stat *stat) {
+	struct socket_server_stat ss;
+	socket_server_stat(SOCKET_SERVER, &ss);
+	stat->write_syscall = ss.write_syscall;
+	stat->write_bytes = ss.write_bytes;
+	stat->accept = ss.accept;
+	stat->accept_error = ss.accept_error;
+	stat->accept_drop = ss.accept_drop;
+}
+
+// socket流量统计快照，id < 0 时返回所有socket
+struct socket_info *
+skynet_socket_info(int id) {
+	return socket_server_info(SOCKET_SERVER, id);
+}
+
+void
+skynet_socket_info_release(struct socket_info *si) {
+	socket_info_release(si);
+}
+
+// socket事件循环，在thread_socket中被第 thread 个socket线程循环调用
 int 
-skynet_socket_poll() {
+skynet_socket_poll(int thread) {
 	struct socket_server *ss = SOCKET_SERVER;
 	assert(ss);
 	struct socket_message result;
 	int more = 1;
 	// socket_server 事件循环
-	int type = socket_server_poll(ss, &result, &more);
+	int type = socket_server_poll_thread(ss, thread, &result, &more);
 	switch (type) {
 	case SOCKET_EXIT:
 		return 0;
@@ -122,6 +166,18 @@ skynet_socket_poll() {
 		// 有udp数据读入
 		forward_message(SKYNET_SOCKET_TYPE_UDP, false, &result);
 		break;
+	case SOCKET_WARNING:
+		// 发送缓冲区超过高水位或者降到低水位
+		forward_message(SKYNET_SOCKET_TYPE_WARNING, false, &result);
+		break;
+	case SOCKET_BATCH:
+		// 一批事件中读到的多个数据，socket_event 数组和 skynet_socket_event 布局相同，直接转发
+		forward_message(SKYNET_SOCKET_TYPE_BATCH, false, &result);
+		break;
+	case SOCKET_FRAME:
+		// 分帧模式下一次读到的完整的包
+		forward_message(SKYNET_SOCKET_TYPE_FRAME, false, &result);
+		break;
 	default:
 		skynet_error(NULL, "Unknown socket message type %d.",type);
 		return -1;
@@ -132,29 +188,23 @@ skynet_socket_poll() {
 	return 1;
 }
 
-// 检查写缓冲区链表中数据的大小
-static int
-check_wsz(struct skynet_context *ctx, int id, void *buffer, int64_t wsz) {
-	if (wsz < 0) {
-		return -1;
-	} else if (wsz > 1024 * 1024) {
-		// 如果超过1M，发送警告消息
-		struct skynet_socket_message tmp;
-		tmp.type = SKYNET_SOCKET_TYPE_WARNING;
-		tmp.id = id;
-		tmp.ud = (int)(wsz / 1024);
-		tmp.buffer = NULL;
-		skynet_send(ctx, 0, skynet_context_handle(ctx), PTYPE_SOCKET, 0 , &tmp, sizeof(tmp));
-//		skynet_error(ctx, "%d Mb bytes on socket %d need to send out", (int)(wsz / (1024 * 1024)), id);
-	}
-	return 0;
-}
-
 // 发送socket消息
 int
 skynet_socket_send(struct skynet_context *ctx, int id, void *buffer, int sz) {
 	int64_t wsz = socket_server_send(SOCKET_SERVER, id, buffer, sz);
-	return check_wsz(ctx, id, buffer, wsz);
+	return wsz < 0 ? -1 : 0;
+}
+
+// 发送文件，fd 由 socket_server 接管
+int
+skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int sz) {
+	return socket_server_sendfile(SOCKET_SERVER, id, fd, offset, sz);
+}
+
+// 同一份数据发送给多个socket，数据由所有目标共享
+int
+skynet_socket_broadcast(struct skynet_context *ctx, const int *id, int n, void *buffer, int sz) {
+	return socket_server_broadcast(SOCKET_SERVER, id, n, buffer, sz);
 }
 
 // 发送socket消息(低优先级)
@@ -163,6 +213,12 @@ skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer,
 	socket_server_send_lowpriority(SOCKET_SERVER, id, buffer, sz);
 }
 
+// 设置发送缓冲区水位
+void
+skynet_socket_watermark(struct skynet_context *ctx, int id, int64_t high, int64_t low, int64_t limit) {
+	socket_server_watermark(SOCKET_SERVER, id, high, low, limit);
+}
+
 // 监听socket
 int 
 skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog) {
@@ -211,6 +267,18 @@ skynet_socket_nodelay(struct skynet_context *ctx, int id) {
 	socket_server_nodelay(SOCKET_SERVER, id);
 }
 
+// 设置分帧模式，包头长度 2 或 4，0 取消，SKYNET_SOCKET_TYPE_FRAME
+void
+skynet_socket_frame(struct skynet_context *ctx, int id, int header, int max) {
+	socket_server_frame(SOCKET_SERVER, id, header, max);
+}
+
+// 设置是否合并数据消息，SKYNET_SOCKET_TYPE_BATCH
+void
+skynet_socket_coalesce(struct skynet_context *ctx, int id, int enable) {
+	socket_server_coalesce(SOCKET_SERVER, id, enable);
+}
+
 // 创建udp连接
 int 
 skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port) {
@@ -228,7 +296,7 @@ skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr,
 int 
 skynet_socket_udp_send(struct skynet_context *ctx, int id, const char * address, const void *buffer, int sz) {
 	int64_t wsz = socket_server_udp_send(SOCKET_SERVER, id, (const struct socket_udp_address *)address, buffer, sz);
-	return check_wsz(ctx, id, (void *)buffer, wsz);
+	return wsz < 0 ? -1 : 0;
 }
 
 const char *
@@ -1,7 +1,10 @@
 #ifndef skynet_socket_h
 #define skynet_socket_h
 
+#include <stdint.h>
+
 struct skynet_context;
+struct skynet_config;
 
 #define SKYNET_SOCKET_TYPE_DATA 1
 #define SKYNET_SOCKET_TYPE_CONNECT 2
@@ -10,6 +13,8 @@ struct skynet_context;
 #define SKYNET_SOCKET_TYPE_ERROR 5
 #define SKYNET_SOCKET_TYPE_UDP 6
 #define SKYNET_SOCKET_TYPE_WARNING 7
+#define SKYNET_SOCKET_TYPE_BATCH 8
+#define SKYNET_SOCKET_TYPE_FRAME 9
 
 struct skynet_socket_message {
 	int type;
@@ -18,13 +23,38 @@ struct skynet_socket_message {
 	char * buffer;
 };
 
-void skynet_socket_init();
+struct socket_info;
+
+// SKYNET_SOCKET_TYPE_BATCH / SKYNET_SOCKET_TYPE_FRAME: ud is the number of events, buffer is an array of
+// skynet_socket_event, the same layout as struct socket_event. The receiver frees each buffer and the array.
+struct skynet_socket_event {
+	int id;
+	int size;
+	char * buffer;
+};
+
+struct skynet_socket_stat {
+	uint64_t write_syscall;
+	uint64_t write_bytes;
+	uint64_t accept;
+	uint64_t accept_error;
+	uint64_t accept_drop;
+};
+
+void skynet_socket_init(struct skynet_config *config);
 void skynet_socket_exit();
 void skynet_socket_free();
-int skynet_socket_poll();
+int skynet_socket_thread();
+int skynet_socket_poll(int thread);
+void skynet_socket_stat(struct skynet_socket_stat *stat);
+// see socket_server_info in socket_server.h
+struct socket_info * skynet_socket_info(int id);
+void skynet_socket_info_release(struct socket_info *si);
 
 int skynet_socket_send(struct skynet_context *ctx, int id, void *buffer, int sz);
+int skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int sz);
 void skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer, int sz);
+int skynet_socket_broadcast(struct skynet_context *ctx, const int *id, int n, void *buffer, int sz);
 int skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog);
 int skynet_socket_connect(struct skynet_context *ctx, const char *host, int port);
 int skynet_socket_bind(struct skynet_context *ctx, int fd);
@@ -32,6 +62,9 @@ void skynet_socket_close(struct skynet_context *ctx, int id);
 void skynet_socket_shutdown(struct skynet_context *ctx, int id);
 void skynet_socket_start(struct skynet_context *ctx, int id);
 void skynet_socket_nodelay(struct skynet_context *ctx, int id);
+void skynet_socket_coalesce(struct skynet_context *ctx, int id, int enable);
+void skynet_socket_frame(struct skynet_context *ctx, int id, int header, int max);
+void skynet_socket_watermark(struct skynet_context *ctx, int id, int64_t high, int64_t low, int64_t limit);
 
 int skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port);
@@ -9,6 +9,9 @@
 #include "skynet_socket.h"
 #include "skynet_daemon.h"
 #include "skynet_harbor.h"
+#include "skynet_trace.h"
+#include "skynet_log.h"
+#include "skynet_error.h"
 
 #include <pthread.h>
 #include <unistd.h>
@@ -33,6 +36,11 @@ struct worker_parm {
 	int weight;
 };
 
+struct socket_parm {
+	struct monitor *m;
+	int id;
+};
+
 static int SIG = 0;
 
 static void
@@ -63,11 +71,12 @@ wakeup(struct monitor *m, int busy) {
 // socket线程入口函数
 static void *
 thread_socket(void *p) {
-	struct monitor * m = p;
+	struct socket_parm *sp = p;
+	struct monitor * m = sp->m;
 	skynet_initthread(THREAD_SOCKET);
 	for (;;) {
 		//socket事件循环
-		int r = skynet_socket_poll();
+		int r = skynet_socket_poll(sp->id);
 		if (r==0)
 			break;
 		if (r<0) {
@@ -108,6 +117,10 @@ thread_monitor(void *p) {
 		for (i=0;i<5;i++) {
 			CHECK_ABORT
 			sleep(1);
+			// 每秒导出一次调用链span，刷新服务日志文件，输出被抑制的日志条数
+			skynet_trace_export();
+			skynet_log_flush();
+			skynet_error_flush();
 		}
 	}
 
@@ -123,6 +136,8 @@ signal_hup() {
 	smsg.session = 0;
 	smsg.data = NULL;
 	smsg.sz = (size_t)PTYPE_SYSTEM << MESSAGE_TYPE_SHIFT;
+	smsg.trace = 0;
+	smsg.span = 0;
 	uint32_t logger = skynet_handle_findname("logger");
 	if (logger) {
 		skynet_context_push(logger, &smsg);
@@ -189,8 +204,9 @@ thread_worker(void *p) {
 // 启动线程
 static void
 start(int thread) {
-	//thread个工作线程，另外3个分别为monitor timer socket 线程各一个
-	pthread_t pid[thread+3];
+	//thread个工作线程，monitor timer 线程各一个，socket_thread个socket线程
+	int socket_thread = skynet_socket_thread();
+	pthread_t pid[thread+2+socket_thread];
 
 	//为每个工作线程，创建一个skynet_monitor
 	struct monitor *m = skynet_malloc(sizeof(*m));
@@ -217,7 +233,12 @@ start(int thread) {
 	//创建monitor timer socket 线程
 	create_thread(&pid[0], thread_monitor, m);
 	create_thread(&pid[1], thread_timer, m);
-	create_thread(&pid[2], thread_socket, m);
+	struct socket_parm sp[socket_thread];
+	for (i=0;i<socket_thread;i++) {
+		sp[i].m = m;
+		sp[i].id = i;
+		create_thread(&pid[i+2], thread_socket, &sp[i]);
+	}
 
 	/*
 		https://github.com/cloudwu/skynet/blob/master/skynet-src/skynet_server.c#L299-L301
@@ -242,10 +263,10 @@ start(int thread) {
 		} else {
 			wp[i].weight = 0;
 		}
-		create_thread(&pid[i+3], thread_worker, &wp[i]);
+		create_thread(&pid[i+2+socket_thread], thread_worker, &wp[i]);
 	}
 
-	for (i=0;i<thread+3;i++) {
+	for (i=0;i<thread+2+socket_thread;i++) {
 		pthread_join(pid[i], NULL); 
 	}
 
@@ -294,8 +315,12 @@ skynet_start(struct skynet_config * config) {
 	// 初始化skynet_timer
 	skynet_timer_init();
 	// 初始化skynet_socket
-	skynet_socket_init();
+	skynet_socket_init(config);
 	skynet_profile_enable(config->profile);
+	// 初始化调用链追踪
+	skynet_trace_init(config->trace);
+	// 初始化日志限流
+	skynet_error_init(config->errorlimit);
 
 	// 启动log服务
 	struct skynet_context *ctx = skynet_context_new(config->logservice, config->logger);
@@ -313,6 +338,7 @@ skynet_start(struct skynet_config * config) {
 	// harbor_exit may call socket send, so it should exit before socket_free
 	skynet_harbor_exit();
 	skynet_socket_free();
+	skynet_trace_exit();
 	if (config->daemon) {
 		daemon_exit(config->daemon);
 	}
@@ -223,6 +223,8 @@ dispatch_list(struct timer_node *current) {
 		message.session = event->session;
 		message.data = NULL;
 		message.sz = (size_t)PTYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+		message.trace = 0;
+		message.span = 0;
 	
 		// 发送回应消息
 		skynet_context_push(event->handle, &message);
@@ -303,6 +305,8 @@ skynet_timeout(uint32_t handle, int time, int session) {
 		message.session = session;
 		message.data = NULL;
 		message.sz = (size_t)PTYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+		message.trace = 0;
+		message.span = 0;
 
 		if (skynet_context_push(handle, &message)) {
 			return -1;
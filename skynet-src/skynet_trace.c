@@ -0,0 +1,156 @@
+#include "skynet.h"
+#include "skynet_trace.h"
+#include "atomic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+// span环形缓冲区大小，必须是2的幂
+#define TRACE_RING_SIZE 0x10000
+
+// 环形缓冲区中的槽位
+struct trace_slot {
+	uint64_t seq;			// 写入完成后赋值为 index+1，0 表示正在写入
+	struct skynet_trace_span span;
+};
+
+// 节点内唯一的span环形缓冲区
+// 多个工作线程无锁写入(head原子递增)，只有导出者(监视器线程)读取(tail)
+// 导出不及时时，旧的span会被覆盖，并计入lost
+struct trace_ring {
+	uint64_t head;			// 下一个写入位置
+	uint64_t tail;			// 下一个导出位置
+	uint64_t lost;			// 被覆盖而丢失的span数量
+	uint32_t id;			// trace/span id分配器
+	FILE * f;			// 导出文件
+	struct trace_slot slot[TRACE_RING_SIZE];
+};
+
+static struct trace_ring *T = NULL;
+
+void
+skynet_trace_init(const char * filename) {
+	if (filename == NULL) {
+		return;
+	}
+	FILE *f = fopen(filename, "ab");
+	if (f == NULL) {
+		fprintf(stderr, "Can't open trace file %s\n", filename);
+		return;
+	}
+	struct trace_ring *r = skynet_malloc(sizeof(*r));
+	memset(r, 0, sizeof(*r));
+	r->f = f;
+	// 不同节点(进程)的id从不同的位置开始，降低跨节点调用链id冲突的概率
+	r->id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+	T = r;
+}
+
+void
+skynet_trace_exit(void) {
+	if (T == NULL) {
+		return;
+	}
+	skynet_trace_export();
+	fclose(T->f);
+	skynet_free(T);
+	T = NULL;
+}
+
+int
+skynet_trace_enable(void) {
+	return T != NULL;
+}
+
+// 分配trace id或span id，0保留为无效值
+uint32_t
+skynet_trace_newid(void) {
+	uint32_t id;
+	do {
+		id = ATOM_INC(&T->id);
+	} while (id == 0);
+	return id;
+}
+
+// 墙上时间，微秒，跨节点的span可以按时间对齐
+uint64_t
+skynet_trace_time(void) {
+#if !defined(__APPLE__)
+	struct timespec ti;
+	clock_gettime(CLOCK_REALTIME, &ti);
+	return (uint64_t)ti.tv_sec * 1000000 + ti.tv_nsec / 1000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+// 写入一个span，可以在任意线程调用
+void
+skynet_trace_record(struct skynet_trace_span *span) {
+	struct trace_ring *r = T;
+	if (r == NULL) {
+		return;
+	}
+	uint64_t index = ATOM_FINC(&r->head);
+	struct trace_slot *s = &r->slot[index & (TRACE_RING_SIZE-1)];
+	s->seq = 0;
+	__sync_synchronize();
+	s->span = *span;
+	__sync_synchronize();
+	s->seq = index + 1;
+}
+
+// 把环形缓冲区中已完成写入的span导出到文件，只能在一个线程中调用
+int
+skynet_trace_export(void) {
+	struct trace_ring *r = T;
+	if (r == NULL) {
+		return 0;
+	}
+	uint64_t head = __sync_add_and_fetch(&r->head, 0);
+	uint64_t tail = r->tail;
+	uint64_t lost = 0;
+	int n = 0;
+	if (head - tail > TRACE_RING_SIZE) {
+		lost += head - tail - TRACE_RING_SIZE;
+		tail = head - TRACE_RING_SIZE;
+	}
+	while (tail != head) {
+		struct trace_slot *s = &r->slot[tail & (TRACE_RING_SIZE-1)];
+		uint64_t seq = s->seq;
+		__sync_synchronize();
+		if (seq < tail + 1) {
+			// 还在写入中，下次再导出
+			break;
+		}
+		struct skynet_trace_span span = s->span;
+		__sync_synchronize();
+		if (seq != tail + 1 || s->seq != seq) {
+			// 读取过程中被新的span覆盖
+			++lost;
+			++tail;
+			continue;
+		}
+		fprintf(r->f, "%08x %08x %08x :%08x :%08x %d %d %" PRIu64 " %" PRIu64 "\n",
+			span.trace, span.span, span.parent, span.source, span.handle,
+			span.type, span.session, span.start, span.stop);
+		++tail;
+		++n;
+	}
+	r->tail = tail;
+	if (lost) {
+		r->lost += lost;
+		fprintf(r->f, "# lost %" PRIu64 " spans\n", r->lost);
+	}
+	if (n || lost) {
+		fflush(r->f);
+	}
+	return n;
+}
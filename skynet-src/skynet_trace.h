@@ -0,0 +1,28 @@
+#ifndef SKYNET_TRACE_H
+#define SKYNET_TRACE_H
+
+#include <stdint.h>
+
+// 一个span对应一次被追踪消息在某个服务中的处理过程
+struct skynet_trace_span {
+	uint32_t trace;		// 调用链id，同一条调用链上的所有span相同
+	uint32_t span;		// 本次处理的span id
+	uint32_t parent;	// 父span id，根span为0
+	uint32_t source;	// 消息源服务handle
+	uint32_t handle;	// 处理消息的服务handle
+	int type;		// 消息类型
+	int session;		// 消息会话
+	uint64_t start;		// 开始时间，微秒
+	uint64_t stop;		// 结束时间，微秒
+};
+
+void skynet_trace_init(const char * filename);
+void skynet_trace_exit(void);
+int skynet_trace_enable(void);
+
+uint32_t skynet_trace_newid(void);
+uint64_t skynet_trace_time(void);	// in micro second
+void skynet_trace_record(struct skynet_trace_span *span);
+int skynet_trace_export(void);	// return the number of spans written
+
+#endif
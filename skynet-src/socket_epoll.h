@@ -10,6 +10,13 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SP_URING
+#include "socket_uring.h"
+#endif
+#endif
+
 static bool 
 sp_invalid(int efd) {
 	return efd == -1;
@@ -24,6 +31,12 @@ sp_create() {
 // 关闭epoll文件描述符
 static void
 sp_release(int efd) {
+#ifdef SP_URING
+	if (uring_is(efd)) {
+		sp_release_uring(efd);
+		return;
+	}
+#endif
 	close(efd);
 }
 
@@ -35,6 +48,11 @@ sp_release(int efd) {
 // EPOLLOUT，只会在内核缓冲区不可写到可写的转变时刻，才会触发一次，所以叫边缘触发
 static int 
 sp_add(int efd, int sock, void *ud) {
+#ifdef SP_URING
+	if (uring_is(efd)) {
+		return sp_add_uring(efd, sock, ud);
+	}
+#endif
 	struct epoll_event ev;
 	ev.events = EPOLLIN;
 	ev.data.ptr = ud;
@@ -47,12 +65,24 @@ sp_add(int efd, int sock, void *ud) {
 // 把sock移出efd事件循环管理
 static void 
 sp_del(int efd, int sock) {
+#ifdef SP_URING
+	if (uring_is(efd)) {
+		sp_del_uring(efd, sock);
+		return;
+	}
+#endif
 	epoll_ctl(efd, EPOLL_CTL_DEL, sock , NULL);
 }
 
 // 修改sock在efd中的权限
 static void 
 sp_write(int efd, int sock, void *ud, bool enable) {
+#ifdef SP_URING
+	if (uring_is(efd)) {
+		sp_write_uring(efd, sock, ud, enable);
+		return;
+	}
+#endif
 	struct epoll_event ev;
 	ev.events = EPOLLIN | (enable ? EPOLLOUT : 0);
 	ev.data.ptr = ud;
@@ -62,6 +92,11 @@ sp_write(int efd, int sock, void *ud, bool enable) {
 // 等待就绪的事件列表
 static int 
 sp_wait(int efd, struct event *e, int max) {
+#ifdef SP_URING
+	if (uring_is(efd)) {
+		return sp_wait_uring(efd, e, max);
+	}
+#endif
 	struct epoll_event ev[max];
 	int n = epoll_wait(efd , ev, max, -1);
 	int i;
@@ -70,6 +105,7 @@ sp_wait(int efd, struct event *e, int max) {
 		unsigned flag = ev[i].events;
 		e[i].write = (flag & EPOLLOUT) != 0;
 		e[i].read = (flag & EPOLLIN) != 0;
+		e[i].done = false;
 	}
 
 	return n;
@@ -75,6 +75,7 @@ sp_wait(int kfd, struct event *e, int max) {
 		unsigned filter = ev[i].filter;
 		e[i].write = (filter == EVFILT_WRITE);
 		e[i].read = (filter == EVFILT_READ);
+		e[i].done = false;
 	}
 
 	return n;
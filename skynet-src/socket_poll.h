@@ -9,6 +9,11 @@ struct event {
 	void * s;
 	bool read;
 	bool write;
+	// 只有 io_uring 的 accept / recv 完成事件为 true，这时 res 为 accept 得到的 fd 或 recv 读到的字节数 (出错为 -errno)，
+	// buffer 为 recv 读到的数据 (malloc 分配，随事件交给调用者)
+	bool done;
+	int res;
+	char * buffer;
 };
 
 static bool sp_invalid(poll_fd fd);
@@ -1,26 +1,50 @@
+#if defined(__linux__)
+#define _GNU_SOURCE	// for recvmmsg / sendmmsg
+#define USE_MMSG
+#endif
+
 #include "skynet.h"
 
 #include "socket_server.h"
 #include "socket_poll.h"
 #include "atomic.h"
+#include "spinlock.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
 
 #define MAX_INFO 128
-// MAX_SOCKET will be 2^MAX_SOCKET_P
-#define MAX_SOCKET_P 16
-#define MAX_EVENT 64			// 事件循环最大事件数，sp_wait
+#define DEFAULT_MAX_SOCKET (1<<16)	// 默认 socket 仓库容量
+#define MAX_SOCKET_P 24			// socket 仓库容量最大 2^MAX_SOCKET_P
+#define SLOT_PAGE_P 10
+#define SLOT_PAGE_SIZE (1<<SLOT_PAGE_P)	// socket 仓库按页分配，每页 1024 个
+#define DEFAULT_MAX_EVENT 64		// 事件循环一次最多取出的事件数，sp_wait
+#define MAX_COALESCE 16			// 一批事件中最多为多少个服务合并数据消息，超过的逐个发送
+#define MAX_FRAME_SIZE 0x1000000	// 分帧模式下包的最大长度上限 16M
+#define DEFAULT_FRAME_SIZE 0x10000	// 分帧模式下包的默认最大长度 64K，见 socket_server_frame
+#define ACCEPT_BUDGET 64		// 一个监听事件最多连续 accept 的连接数，剩余的等下一次 sp_wait
 #define MIN_READ_BUFFER 64		// 默认读缓冲区最小长度，read
+#define READ_BUFFER_CLASS 15		// 读缓冲区按2的幂分级，MIN_READ_BUFFER ~ MAX_READ_BUFFER
+#define MAX_READ_BUFFER (MIN_READ_BUFFER << (READ_BUFFER_CLASS-1))	// 读缓冲区最大长度 1M
+#define READ_POOL_DEPTH 16		// 每个大小等级最多预分配的读缓冲区数
+#define READ_POOL_BYTES 0x10000		// 每个大小等级预分配的总长度，大的等级少备几个，至少一个
 #define SOCKET_TYPE_INVALID 0	// 默认初始无效套接字
 #define SOCKET_TYPE_RESERVE 1   // 保留套接字，系统已为其分配id与之对应
 #define SOCKET_TYPE_PLISTEN 2	// 监听套接字，但未加入事件循环管理
@@ -31,13 +55,9 @@
 #define SOCKET_TYPE_PACCEPT 7	// 被动连接套接字，accept后并未加入事件循环管理
 #define SOCKET_TYPE_BIND 8		// 绑定文件描述符，把stdin stdout 等加入事件循环管理
 
-#define MAX_SOCKET (1<<MAX_SOCKET_P)
-
 #define PRIORITY_HIGH 0
 #define PRIORITY_LOW 1
 
-#define HASH_ID(id) (((unsigned)id) % MAX_SOCKET)
-
 #define PROTOCOL_TCP 0
 #define PROTOCOL_UDP 1
 #define PROTOCOL_UDPv6 2
@@ -45,6 +65,16 @@
 #define UDP_ADDRESS_SIZE 19	// ipv6 128bit + port 16bit + 1 byte type
 
 #define MAX_UDP_PACKAGE 65535
+#define DEFAULT_HIGH_WATERMARK (1024 * 1024)	// 默认高水位 1M
+#define MAX_UDP_BATCH 64		// recvmmsg/sendmmsg 一次最多处理的数据报个数
+#define MIN_CMD_QUEUE 4096		// 控制指令队列的初始长度
+
+// writev 一次最多合并的写缓冲区个数
+#ifdef IOV_MAX
+#define MAX_IOV IOV_MAX
+#else
+#define MAX_IOV 64
+#endif
 
 // EAGAIN and EWOULDBLOCK may be not the same value.
 #if (EAGAIN != EWOULDBLOCK)
@@ -60,6 +90,9 @@ struct write_buffer {
 	char *ptr;								// 数据指针
 	int sz;									// 数据大小
 	bool userobject;
+	bool broadcast;							// buffer 是共享的 struct socket_broadcast
+	int file_fd;							// sendfile 的文件描述符，-1 表示内存数据
+	int64_t offset;							// sendfile 的文件偏移
 	uint8_t udp_address[UDP_ADDRESS_SIZE];
 };
 
@@ -86,23 +119,114 @@ struct socket {
 		int size;								// tcp 读缓冲区大小，默认为 MIN_READ_BUFFER，动态变化
 		uint8_t udp_address[UDP_ADDRESS_SIZE];
 	} p;
+	// 工作线程直接写入 (socket_server_direct)
+	struct spinlock dw_lock;					// 工作线程直接写入和socket线程关闭fd互斥
+	int sending;								// 已提交但socket线程还未处理的发送请求数
+	struct write_buffer * dw_buffer;			// 直接写入没有写完的剩余部分，由socket线程接管
+	bool dw_held;								// socket线程正持有 dw_lock 写入，只在socket线程中访问
+	// 发送缓冲区水位 (socket_server_watermark)
+	int64_t high_watermark;						// wb_size 超过高水位时通知服务暂停发送
+	int64_t low_watermark;						// 暂停后 wb_size 降到低水位以下时通知服务恢复发送
+	int64_t limit;								// wb_size 超过硬上限时关闭连接，0 不限制
+	bool paused;								// 已发送暂停通知，还未恢复
+	int next_free;								// 空闲链表中下一个socket的仓库索引
+	bool coalesce;								// 一批事件中读到的数据合并成一条消息发给服务 (socket_server_coalesce)
+	// 分帧 (socket_server_frame)，socket线程按长度包头切出完整的包
+	uint8_t frame;								// 包头长度 2 或 4 (大端)，0 不分帧
+	uint8_t frame_header_n;						// 已读的包头字节数
+	uint8_t frame_header[4];
+	int frame_size;								// 当前包的长度，-1 表示正在读包头
+	int frame_read;								// 当前包已读的长度
+	int frame_cap;								// frame_buffer 的大小，随读到的数据增长
+	int frame_max;								// 包的最大长度，超过时关闭连接
+	char * frame_buffer;						// 当前包的缓冲区
+	// 流量统计，只在socket线程中修改 (socket_server_info)
+	uint64_t recv_bytes;						// 读入字节数
+	uint64_t recv_packets;						// 读入次数
+	uint64_t send_bytes;						// socket线程写出的字节数
+	uint64_t send_packets;						// 发送请求数
+	uint64_t dw_bytes;							// 工作线程直接写入的字节数，持有 dw_lock 时修改
+	uint64_t dw_packets;						// 工作线程直接写入的发送请求数，持有 dw_lock 时修改
+	uint64_t last_active;						// 最后一次读写的时间，毫秒
 };
 
-// 套接字服务器实体
-struct socket_server {
-	int recvctrl_fd;			// 接受套接字
-	int sendctrl_fd;			// 发送套接字
+// 控制指令队列，多个工作线程写入，socket线程整批取出
+// 指令依次紧凑存放: type(1) len(1) data(len)
+struct cmd_queue {
+	struct spinlock lock;
+	int signaled;				// 已经写过唤醒管道，socket线程取出指令之前不再写
+	int size;				// 已写入的长度
+	int cap;				// buffer 容量
+	uint8_t *buffer;
+};
+
+// 一批事件中发给同一个服务的数据，批次结束时合并为一条 SOCKET_BATCH 消息
+struct coalesce_buffer {
+	uintptr_t opaque;			// 服务handle
+	int n;					// 数据个数
+	int cap;				// ev 容量，只有一个数据时不分配 ev
+	struct socket_event first;		// 第一个数据
+	struct socket_event *ev;		// 所有数据，随消息交给服务释放
+};
+
+// 一个大小等级的读缓冲区池，只在 socket 线程中使用
+struct read_pool {
+	int n;
+	char * buffer[READ_POOL_DEPTH];
+};
+
+// 事件循环，每个socket线程一个
+// socket按 id % thread 归属于某一个事件循环，只在对应的socket线程中读写
+struct socket_poller {
+	int recvctrl_fd;			// 唤醒管道读端
+	int sendctrl_fd;			// 唤醒管道写端
 	int checkctrl;				// 检查指令标识 默认为1
 	poll_fd event_fd;			// 事件循环句柄
-	int alloc_id;				// 系统分配的递增id，用于生成hash索引
 	int event_n;				// 事件循环中的事件数量
 	int event_index;			// 事件循环中的事件编号
-	struct socket_object_interface soi;	// 发送对象接口方法结构，包括 buffer size free 三个方法指针
-	struct event ev[MAX_EVENT];		// 事件循环的事件缓冲区
-	struct socket slot[MAX_SOCKET];		// socket仓库
+	struct cmd_queue queue;			// 待取出的控制指令
+	uint8_t *batch;				// 已取出，正在执行的一批控制指令
+	int batch_cap;
+	int batch_size;
+	int batch_offset;			// 下一条要执行的指令位置
+	struct socket_server_stat stat;		// 写和accept统计，只在本事件循环的socket线程中修改
+	struct read_pool read_pool[READ_BUFFER_CLASS];	// 按大小等级预分配的读缓冲区
+	uint32_t read_refill;			// 取用过的大小等级(位)，等待事件前补足
+	struct event *ev;			// 事件循环的事件缓冲区，max_event 个
 	char buffer[MAX_INFO];
 	uint8_t udpbuffer[MAX_UDP_PACKAGE];
-	fd_set rfds;				// 可读文件描述符集
+	uint8_t *udpbatch;			// recvmmsg 的接收缓冲区，udp_batch 个 MAX_UDP_PACKAGE，用到时才分配
+	uint64_t now;				// 最后一次 sp_wait 返回的时间，毫秒，用于记录 socket 的最后活动时间
+	int accept_n;				// 当前监听事件已经 accept 的连接数，不超过 ACCEPT_BUDGET
+	int coalesce_n;				// 当前批次中有合并数据的服务数
+	struct coalesce_buffer coalesce[MAX_COALESCE];
+	int deferred_type;			// 为了保证同一个服务的消息顺序而推迟返回的消息，-1 表示没有
+	struct socket_message deferred;
+	struct broadcast_list *broadcast;	// 处理到一半的广播指令
+};
+
+// 套接字服务器实体
+struct socket_server {
+	int thread;				// 事件循环(socket线程)数量
+	int reuseport;				// 监听套接字是否设置 SO_REUSEPORT
+	int direct;				// 是否允许工作线程直接写入套接字
+	int readall;				// 读满缓冲区后是否继续读，直到 EAGAIN
+	int udp_batch;				// udp 一次收发的最大数据报个数，不大于1时逐个收发
+	uint64_t direct_syscall;		// 工作线程直接写入的 write 次数
+	uint64_t direct_bytes;			// 工作线程直接写入的字节数
+	struct socket_poller *poller;		// 事件循环数组
+	struct socket_object_interface soi;	// 发送对象接口方法结构，包括 buffer size free 三个方法指针
+	// socket仓库，按页分配，用到时才分配新的一页，最多 max_socket 个
+	// id 的低 socket_p 位为仓库索引，高位为版本号，仓库位置每复用一次版本号加一，所以不同的id不会落到同一个位置上
+	int max_socket;				// 仓库容量，2的幂
+	int socket_p;				// log2(max_socket)
+	int max_event;				// 事件循环一次最多取出的事件数
+	struct spinlock slot_lock;		// 保护空闲链表和分页分配
+	int free_head;				// 空闲链表头，先进先出，关闭的socket位置尽量晚复用
+	int free_tail;				// 空闲链表尾
+	int page_n;				// 已分配的页数
+	struct socket **slot_page;		// 仓库页，max_socket / SLOT_PAGE_SIZE 个
+	struct socket invalid;			// 所在页还未分配的id，查询到这个无效socket
 };
 
 struct request_open {
@@ -112,12 +236,32 @@ struct request_open {
 	char host[1];
 };
 
+// 连接 unix 套接字，地址在调用者线程中解析好
+struct request_open_unix {
+	int id;
+	int len;		// 地址长度
+	uintptr_t opaque;
+	struct sockaddr_un addr;
+};
+
 struct request_send {
 	int id;
 	int sz;
 	char * buffer;
 };
 
+// 广播，list 中是同一个socket线程负责的目标
+struct request_broadcast {
+	struct broadcast_list *list;
+};
+
+struct request_sendfile {
+	int id;
+	int fd;
+	int sz;
+	int64_t offset;
+};
+
 struct request_send_udp {
 	struct request_send send;
 	uint8_t address[UDP_ADDRESS_SIZE];
@@ -158,6 +302,19 @@ struct request_setopt {
 	int value;
 };
 
+struct request_frame {
+	int id;
+	int header;
+	int max;
+};
+
+struct request_watermark {
+	int id;
+	int64_t high;
+	int64_t low;
+	int64_t limit;
+};
+
 struct request_udp {
 	int id;
 	int fd;
@@ -175,9 +332,13 @@ struct request_udp {
 	O Connect to (Open)
 	X Exit
 	D Send package (high)
+	W Remainder of a direct write from worker thread
+	R Broadcast a shared buffer to a list of sockets
+	F Send file (high)
 	P Send package (low)
 	A Send UDP package
 	T Set opt
+	M Set send buffer watermark
 	U Create UDP socket
 	C set udp address
  */
@@ -189,13 +350,18 @@ struct request_package {
 	union {
 		char buffer[256];
 		struct request_open open;
+		struct request_open_unix open_unix;
 		struct request_send send;
+		struct request_sendfile sendfile;
+		struct request_broadcast broadcast;
 		struct request_send_udp send_udp;
 		struct request_close close;
 		struct request_listen listen;
 		struct request_bind bind;
 		struct request_start start;
 		struct request_setopt setopt;
+		struct request_frame frame;
+		struct request_watermark watermark;
 		struct request_udp udp;
 		struct request_setudp set_udp;
 	} u;
@@ -206,8 +372,54 @@ union sockaddr_all {
 	struct sockaddr s;
 	struct sockaddr_in v4;
 	struct sockaddr_in6 v6;
+	struct sockaddr_un un;
 };
 
+// 地址以 "unix:" 开头时使用 AF_UNIX 流式套接字，同一台机器上的连接不经过 TCP 协议栈
+#define UNIX_PREFIX "unix:"
+
+// 返回 unix 套接字路径，不是 unix 地址时返回 NULL
+static const char *
+unix_path(const char *host) {
+	if (host && strncmp(host, UNIX_PREFIX, sizeof(UNIX_PREFIX)-1) == 0) {
+		return host + sizeof(UNIX_PREFIX)-1;
+	}
+	return NULL;
+}
+
+// 填充 sockaddr_un，返回地址长度，路径为空或过长时返回 -1
+// linux 上以 '@' 开头的路径属于抽象命名空间，不会在文件系统中创建文件
+static int
+unix_address(const char *path, struct sockaddr_un *addr) {
+	size_t len = strlen(path);
+	if (len == 0 || len >= sizeof(addr->sun_path)) {
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path, path, len);
+#ifdef __linux__
+	if (path[0] == '@') {
+		addr->sun_path[0] = '\0';
+		return offsetof(struct sockaddr_un, sun_path) + len;
+	}
+#endif
+	return offsetof(struct sockaddr_un, sun_path) + len + 1;
+}
+
+// 把 unix 地址格式化为 unix:path ，未命名的一端(connect 的客户端)只有 unix:
+static void
+unix_name(const struct sockaddr_un *addr, socklen_t len, char *buffer, size_t sz) {
+	int n = (int)len - (int)offsetof(struct sockaddr_un, sun_path);
+	if (n <= 0) {
+		snprintf(buffer, sz, "%s", UNIX_PREFIX);
+	} else if (addr->sun_path[0] == '\0') {
+		snprintf(buffer, sz, "%s@%.*s", UNIX_PREFIX, n - 1, addr->sun_path + 1);
+	} else {
+		snprintf(buffer, sz, "%s%.*s", UNIX_PREFIX, n, addr->sun_path);
+	}
+}
+
 // 发送对象结构，socket_object_interface 对应初始化
 struct send_object {
 	void * buffer;
@@ -218,6 +430,51 @@ struct send_object {
 #define MALLOC skynet_malloc
 #define FREE skynet_free
 
+// 广播的共享数据，每个目标持有一个引用，最后一个引用释放时释放数据
+// 目标可能属于不同的socket线程，引用计数需要原子操作
+struct socket_broadcast {
+	int ref;
+	void * object;				// 原始数据，释放时交给 so.free_func
+	struct send_object so;
+};
+
+// 一个socket线程负责的广播目标
+struct broadcast_list {
+	struct socket_broadcast *b;
+	int n;
+	int index;		// 下一个要处理的目标，中途返回消息后从这里继续
+	int *id;
+};
+
+// socket id 所属的事件循环
+static inline struct socket_poller *
+poller_of(struct socket_server *ss, int id) {
+	return &ss->poller[(unsigned)id % ss->thread];
+}
+
+// 单调时间，毫秒
+static uint64_t
+monotonic_ms() {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * 1000 + ti.tv_nsec / 1000000;
+}
+
+// 统计一次读入
+static inline void
+stat_recv(struct socket_poller *p, struct socket *s, int n) {
+	s->recv_bytes += n;
+	++s->recv_packets;
+	s->last_active = p->now;
+}
+
+// 统计一次写出
+static inline void
+stat_send(struct socket_poller *p, struct socket *s, int n) {
+	s->send_bytes += n;
+	s->last_active = p->now;
+}
+
 // 发送对象初始化
 static inline bool
 send_object_init(struct socket_server *ss, struct send_object *so, void *object, int sz) {
@@ -234,10 +491,22 @@ send_object_init(struct socket_server *ss, struct send_object *so, void *object,
 	}
 }
 
+static void
+broadcast_release(struct socket_broadcast *b) {
+	if (ATOM_DEC(&b->ref) == 0) {
+		b->so.free_func(b->object);
+		FREE(b);
+	}
+}
+
 // 释放写缓冲区
 static inline void
 write_buffer_free(struct socket_server *ss, struct write_buffer *wb) {
-	if (wb->userobject) {
+	if (wb->file_fd >= 0) {
+		close(wb->file_fd);
+	} else if (wb->broadcast) {
+		broadcast_release(wb->buffer);
+	} else if (wb->userobject) {
 		ss->soi.free(wb->buffer);
 	} else {
 		FREE(wb->buffer);
@@ -252,33 +521,101 @@ socket_keepalive(int fd) {
 	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));  
 }
 
-// 递增分配id进行hash，并返回匹配的socket
+// 查找id对应的socket，调用者需要检查 s->id == id 以及 s->type
+static inline struct socket *
+get_socket(struct socket_server *ss, int id) {
+	unsigned index = (unsigned)id & (ss->max_socket - 1);
+	struct socket *page = ss->slot_page[index >> SLOT_PAGE_P];
+	if (page == NULL) {
+		return &ss->invalid;
+	}
+	return &page[index & (SLOT_PAGE_SIZE - 1)];
+}
+
+static inline void
+clear_wb_list(struct wb_list *list);
+
+// 分配新的一页socket，接到空闲链表尾部，仓库已满时返回0
+// 需要持有 slot_lock
 static int
-reserve_id(struct socket_server *ss) {
+alloc_slot_page(struct socket_server *ss) {
+	if (ss->page_n >= (ss->max_socket >> SLOT_PAGE_P)) {
+		return 0;
+	}
+	struct socket *page = MALLOC(SLOT_PAGE_SIZE * sizeof(*page));
+	int base = ss->page_n << SLOT_PAGE_P;
 	int i;
-	for (i=0;i<MAX_SOCKET;i++) {
-		// 递增
-		int id = ATOM_INC(&(ss->alloc_id));
-		if (id < 0) {
-			// 回绕
-			id = ATOM_AND(&(ss->alloc_id), 0x7fffffff);
-		}
-		// 哈希匹配
-		struct socket *s = &ss->slot[HASH_ID(id)];
-		if (s->type == SOCKET_TYPE_INVALID) {
-			// 如果是初始类型，修改为保留类型
-			if (ATOM_CAS(&s->type, SOCKET_TYPE_INVALID, SOCKET_TYPE_RESERVE)) {
-				s->id = id;
-				s->fd = -1;
-				return id;
-			} else {
-				// 否则，重试
-				// retry
-				--i;
-			}
-		}
+	for (i=0;i<SLOT_PAGE_SIZE;i++) {
+		struct socket *s = &page[i];
+		s->type = SOCKET_TYPE_INVALID;
+		s->id = base + i;	// 版本号为0
+		clear_wb_list(&s->high);
+		clear_wb_list(&s->low);
+		spinlock_init(&s->dw_lock);
+		s->sending = 0;
+		s->dw_buffer = NULL;
+		s->dw_held = false;
+		s->next_free = (i+1 < SLOT_PAGE_SIZE) ? base + i + 1 : -1;
+	}
+	// 初始化完成之后其他线程才能看到这一页
+	__sync_synchronize();
+	ss->slot_page[ss->page_n++] = page;
+	if (ss->free_tail < 0) {
+		ss->free_head = base;
+	} else {
+		get_socket(ss, ss->free_tail)->next_free = base;
 	}
-	return -1;
+	ss->free_tail = base + SLOT_PAGE_SIZE - 1;
+	return 1;
+}
+
+// 从空闲链表头取出一个socket，修改为保留类型，返回新的id
+static int
+reserve_id(struct socket_server *ss) {
+	spinlock_lock(&ss->slot_lock);
+	if (ss->free_head < 0 && !alloc_slot_page(ss)) {
+		spinlock_unlock(&ss->slot_lock);
+		return -1;
+	}
+	int index = ss->free_head;
+	struct socket *s = get_socket(ss, index);
+	ss->free_head = s->next_free;
+	if (ss->free_head < 0) {
+		ss->free_tail = -1;
+	}
+	assert(s->type == SOCKET_TYPE_INVALID);
+	// 版本号加一，回绕时跳过0，id 始终为正数
+	int version = (int)((unsigned)s->id >> ss->socket_p) + 1;
+	if (version >= (1 << (31 - ss->socket_p))) {
+		version = 1;
+	}
+	int id = (version << ss->socket_p) | index;
+	s->id = id;
+	s->fd = -1;
+	s->type = SOCKET_TYPE_RESERVE;
+	spinlock_unlock(&ss->slot_lock);
+	return id;
+}
+
+// 修改为初始类型，放回空闲链表尾部
+static void
+free_slot(struct socket_server *ss, struct socket *s) {
+	if (s == &ss->invalid) {
+		return;
+	}
+	int index = s->id & (ss->max_socket - 1);
+	spinlock_lock(&ss->slot_lock);
+	// 同一个 socket 只能释放一次
+	assert(s->type != SOCKET_TYPE_INVALID);
+	s->type = SOCKET_TYPE_INVALID;
+	s->next_free = -1;
+	if (ss->free_tail < 0) {
+		ss->free_head = index;
+	} else {
+		get_socket(ss, ss->free_tail)->next_free = index;
+	}
+	ss->free_tail = index;
+	spinlock_unlock(&ss->slot_lock);
 }
 
 // 清理写缓冲区链表
@@ -288,22 +625,66 @@ clear_wb_list(struct wb_list *list) {
 	list->tail = NULL;
 }
 
-// 创建socket_server                                                                                                                                                                       
-struct socket_server * 
-socket_server_create() {
+static void
+poller_release(struct socket_poller *p) {
+	close(p->sendctrl_fd);
+	close(p->recvctrl_fd);
+	sp_release(p->event_fd);
+	SPIN_DESTROY(&p->queue)
+	FREE(p->queue.buffer);
+	FREE(p->batch);
 	int i;
+	for (i=0;i<READ_BUFFER_CLASS;i++) {
+		struct read_pool *rp = &p->read_pool[i];
+		while (rp->n > 0) {
+			FREE(rp->buffer[--rp->n]);
+		}
+	}
+	FREE(p->udpbatch);
+	for (i=p->event_index;i<p->event_n;i++) {
+		// io_uring 读到还没有处理的数据
+		if (p->ev[i].done) {
+			FREE(p->ev[i].buffer);
+		}
+	}
+	FREE(p->ev);
+	if (p->broadcast) {
+		struct broadcast_list *list = p->broadcast;
+		while (list->index < list->n) {
+			++list->index;
+			broadcast_release(list->b);
+		}
+		FREE(list);
+	}
+	for (i=0;i<p->coalesce_n;i++) {
+		struct coalesce_buffer *cb = &p->coalesce[i];
+		if (cb->ev) {
+			int j;
+			for (j=0;j<cb->n;j++) {
+				FREE(cb->ev[j].data);
+			}
+			FREE(cb->ev);
+		} else {
+			FREE(cb->first.data);
+		}
+	}
+}
+
+// 初始化一个事件循环
+static int
+poller_init(struct socket_poller *p, int max_event) {
 	int fd[2];
 	// 创建事件循环句柄 epoll/kqueue
 	poll_fd efd = sp_create();
 	if (sp_invalid(efd)) {
 		fprintf(stderr, "socket-server: create event pool failed.\n");
-		return NULL;
+		return 1;
 	}
-	// 创建管道，这里用于进程内读写指令
+	// 创建管道，控制指令写入队列后，用它唤醒事件循环
 	if (pipe(fd)) {
 		sp_release(efd);
 		fprintf(stderr, "socket-server: create socket pair failed.\n");
-		return NULL;
+		return 1;
 	}
 	// 把管道的读端加入事件循环
 	if (sp_add(efd, fd[0], NULL)) {
@@ -312,36 +693,106 @@ socket_server_create() {
 		close(fd[0]);
 		close(fd[1]);
 		sp_release(efd);
-		return NULL;
+		return 1;
+	}
+	sp_nonblocking(fd[0]);
+	sp_nonblocking(fd[1]);
+	p->event_fd = efd;
+	p->recvctrl_fd = fd[0];
+	p->sendctrl_fd = fd[1];
+	p->checkctrl = 1;
+	p->event_n = 0;
+	p->event_index = 0;
+	SPIN_INIT(&p->queue)
+	p->queue.signaled = 0;
+	p->queue.size = 0;
+	p->queue.cap = MIN_CMD_QUEUE;
+	p->queue.buffer = MALLOC(MIN_CMD_QUEUE);
+	p->batch_cap = MIN_CMD_QUEUE;
+	p->batch = MALLOC(MIN_CMD_QUEUE);
+	p->batch_size = 0;
+	p->batch_offset = 0;
+	memset(&p->stat, 0, sizeof(p->stat));
+	memset(p->read_pool, 0, sizeof(p->read_pool));
+	p->read_refill = 0;
+	p->udpbatch = NULL;
+	p->now = monotonic_ms();
+	p->accept_n = 0;
+	p->coalesce_n = 0;
+	memset(p->coalesce, 0, sizeof(p->coalesce));
+	p->deferred_type = -1;
+	p->broadcast = NULL;
+	p->ev = MALLOC(max_event * sizeof(struct event));
+	return 0;
+}
+
+// 创建socket_server，thread 为事件循环(socket线程)的数量
+// max_socket 为socket仓库的容量，向上取整为2的幂
+// max_event 为事件循环一次最多取出的事件数
+struct socket_server * 
+socket_server_create_ex(int thread, int max_socket, int max_event) {
+	int i;
+	if (thread < 1) {
+		thread = 1;
+	}
+	if (max_event <= 0) {
+		max_event = DEFAULT_MAX_EVENT;
+	}
+	if (max_socket <= 0) {
+		max_socket = DEFAULT_MAX_SOCKET;
+	}
+	int socket_p = SLOT_PAGE_P;
+	while ((1 << socket_p) < max_socket && socket_p < MAX_SOCKET_P) {
+		++socket_p;
+	}
+	struct socket_poller *poller = MALLOC(thread * sizeof(*poller));
+	for (i=0;i<thread;i++) {
+		if (poller_init(&poller[i], max_event)) {
+			while (--i >= 0) {
+				poller_release(&poller[i]);
+			}
+			FREE(poller);
+			return NULL;
+		}
 	}
 
 	// 创建并初始化socket_server
 	struct socket_server *ss = MALLOC(sizeof(*ss));
-	ss->event_fd = efd;
-	ss->recvctrl_fd = fd[0];
-	ss->sendctrl_fd = fd[1];
-	ss->checkctrl = 1;
-
-	for (i=0;i<MAX_SOCKET;i++) {
-		struct socket *s = &ss->slot[i];
-		s->type = SOCKET_TYPE_INVALID;
-		clear_wb_list(&s->high);
-		clear_wb_list(&s->low);
-	}
-	ss->alloc_id = 0;
-	ss->event_n = 0;
-	ss->event_index = 0;
+	ss->thread = thread;
+	ss->reuseport = 0;
+	ss->direct = 0;
+	ss->readall = 0;
+	ss->udp_batch = 0;
+	ss->direct_syscall = 0;
+	ss->direct_bytes = 0;
+	ss->poller = poller;
+	ss->max_socket = 1 << socket_p;
+	ss->socket_p = socket_p;
+	ss->max_event = max_event;
+	spinlock_init(&ss->slot_lock);
+	ss->free_head = -1;
+	ss->free_tail = -1;
+	ss->page_n = 0;
+	int page_n = ss->max_socket >> SLOT_PAGE_P;
+	ss->slot_page = MALLOC(page_n * sizeof(struct socket *));
+	for (i=0;i<page_n;i++) {
+		ss->slot_page[i] = NULL;
+	}
+	memset(&ss->invalid, 0, sizeof(ss->invalid));
+	ss->invalid.type = SOCKET_TYPE_INVALID;
+	ss->invalid.id = -1;
+	spinlock_init(&ss->invalid.dw_lock);
 	memset(&ss->soi, 0, sizeof(ss->soi));
-	// 清空可读文件描述符集，为select做准备
-	FD_ZERO(&ss->rfds);
-	// 判断管道读套接字描述符小于系统描述符集大小常量，一般为1024
-	// has_cmd中会调用FD_SET把管道读套接字加入可读文件描述符集管理
-	// 提前判断避免FD_SET执行错误
-	assert(ss->recvctrl_fd < FD_SETSIZE);
 
 	return ss;
 }
 
+// 使用默认配置创建socket_server：一个事件循环，默认的socket容量和事件数
+struct socket_server * 
+socket_server_create() {
+	return socket_server_create_ex(1, 0, 0);
+}
+
 // 清空写缓冲区，并释放内存空间
 static void
 free_wb_list(struct socket_server *ss, struct wb_list *list) {
@@ -373,31 +824,54 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_message *r
 	free_wb_list(ss,&s->low);
 	if (s->type != SOCKET_TYPE_PACCEPT && s->type != SOCKET_TYPE_PLISTEN) {
 		// 已加入事件循环管理的套接字，从事件循环管理中移除
-		sp_del(ss->event_fd, s->fd);
+		sp_del(poller_of(ss, s->id)->event_fd, s->fd);
 	}
+	// 工作线程可能正在直接写入，加锁后再关闭fd (发送时出错的话socket线程已经持有锁)
+	bool held = s->dw_held;
+	if (!held) {
+		spinlock_lock(&s->dw_lock);
+	}
+	if (s->dw_buffer) {
+		write_buffer_free(ss, s->dw_buffer);
+		s->dw_buffer = NULL;
+	}
+	FREE(s->frame_buffer);
+	s->frame_buffer = NULL;
+	s->frame_cap = 0;
 	if (s->type != SOCKET_TYPE_BIND) {
 		// 如果是正常socket套接字，执行close关闭套接字
 		if (close(s->fd) < 0) {
 			perror("close socket:");
 		}
 	}
-	// 修改套接字为初始类型
-	s->type = SOCKET_TYPE_INVALID;
+	// 修改套接字为初始类型，放回空闲链表
+	free_slot(ss, s);
+	if (!held) {
+		spinlock_unlock(&s->dw_lock);
+	}
 }
 
 void 
 socket_server_release(struct socket_server *ss) {
-	int i;
+	int i,j;
 	struct socket_message dummy;
-	for (i=0;i<MAX_SOCKET;i++) {
-		struct socket *s = &ss->slot[i];
-		if (s->type != SOCKET_TYPE_RESERVE) {
-			force_close(ss, s , &dummy);
+	for (i=0;i<ss->page_n;i++) {
+		struct socket *page = ss->slot_page[i];
+		for (j=0;j<SLOT_PAGE_SIZE;j++) {
+			struct socket *s = &page[j];
+			if (s->type != SOCKET_TYPE_RESERVE) {
+				force_close(ss, s , &dummy);
+			}
 		}
 	}
-	close(ss->sendctrl_fd);
-	close(ss->recvctrl_fd);
-	sp_release(ss->event_fd);
+	for (i=0;i<ss->page_n;i++) {
+		FREE(ss->slot_page[i]);
+	}
+	FREE(ss->slot_page);
+	for (i=0;i<ss->thread;i++) {
+		poller_release(&ss->poller[i]);
+	}
+	FREE(ss->poller);
 	FREE(ss);
 }
 
@@ -408,20 +882,19 @@ check_wb_list(struct wb_list *s) {
 }
 
 // 创建新的socket实例
-// id，通过reserve_id分配的alloc_id
+// id，通过reserve_id分配的id
 // fd, 通过socket创建的套接字
 // add, true则加入事件循环
 static struct socket *
 new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque, bool add) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	// 正常情况下，socket已在reserve_id中赋值为保留类型
 	assert(s->type == SOCKET_TYPE_RESERVE);
 
 	if (add) {
 		// 加入事件循环
-		if (sp_add(ss->event_fd, fd, s)) {
-			// 如果加入失败，socket重置为初始类型	
-			s->type = SOCKET_TYPE_INVALID;
+		if (sp_add(poller_of(ss, id)->event_fd, fd, s)) {
+			// 如果加入失败，由调用者释放 socket
 			return NULL;
 		}
 	}
@@ -433,11 +906,89 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	s->p.size = MIN_READ_BUFFER;
 	s->opaque = opaque;
 	s->wb_size = 0;
+	s->high_watermark = DEFAULT_HIGH_WATERMARK;
+	s->low_watermark = 0;
+	s->limit = 0;
+	s->paused = false;
+	s->recv_bytes = 0;
+	s->recv_packets = 0;
+	s->send_bytes = 0;
+	s->send_packets = 0;
+	s->dw_bytes = 0;
+	s->dw_packets = 0;
+	s->last_active = poller_of(ss, id)->now;
+	s->coalesce = false;
+	s->frame = 0;
+	s->frame_header_n = 0;
+	s->frame_size = -1;
+	s->frame_read = 0;
+	s->frame_cap = 0;
+	s->frame_max = DEFAULT_FRAME_SIZE;
+	s->frame_buffer = NULL;
 	check_wb_list(&s->high);
 	check_wb_list(&s->low);
 	return s;
 }
 
+// io_uring 事件循环中，监听套接字改用内核的多次 accept，tcp 连接改用多次 recv 到 buffer ring
+// 内核不支持时继续使用 poll，读写逻辑不变
+static inline void
+uring_accept(struct socket_server *ss, struct socket *s) {
+#ifdef SP_URING
+	poll_fd efd = poller_of(ss, s->id)->event_fd;
+	if (uring_is(efd)) {
+		sp_accept_uring(efd, s->fd);
+	}
+#endif
+}
+
+static inline void
+uring_recv(struct socket_server *ss, struct socket *s) {
+#ifdef SP_URING
+	poll_fd efd = poller_of(ss, s->id)->event_fd;
+	if (uring_is(efd)) {
+		sp_recv_uring(efd, s->fd);
+	}
+#endif
+}
+
+// 连接 unix 套接字，本机连接要么立即完成，要么失败(对端 backlog 已满时为 EAGAIN)，不会有连接中的状态
+static int
+open_unix_socket(struct socket_server *ss, struct request_open_unix * request, struct socket_message *result) {
+	int id = request->id;
+	result->opaque = request->opaque;
+	result->id = id;
+	result->ud = 0;
+	result->data = NULL;
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		result->data = strerror(errno);
+		goto _failed;
+	}
+	sp_nonblocking(sock);
+	if (connect(sock, (struct sockaddr *)&request->addr, request->len) != 0) {
+		result->data = strerror(errno);
+		close(sock);
+		goto _failed;
+	}
+	// 流式套接字，读写和 tcp 完全相同
+	struct socket *ns = new_fd(ss, id, sock, PROTOCOL_TCP, request->opaque, true);
+	if (ns == NULL) {
+		close(sock);
+		result->data = "reach skynet socket number limit";
+		goto _failed;
+	}
+	ns->type = SOCKET_TYPE_CONNECTED;
+	uring_recv(ss, ns);
+	char * buffer = poller_of(ss, id)->buffer;
+	unix_name(&request->addr, request->len, buffer, MAX_INFO);
+	result->data = buffer;
+	return SOCKET_OPEN;
+_failed:
+	free_slot(ss, get_socket(ss, id));
+	return SOCKET_ERROR;
+}
+
 // return -1 when connecting
 // 打开套接字
 // 正常返回 SOCKET_OPEN
@@ -506,11 +1057,13 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 	if(status == 0) {
 		// socket修改为已连接类型
 		ns->type = SOCKET_TYPE_CONNECTED;
+		uring_recv(ss, ns);
 		struct sockaddr * addr = ai_ptr->ai_addr;
  		// 区分ipv4和ipv6，ip地址放入result->data
 		void * sin_addr = (ai_ptr->ai_family == AF_INET) ? (void*)&((struct sockaddr_in *)addr)->sin_addr : (void*)&((struct sockaddr_in6 *)addr)->sin6_addr;
-		if (inet_ntop(ai_ptr->ai_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
-			result->data = ss->buffer;
+		char * buffer = poller_of(ss, id)->buffer;
+		if (inet_ntop(ai_ptr->ai_family, sin_addr, buffer, MAX_INFO)) {
+			result->data = buffer;
 		}
 		freeaddrinfo( ai_list );
 		return SOCKET_OPEN;
@@ -518,54 +1071,131 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 		// socket修改为连接中类型，在socket_server_poll方法中调用report_connect方法修改为SOCKET_TYPE_CONNECTED，并返回SOCKET_OPEN
 		ns->type = SOCKET_TYPE_CONNECTING;
 		// 打开事件循环中fd的可写权限
-		sp_write(ss->event_fd, ns->fd, ns, true);
+		sp_write(poller_of(ss, id)->event_fd, ns->fd, ns, true);
 	}
 
 	freeaddrinfo( ai_list );
 	return -1;
 _failed:
 	freeaddrinfo( ai_list );
-	ss->slot[HASH_ID(id)].type = SOCKET_TYPE_INVALID;
+	free_slot(ss, get_socket(ss, id));
 	return SOCKET_ERROR;
 }
 
+// 用 sendfile 发送链表头部的文件，文件发送完时释放并返回 0
+// 内核缓冲区已满时返回 -1，出错关闭时返回 SOCKET_CLOSE
+static int
+send_file(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
+	struct socket_server_stat *stat = &poller_of(ss, s->id)->stat;
+	struct write_buffer *tmp = list->head;
+	while (tmp->sz > 0) {
+#ifdef __linux__
+		off_t offset = (off_t)tmp->offset;
+		ssize_t sz = sendfile(s->fd, tmp->file_fd, &offset, tmp->sz);
+#else
+		char buffer[65536];
+		ssize_t sz = pread(tmp->file_fd, buffer, tmp->sz < (int)sizeof(buffer) ? tmp->sz : (int)sizeof(buffer), (off_t)tmp->offset);
+		if (sz > 0) {
+			sz = write(s->fd, buffer, sz);
+		}
+#endif
+		if (sz < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			fprintf(stderr, "socket-server: sendfile to %d (fd=%d) error :%s.\n",s->id,s->fd,strerror(errno));
+			force_close(ss,s, result);
+			return SOCKET_CLOSE;
+		}
+		if (sz == 0) {
+			// 文件比请求的长度短，丢弃剩余部分
+			fprintf(stderr, "socket-server: sendfile to %d (fd=%d) reach the end of file, %d bytes left.\n",s->id,s->fd,tmp->sz);
+			s->wb_size -= tmp->sz;
+			break;
+		}
+		++stat->write_syscall;
+		stat->write_bytes += sz;
+		stat_send(poller_of(ss, s->id), s, sz);
+		s->wb_size -= sz;
+		tmp->offset += sz;
+		tmp->sz -= sz;
+	}
+	list->head = tmp->next;
+	if (list->head == NULL) {
+		list->tail = NULL;
+	}
+	write_buffer_free(ss, tmp);
+	return 0;
+}
+
 // 发送tcp数据
+// 每次用 writev 把链表中最多 MAX_IOV 个缓冲区合并写入
 // 正常返回 -1
 // 失败返回 SOCKET_CLOSE
 static int
 send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
+	struct socket_server_stat *stat = &poller_of(ss, s->id)->stat;
 	while (list->head) {
-		struct write_buffer * tmp = list->head;
-		for (;;) {
-			// 往套接字写入数据
-			int sz = write(s->fd, tmp->ptr, tmp->sz);
-			if (sz < 0) {
-				switch(errno) {
-				case EINTR:
-					// 信用中断，循环等待
-					continue;
-				case AGAIN_WOULDBLOCK:
-					// 写缓冲区满，直接返回
-					return -1;
-				}
-				// 关闭socket
-				force_close(ss,s, result);
-				return SOCKET_CLOSE;
+		if (list->head->file_fd >= 0) {
+			// 文件用 sendfile 发送，之前的内存数据已经发送完
+			int r = send_file(ss, s, list, result);
+			if (r != 0) {
+				return r;
 			}
-			s->wb_size -= sz;
-			if (sz != tmp->sz) {
-				// 如果缓冲区数据没有发送完，直接返回-1
-				// tmp缓冲区仍然在缓冲区链表中，等待下一次发送
-				tmp->ptr += sz;
-				tmp->sz -= sz;
+			continue;
+		}
+		struct iovec iov[MAX_IOV];
+		struct write_buffer * tmp;
+		int n = 0;
+		size_t total = 0;
+		// 遇到文件时停止合并，保证发送顺序
+		for (tmp = list->head; tmp && tmp->file_fd < 0 && n < MAX_IOV; tmp = tmp->next) {
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			total += tmp->sz;
+			++n;
+		}
+		// 往套接字写入数据
+		ssize_t sz = writev(s->fd, iov, n);
+		if (sz < 0) {
+			switch(errno) {
+			case EINTR:
+				// 信号中断，重试
+				continue;
+			case AGAIN_WOULDBLOCK:
+				// 写缓冲区满，直接返回
 				return -1;
 			}
-			break;
+			// 关闭socket
+			force_close(ss,s, result);
+			return SOCKET_CLOSE;
+		}
+		++stat->write_syscall;
+		stat->write_bytes += sz;
+		stat_send(poller_of(ss, s->id), s, sz);
+		s->wb_size -= sz;
+		size_t written = sz;
+		// 释放已经发送完的缓冲区(包括长度为0的缓冲区，否则只剩它们时会一直循环)
+		while ((tmp = list->head) != NULL && tmp->file_fd < 0 && (size_t)sz >= tmp->sz) {
+			sz -= tmp->sz;
+			// head指针偏移到tmp下一个缓冲区
+			list->head = tmp->next;
+			// 释放tmp缓冲区
+			write_buffer_free(ss,tmp);
+		}
+		if (sz > 0) {
+			// 没有发送完的缓冲区偏移指针，等待下一次发送
+			tmp->ptr += sz;
+			tmp->sz -= sz;
+			return -1;
+		}
+		if (written < total) {
+			// 内核缓冲区已满，等待可写事件
+			return -1;
 		}
-		// head指针偏移到tmp下一个缓冲区
-		list->head = tmp->next;
-		// 释放tmp缓冲区
-		write_buffer_free(ss,tmp);
 	}
 	list->tail = NULL;
 
@@ -622,6 +1252,7 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 */
 		}
 
+		stat_send(poller_of(ss, s->id), s, tmp->sz);
 		s->wb_size -= tmp->sz;
 		list->head = tmp->next;
 		write_buffer_free(ss,tmp);
@@ -631,14 +1262,67 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 	return -1;
 }
 
+#ifdef USE_MMSG
+// 用 sendmmsg 一次发送链表中最多 udp_batch 个数据报
+static int
+send_list_udp_batch(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
+	while (list->head) {
+		struct mmsghdr msg[MAX_UDP_BATCH];
+		struct iovec iov[MAX_UDP_BATCH];
+		union sockaddr_all sa[MAX_UDP_BATCH];
+		struct write_buffer * tmp;
+		int n = 0;
+		for (tmp = list->head; tmp && n < ss->udp_batch; tmp = tmp->next) {
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			memset(&msg[n].msg_hdr, 0, sizeof(msg[n].msg_hdr));
+			msg[n].msg_hdr.msg_name = &sa[n];
+			msg[n].msg_hdr.msg_namelen = udp_socket_address(s, tmp->udp_address, &sa[n]);
+			msg[n].msg_hdr.msg_iov = &iov[n];
+			msg[n].msg_hdr.msg_iovlen = 1;
+			++n;
+		}
+		int m = sendmmsg(s->fd, msg, n, 0);
+		if (m < 0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			fprintf(stderr, "socket-server : udp (%d) sendmmsg error %s.\n",s->id, strerror(errno));
+			return -1;
+		}
+		int i;
+		for (i=0;i<m;i++) {
+			tmp = list->head;
+			stat_send(poller_of(ss, s->id), s, tmp->sz);
+			s->wb_size -= tmp->sz;
+			list->head = tmp->next;
+			write_buffer_free(ss,tmp);
+		}
+		if (m < n) {
+			// 内核缓冲区已满，等待可写事件
+			return -1;
+		}
+	}
+	list->tail = NULL;
+
+	return -1;
+}
+#endif
+
 // 发送链表缓冲区数据
 static int
 send_list(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
 	if (s->protocol == PROTOCOL_TCP) {
 		return send_list_tcp(ss, s, list, result);
-	} else {
-		return send_list_udp(ss, s, list, result);
 	}
+#ifdef USE_MMSG
+	if (ss->udp_batch > 1) {
+		return send_list_udp_batch(ss, s, list, result);
+	}
+#endif
+	return send_list_udp(ss, s, list, result);
 }
 
 // 返回s缓冲区是否已发送完
@@ -669,6 +1353,61 @@ raise_uncomplete(struct socket * s) {
 	high->head = high->tail = tmp;
 }
 
+// 判断高低两个链表缓冲区是否同时为空
+static inline int
+send_buffer_empty(struct socket *s) {
+	return (s->high.head == NULL && s->low.head == NULL);
+}
+
+// 直接写入模式下，socket线程写入套接字或者修改发送缓冲区之前持有 dw_lock
+// 工作线程在 dw_lock 中检查发送缓冲区为空后才写入，这样两边的写入不会交错
+static inline void
+socket_lock_write(struct socket_server *ss, struct socket *s) {
+	if (ss->direct) {
+		spinlock_lock(&s->dw_lock);
+		s->dw_held = true;
+	}
+}
+
+static inline void
+socket_unlock_write(struct socket *s) {
+	if (s->dw_held) {
+		s->dw_held = false;
+		spinlock_unlock(&s->dw_lock);
+	}
+}
+
+// 接管工作线程直接写入后剩余的数据
+// 直接写入时发送缓冲区一定为空，所以剩余部分放在高优先级链表的最前面
+static void
+take_direct_write(struct socket_server *ss, struct socket *s) {
+	if (!ss->direct) {
+		return;
+	}
+	bool held = s->dw_held;
+	if (!held) {
+		spinlock_lock(&s->dw_lock);
+	}
+	struct write_buffer *buf = s->dw_buffer;
+	if (buf) {
+		s->dw_buffer = NULL;
+		bool empty = send_buffer_empty(s);
+		buf->next = s->high.head;
+		s->high.head = buf;
+		if (s->high.tail == NULL) {
+			s->high.tail = buf;
+		}
+		s->wb_size += buf->sz;
+		if (empty) {
+			// 打开事件循环中fd的可写权限
+			sp_write(poller_of(ss, s->id)->event_fd, s->fd, s, true);
+		}
+	}
+	if (!held) {
+		spinlock_unlock(&s->dw_lock);
+	}
+}
+
 /*
 	Each socket has two write buffer list, high priority and low priority.
 
@@ -680,6 +1419,7 @@ raise_uncomplete(struct socket * s) {
 // 发送缓冲区数据
 static int
 send_buffer(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+	take_direct_write(ss, s);
 	assert(!list_uncomplete(&s->low));
 	// step 1
 	// 发送高优先级链表缓冲区
@@ -703,7 +1443,7 @@ send_buffer(struct socket_server *ss, struct socket *s, struct socket_message *r
 			// step 4
 			// 如果低优先级链表缓冲区发送完
 			// 关闭事件循环中socket句柄的可写权限
-			sp_write(ss->event_fd, s->fd, s, false);
+			sp_write(poller_of(ss, s->id)->event_fd, s->fd, s, false);
 
 			if (s->type == SOCKET_TYPE_HALFCLOSE) {
 				force_close(ss, s, result);
@@ -722,10 +1462,12 @@ append_sendbuffer_(struct socket_server *ss, struct wb_list *s, struct request_s
 	struct write_buffer * buf = MALLOC(size);
 	struct send_object so;
 	buf->userobject = send_object_init(ss, &so, request->buffer, request->sz);
+	buf->broadcast = false;
 	// 已发送n个字节，所以指针+n，大小-n
 	buf->ptr = (char*)so.buffer+n;
 	buf->sz = so.sz - n;
 	buf->buffer = request->buffer;
+	buf->file_fd = -1;
 	buf->next = NULL;
 	if (s->head == NULL) {
 		// 链表为空
@@ -761,12 +1503,6 @@ append_sendbuffer_low(struct socket_server *ss,struct socket *s, struct request_
 	s->wb_size += buf->sz;
 }
 
-// 判断高低两个链表缓冲区是否同时为空
-static inline int
-send_buffer_empty(struct socket *s) {
-	return (s->high.head == NULL && s->low.head == NULL);
-}
-
 /*
 	When send a package , we can assign the priority : PRIORITY_HIGH or PRIORITY_LOW
 
@@ -777,7 +1513,7 @@ send_buffer_empty(struct socket *s) {
 static int
 send_socket(struct socket_server *ss, struct request_send * request, struct socket_message *result, int priority, const uint8_t *udp_address) {
 	int id = request->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	struct send_object so;
 	send_object_init(ss, &so, request->buffer, request->sz);
 	if (s->type == SOCKET_TYPE_INVALID || s->id != id 
@@ -791,6 +1527,9 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 		so.free_func(request->buffer);
 		return -1;
 	}
+	++s->send_packets;
+	// 先接管直接写入的剩余数据，保证发送顺序
+	take_direct_write(ss, s);
 	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
 		// 如果已连接且发送缓冲区为空
 		if (s->protocol == PROTOCOL_TCP) {
@@ -810,6 +1549,10 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 					return SOCKET_CLOSE;
 				}
 			}
+			struct socket_server_stat *stat = &poller_of(ss, id)->stat;
+			++stat->write_syscall;
+			stat->write_bytes += n;
+			stat_send(poller_of(ss, id), s, n);
 			if (n == so.sz) {
 				// 如果全部发送完，释放数据缓冲区，返回-1
 				so.free_func(request->buffer);
@@ -828,12 +1571,13 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 			if (n != so.sz) {
 				append_sendbuffer_udp(ss,s,priority,request,udp_address);
 			} else {
+				stat_send(poller_of(ss, id), s, n);
 				so.free_func(request->buffer);
 				return -1;
 			}
 		}
 		// 打开事件循环中fd的可写权限
-		sp_write(ss->event_fd, s->fd, s, true);
+		sp_write(poller_of(ss, id)->event_fd, s->fd, s, true);
 	} else {
 		if (s->protocol == PROTOCOL_TCP) {
 			if (priority == PRIORITY_LOW) {
@@ -851,6 +1595,48 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 	return -1;
 }
 
+// 把文件加入高优先级链表，由 send_buffer 用 sendfile 发送
+static int
+sendfile_socket(struct socket_server *ss, struct request_sendfile * request, struct socket_message *result) {
+	int id = request->id;
+	struct socket * s = get_socket(ss, id);
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id
+		|| s->type == SOCKET_TYPE_HALFCLOSE
+		|| s->type == SOCKET_TYPE_PACCEPT
+		|| s->type == SOCKET_TYPE_PLISTEN
+		|| s->type == SOCKET_TYPE_LISTEN
+		|| s->protocol != PROTOCOL_TCP) {
+		close(request->fd);
+		return -1;
+	}
+	// 先接管直接写入的剩余数据，保证发送顺序
+	take_direct_write(ss, s);
+	struct write_buffer * buf = MALLOC(sizeof(*buf));
+	buf->next = NULL;
+	buf->buffer = NULL;
+	buf->ptr = NULL;
+	buf->sz = request->sz;
+	buf->userobject = false;
+	buf->broadcast = false;
+	buf->file_fd = request->fd;
+	buf->offset = request->offset;
+	bool empty = send_buffer_empty(s);
+	struct wb_list *list = &s->high;
+	if (list->head == NULL) {
+		list->head = list->tail = buf;
+	} else {
+		list->tail->next = buf;
+		list->tail = buf;
+	}
+	s->wb_size += buf->sz;
+	++s->send_packets;
+	if (empty && s->type == SOCKET_TYPE_CONNECTED) {
+		// 打开可写权限，在可写事件中发送
+		sp_write(poller_of(ss, id)->event_fd, s->fd, s, true);
+	}
+	return -1;
+}
+
 // 监听套接字
 static int
 listen_socket(struct socket_server *ss, struct request_listen * request, struct socket_message *result) {
@@ -869,7 +1655,7 @@ _failed:
 	result->id = id;
 	result->ud = 0;
 	result->data = "reach skynet socket number limit";
-	ss->slot[HASH_ID(id)].type = SOCKET_TYPE_INVALID;
+	free_slot(ss, get_socket(ss, id));
 
 	return SOCKET_ERROR;
 }
@@ -878,7 +1664,7 @@ _failed:
 static int
 close_socket(struct socket_server *ss, struct request_close *request, struct socket_message *result) {
 	int id = request->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (s->type == SOCKET_TYPE_INVALID || s->id != id) {
 		result->id = id;
 		result->opaque = request->opaque;
@@ -886,12 +1672,17 @@ close_socket(struct socket_server *ss, struct request_close *request, struct soc
 		result->data = NULL;
 		return SOCKET_CLOSE;
 	}
+	socket_lock_write(ss, s);
+	take_direct_write(ss, s);
 	if (!send_buffer_empty(s)) { 
 		// 如果发送缓冲区不为空，继续发送缓冲区数据
 		int type = send_buffer(ss,s,result);
-		if (type != -1)
+		if (type != -1) {
+			socket_unlock_write(s);
 			return type;
+		}
 	}
+	socket_unlock_write(s);
 	// 如果发送缓冲区已为空
 	if (request->shutdown || send_buffer_empty(s)) {
 		force_close(ss,s,result);
@@ -916,6 +1707,7 @@ bind_socket(struct socket_server *ss, struct request_bind *request, struct socke
 	struct socket *s = new_fd(ss, id, request->fd, PROTOCOL_TCP, request->opaque, true);
 	if (s == NULL) {
 		result->data = "reach skynet socket number limit";
+		free_slot(ss, get_socket(ss, id));
 		return SOCKET_ERROR;
 	}
 	// 套接字设置为非阻塞
@@ -934,21 +1726,27 @@ start_socket(struct socket_server *ss, struct request_start *request, struct soc
 	result->opaque = request->opaque;
 	result->ud = 0;
 	result->data = NULL;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
 		result->data = "invalid socket";
 		return SOCKET_ERROR;
 	}
 	if (s->type == SOCKET_TYPE_PACCEPT || s->type == SOCKET_TYPE_PLISTEN) {
 		// 套接字加入事件循环
-		if (sp_add(ss->event_fd, s->fd, s)) {
+		if (sp_add(poller_of(ss, id)->event_fd, s->fd, s)) {
 			force_close(ss, s, result);
 			result->data = strerror(errno);
 			return SOCKET_ERROR;
 		}
 		// SOCKET_TYPE_PACCEPT -> SOCKET_TYPE_CONNECTED
 		// SOCKET_TYPE_PLISTEN -> SOCKET_TYPE_LISTEN
-		s->type = (s->type == SOCKET_TYPE_PACCEPT) ? SOCKET_TYPE_CONNECTED : SOCKET_TYPE_LISTEN;
+		if (s->type == SOCKET_TYPE_PACCEPT) {
+			s->type = SOCKET_TYPE_CONNECTED;
+			uring_recv(ss, s);
+		} else {
+			s->type = SOCKET_TYPE_LISTEN;
+			uring_accept(ss, s);
+		}
 		s->opaque = request->opaque;
 		result->data = "start";
 		return SOCKET_OPEN;
@@ -966,7 +1764,7 @@ start_socket(struct socket_server *ss, struct request_start *request, struct soc
 static void
 setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	int id = request->id;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
 		return;
 	}
@@ -974,44 +1772,127 @@ setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	setsockopt(s->fd, IPPROTO_TCP, request->what, &v, sizeof(v));
 }
 
-// 从管道阻塞读数据
-// pipefd 管道读端
+// 设置是否合并数据消息
+static void
+setcoalesce_socket(struct socket_server *ss, struct request_setopt *request) {
+	int id = request->id;
+	struct socket *s = get_socket(ss, id);
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return;
+	}
+	s->coalesce = request->value != 0;
+}
+
+// 设置分帧模式，丢弃未完成的包
+static void
+setframe_socket(struct socket_server *ss, struct request_frame *request) {
+	int id = request->id;
+	struct socket *s = get_socket(ss, id);
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return;
+	}
+	int header = request->header;
+	s->frame = (header == 2 || header == 4) ? header : 0;
+	s->frame_max = request->max;
+	s->frame_header_n = 0;
+	s->frame_size = -1;
+	s->frame_read = 0;
+	s->frame_cap = 0;
+	FREE(s->frame_buffer);
+	s->frame_buffer = NULL;
+}
+
+// 设置发送缓冲区水位
+static void
+setwatermark_socket(struct socket_server *ss, struct request_watermark *request) {
+	int id = request->id;
+	struct socket *s = get_socket(ss, id);
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return;
+	}
+	s->high_watermark = request->high;
+	s->low_watermark = request->low;
+	s->limit = request->limit;
+}
+
+// 发送缓冲区增长后检查水位
+// 超过硬上限时关闭连接，返回 SOCKET_ERROR
+// 第一次超过高水位时返回 SOCKET_WARNING，ud 为发送缓冲区大小(K)，通知服务暂停发送
+static int
+check_high_watermark(struct socket_server *ss, int id, struct socket_message *result) {
+	struct socket *s = get_socket(ss, id);
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id) {
+		return -1;
+	}
+	if (s->limit > 0 && s->wb_size > s->limit) {
+		fprintf(stderr, "socket-server: send buffer of %d overflow (%lld bytes), close it.\n", id, (long long)s->wb_size);
+		force_close(ss, s, result);
+		result->data = "send buffer overflow";
+		return SOCKET_ERROR;
+	}
+	if (!s->paused && s->high_watermark > 0 && s->wb_size > s->high_watermark) {
+		s->paused = true;
+		result->opaque = s->opaque;
+		result->id = id;
+		result->ud = (int)(s->wb_size / 1024);
+		result->data = NULL;
+		return SOCKET_WARNING;
+	}
+	return -1;
+}
+
+// 发送缓冲区数据写出后检查水位
+// 暂停后降到低水位以下时返回 SOCKET_WARNING，ud 为 0，通知服务恢复发送
+static int
+check_low_watermark(struct socket *s, struct socket_message *result) {
+	if (s->paused && s->wb_size <= s->low_watermark) {
+		s->paused = false;
+		result->opaque = s->opaque;
+		result->id = s->id;
+		result->ud = 0;
+		result->data = NULL;
+		return SOCKET_WARNING;
+	}
+	return -1;
+}
+
+// 清空唤醒管道
 static void
-block_readpipe(int pipefd, void *buffer, int sz) {
+drain_pipe(int pipefd) {
+	char tmp[64];
 	for (;;) {
-		// 读pipe和socket的fd默认以阻塞方式
-		int n = read(pipefd, buffer, sz);
-		if (n<0) {
-			// 如果接收任何数据之前，被信号中断则继续接收
-			if (errno == EINTR)
-				continue;
-			fprintf(stderr, "socket-server : read pipe error %s.\n",strerror(errno));
+		int n = read(pipefd, tmp, sizeof(tmp));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < (int)sizeof(tmp))
 			return;
-		}
-		// must atomic read from a pipe
-		assert(n == sz);
-		return;
 	}
 }
 
-// 管道读端是否有指令读入
+// 是否还有待执行的控制指令
+// 当前批次执行完后，把队列中的指令整批交换出来
 // 有 1 无 0
 static int
-has_cmd(struct socket_server *ss) {
-	// 非阻塞：仅检测描述符集合的状态，然后立即返回，并不等待外部事件的发生
-	struct timeval tv = {0,0};
-	int retval;
-
-	// 把管道读套接字加入可读文件描述集
-	FD_SET(ss->recvctrl_fd, &ss->rfds);
-
-	// 内核等待多个事件中的任何一个发送，并只在有一个或多个事件发生或经历一段指定的时间后才唤醒
-	retval = select(ss->recvctrl_fd+1, &ss->rfds, NULL, NULL, &tv);
-	if (retval == 1) {
-		// 监测到管道读端套接字有状态变化
+has_cmd(struct socket_poller *p) {
+	if (p->batch_offset < p->batch_size) {
 		return 1;
 	}
-	return 0;
+	// 先清空管道再交换，交换之后写入的指令会重新唤醒
+	drain_pipe(p->recvctrl_fd);
+	struct cmd_queue *q = &p->queue;
+	uint8_t *buffer = p->batch;
+	int cap = p->batch_cap;
+	SPIN_LOCK(q)
+	p->batch = q->buffer;
+	p->batch_cap = q->cap;
+	p->batch_size = q->size;
+	q->buffer = buffer;
+	q->cap = cap;
+	q->size = 0;
+	q->signaled = 0;
+	SPIN_UNLOCK(q)
+	p->batch_offset = 0;
+	return p->batch_size > 0;
 }
 
 // 创建udp类型的socket实例
@@ -1027,7 +1908,7 @@ add_udp_socket(struct socket_server *ss, struct request_udp *udp) {
 	struct socket *ns = new_fd(ss, id, udp->fd, protocol, udp->opaque, true);
 	if (ns == NULL) {
 		close(udp->fd);
-		ss->slot[HASH_ID(id)].type = SOCKET_TYPE_INVALID;
+		free_slot(ss, get_socket(ss, id));
 		return;
 	}
 	// 直接设置socket为已连接类型
@@ -1038,7 +1919,7 @@ add_udp_socket(struct socket_server *ss, struct request_udp *udp) {
 static int
 set_udp_address(struct socket_server *ss, struct request_setudp *request, struct socket_message *result) {
 	int id = request->id;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
 		return -1;
 	}
@@ -1060,22 +1941,99 @@ set_udp_address(struct socket_server *ss, struct request_setudp *request, struct
 	return -1;
 }
 
+// 共享数据发送给一个socket，发送缓冲区为空时先直接写入，剩余部分加入高优先级链表
+// 写入出错留给可写事件处理，因为一条广播指令只能返回一个消息
+static void
+broadcast_one(struct socket_server *ss, struct socket *s, struct socket_broadcast *b) {
+	++s->send_packets;
+	take_direct_write(ss, s);
+	int n = 0;
+	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
+		n = write(s->fd, b->so.buffer, b->so.sz);
+		if (n < 0) {
+			n = 0;
+		} else {
+			struct socket_server_stat *stat = &poller_of(ss, s->id)->stat;
+			++stat->write_syscall;
+			stat->write_bytes += n;
+			stat_send(poller_of(ss, s->id), s, n);
+			if (n == b->so.sz) {
+				broadcast_release(b);
+				return;
+			}
+		}
+		sp_write(poller_of(ss, s->id)->event_fd, s->fd, s, true);
+	}
+	struct write_buffer * buf = MALLOC(sizeof(*buf));
+	buf->next = NULL;
+	buf->buffer = b;
+	buf->ptr = (char *)b->so.buffer + n;
+	buf->sz = b->so.sz - n;
+	buf->userobject = false;
+	buf->broadcast = true;
+	buf->file_fd = -1;
+	struct wb_list *list = &s->high;
+	if (list->head == NULL) {
+		list->head = list->tail = buf;
+	} else {
+		list->tail->next = buf;
+		list->tail = buf;
+	}
+	s->wb_size += buf->sz;
+}
+
+// 依次处理一个socket线程负责的广播目标
+// 某个目标需要返回消息(水位警告或者缓冲区溢出关闭)时记下进度，下次从这里继续
+static int
+broadcast_socket(struct socket_server *ss, struct socket_poller *p, struct broadcast_list *list, struct socket_message *result) {
+	while (list->index < list->n) {
+		int id = list->id[list->index++];
+		struct socket * s = get_socket(ss, id);
+		int type = -1;
+		if (s->id != id || s->protocol != PROTOCOL_TCP
+			|| s->type == SOCKET_TYPE_INVALID
+			|| s->type == SOCKET_TYPE_HALFCLOSE
+			|| s->type == SOCKET_TYPE_PACCEPT
+			|| s->type == SOCKET_TYPE_PLISTEN
+			|| s->type == SOCKET_TYPE_LISTEN) {
+			broadcast_release(list->b);
+		} else {
+			// 和工作线程的直接写入互斥，见 socket_lock_write
+			socket_lock_write(ss, s);
+			broadcast_one(ss, s, list->b);
+			socket_unlock_write(s);
+			type = check_high_watermark(ss, id, result);
+		}
+		if (ss->direct) {
+			ATOM_DEC(&s->sending);
+		}
+		if (type != -1) {
+			p->broadcast = list;
+			return type;
+		}
+	}
+	p->broadcast = NULL;
+	FREE(list);
+	return -1;
+}
+
 // return type
 // 执行管道指令，写入socket_message
 static int
-ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
-	int fd = ss->recvctrl_fd;
-	// the length of message is one byte, so 256+8 buffer size is enough.
-	// 读管道数据，相反的数据写入管道逻辑见send_request方法
-	// len长度1个字节，所以缓冲区的长度为256足够
-	uint8_t buffer[256];
-	uint8_t header[2];
-	// 先读2字节的头
-	block_readpipe(fd, header, sizeof(header));
+ctrl_cmd(struct socket_server *ss, struct socket_poller *p, struct socket_message *result) {
+	// the length of message is one byte, so 256 buffer size is enough.
+	// 从当前批次中取出一条指令，写入队列的逻辑见send_request方法
+	// len长度1个字节，所以缓冲区的长度为256足够，复制出来以保证对齐
+	union {
+		uint8_t buffer[256];
+		uintptr_t align;
+	} u;
+	uint8_t *buffer = u.buffer;
+	const uint8_t *header = p->batch + p->batch_offset;
 	int type = header[0];
 	int len = header[1];
-	// 再读剩余数据部分
-	block_readpipe(fd, buffer, len);
+	memcpy(buffer, header + 2, len);
+	p->batch_offset += len + 2;
 	// ctrl command only exist in local fd, so don't worry about endian.
 	switch (type) {
 	case 'S':
@@ -1095,6 +2053,9 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	case 'O':
 		// 打开套接字
 		return open_socket(ss, (struct request_open *)buffer, result);
+	case 'N':
+		// 连接 unix 套接字
+		return open_unix_socket(ss, (struct request_open_unix *)buffer, result);
 	case 'X':
 		// 退出套接字
 		result->opaque = 0;
@@ -1103,14 +2064,57 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		result->data = NULL;
 		return SOCKET_EXIT;
 	case 'D':
-		// 发送高优先级数据
-		return send_socket(ss, (struct request_send *)buffer, result, PRIORITY_HIGH, NULL);
-	case 'P':
-		// 发送低优先级数据
-		return send_socket(ss, (struct request_send *)buffer, result, PRIORITY_LOW, NULL);
+	case 'P': {
+		// 发送高/低优先级数据
+		struct request_send * request = (struct request_send *)buffer;
+		struct socket * s = get_socket(ss, request->id);
+		socket_lock_write(ss, s);
+		int ret = send_socket(ss, request, result, type == 'D' ? PRIORITY_HIGH : PRIORITY_LOW, NULL);
+		socket_unlock_write(s);
+		if (ss->direct) {
+			// 处理完之后工作线程才可以直接写入
+			ATOM_DEC(&get_socket(ss, request->id)->sending);
+		}
+		if (ret == -1) {
+			ret = check_high_watermark(ss, request->id, result);
+		}
+		return ret;
+	}
+	case 'F': {
+		// 发送文件
+		struct request_sendfile * request = (struct request_sendfile *)buffer;
+		struct socket * s = get_socket(ss, request->id);
+		socket_lock_write(ss, s);
+		int ret = sendfile_socket(ss, request, result);
+		socket_unlock_write(s);
+		if (ss->direct) {
+			ATOM_DEC(&get_socket(ss, request->id)->sending);
+		}
+		if (ret == -1) {
+			ret = check_high_watermark(ss, request->id, result);
+		}
+		return ret;
+	}
+	case 'R':
+		// 广播
+		return broadcast_socket(ss, p, ((struct request_broadcast *)buffer)->list, result);
+	case 'W': {
+		// 工作线程直接写入后剩余的数据
+		struct request_send * request = (struct request_send *)buffer;
+		struct socket * s = get_socket(ss, request->id);
+		if (s->id == request->id) {
+			take_direct_write(ss, s);
+			return check_high_watermark(ss, request->id, result);
+		}
+		return -1;
+	}
 	case 'A': {
 		struct request_send_udp * rsu = (struct request_send_udp *)buffer;
-		return send_socket(ss, &rsu->send, result, PRIORITY_HIGH, rsu->address);
+		int ret = send_socket(ss, &rsu->send, result, PRIORITY_HIGH, rsu->address);
+		if (ret == -1) {
+			ret = check_high_watermark(ss, rsu->send.id, result);
+		}
+		return ret;
 	}
 	case 'C':
 		return set_udp_address(ss, (struct request_setudp *)buffer, result);
@@ -1118,6 +2122,18 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		// 设置套接字
 		setopt_socket(ss, (struct request_setopt *)buffer);
 		return -1;
+	case 'G':
+		// 设置是否合并数据消息
+		setcoalesce_socket(ss, (struct request_setopt *)buffer);
+		return -1;
+	case 'H':
+		// 设置分帧模式
+		setframe_socket(ss, (struct request_frame *)buffer);
+		return -1;
+	case 'M':
+		// 设置发送缓冲区水位
+		setwatermark_socket(ss, (struct request_watermark *)buffer);
+		return -1;
 	case 'U':
 		add_udp_socket(ss, (struct request_udp *)buffer);
 		return -1;
@@ -1129,22 +2145,196 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	return -1;
 }
 
+// 读缓冲区的大小等级，sz 为 MIN_READ_BUFFER 的 2 的幂倍
+static inline int
+read_buffer_class(int sz) {
+	int c = 0;
+	while ((MIN_READ_BUFFER << c) < sz) {
+		++c;
+	}
+	return c;
+}
+
+// 每个大小等级预分配的读缓冲区个数
+static inline int
+read_pool_depth(int c) {
+	int n = READ_POOL_BYTES / (MIN_READ_BUFFER << c);
+	if (n < 1) {
+		return 1;
+	}
+	if (n > READ_POOL_DEPTH) {
+		return READ_POOL_DEPTH;
+	}
+	return n;
+}
+
+// 分配读缓冲区，从预分配的池中取
+// 读到数据的缓冲区交给服务，服务照常调用 skynet_free 释放，内存回到分配器，
+// socket 线程在等待事件前 (read_pool_refill) 再从分配器补足用掉的缓冲区，读的路径上不再 malloc
+static inline char *
+read_buffer_alloc(struct socket_poller *p, int sz) {
+	int c = read_buffer_class(sz);
+	struct read_pool *rp = &p->read_pool[c];
+	p->read_refill |= 1u << c;
+	if (rp->n > 0) {
+		return rp->buffer[--rp->n];
+	}
+	return MALLOC(sz);
+}
+
+// 没有用上的读缓冲区 (EAGAIN, EINTR, EOF, 半关闭时丢弃, 分帧后) 放回池中
+static inline void
+read_buffer_free(struct socket_poller *p, char * buffer, int sz) {
+	int c = read_buffer_class(sz);
+	struct read_pool *rp = &p->read_pool[c];
+	if (rp->n < read_pool_depth(c)) {
+		rp->buffer[rp->n++] = buffer;
+	} else {
+		FREE(buffer);
+	}
+}
+
+// 补足这一批事件中取用过的大小等级，在 socket 线程等待事件前调用
+static void
+read_pool_refill(struct socket_poller *p) {
+	uint32_t refill = p->read_refill;
+	p->read_refill = 0;
+	int c;
+	for (c=0; refill; c++, refill >>= 1) {
+		if (refill & 1) {
+			struct read_pool *rp = &p->read_pool[c];
+			int depth = read_pool_depth(c);
+			while (rp->n < depth) {
+				rp->buffer[rp->n++] = MALLOC(MIN_READ_BUFFER << c);
+			}
+		}
+	}
+}
+
+// 包的缓冲区至少能放下 sz 字节
+// 按读到的数据分配，每次至少翻倍，不超过包的长度；只发来包头的连接不会占用整个包的内存
+static void
+frame_reserve(struct socket *s, int sz) {
+	if (sz <= s->frame_cap) {
+		return;
+	}
+	int cap = s->frame_cap * 2;
+	if (cap < sz) {
+		cap = sz;
+	}
+	if (cap > s->frame_size) {
+		cap = s->frame_size;
+	}
+	char * buffer = MALLOC(cap);
+	if (s->frame_read > 0) {
+		memcpy(buffer, s->frame_buffer, s->frame_read);
+	}
+	FREE(s->frame_buffer);
+	s->frame_buffer = buffer;
+	s->frame_cap = cap;
+}
+
 // return -1 (ignore) when error
-// 从套接字读数据，返回SOCKET_DATA
+// 分帧模式，从读到的数据中切出完整的包，返回 SOCKET_FRAME
+// ud 为包的个数，data 为 struct socket_event 数组，没有完整的包时返回 -1
+// 不完整的包保存在 socket 中，等待下一次读入
+static int
+forward_frame(struct socket_server *ss, struct socket *s, const char * buffer, int n, struct socket_message * result) {
+	struct socket_event *ev = NULL;
+	int ev_n = 0;
+	int ev_cap = 0;
+	while (n > 0) {
+		if (s->frame_size < 0) {
+			// 读包头
+			int need = s->frame - s->frame_header_n;
+			if (n < need) {
+				memcpy(s->frame_header + s->frame_header_n, buffer, n);
+				s->frame_header_n += n;
+				break;
+			}
+			memcpy(s->frame_header + s->frame_header_n, buffer, need);
+			buffer += need;
+			n -= need;
+			const uint8_t * h = s->frame_header;
+			uint32_t size = (s->frame == 2) ? (h[0] << 8 | h[1])
+				: ((uint32_t)h[0] << 24 | h[1] << 16 | h[2] << 8 | h[3]);
+			if (size > (uint32_t)s->frame_max) {
+				int i;
+				for (i=0;i<ev_n;i++) {
+					FREE(ev[i].data);
+				}
+				FREE(ev);
+				force_close(ss, s, result);
+				result->data = "frame too large";
+				return SOCKET_ERROR;
+			}
+			s->frame_header_n = 0;
+			s->frame_size = (int)size;
+			s->frame_read = 0;
+		}
+		int need = s->frame_size - s->frame_read;
+		if (n < need) {
+			frame_reserve(s, s->frame_read + n);
+			memcpy(s->frame_buffer + s->frame_read, buffer, n);
+			s->frame_read += n;
+			break;
+		}
+		frame_reserve(s, s->frame_size);
+		if (s->frame_buffer == NULL) {
+			// 空包
+			s->frame_buffer = MALLOC(0);
+		}
+		memcpy(s->frame_buffer + s->frame_read, buffer, need);
+		buffer += need;
+		n -= need;
+		if (ev_n >= ev_cap) {
+			ev_cap = ev_cap ? ev_cap * 2 : 4;
+			struct socket_event *tmp = MALLOC(ev_cap * sizeof(*tmp));
+			if (ev_n > 0) {
+				memcpy(tmp, ev, ev_n * sizeof(*tmp));
+			}
+			FREE(ev);
+			ev = tmp;
+		}
+		ev[ev_n].id = s->id;
+		ev[ev_n].ud = s->frame_size;
+		ev[ev_n].data = s->frame_buffer;
+		++ev_n;
+		s->frame_buffer = NULL;
+		s->frame_cap = 0;
+		s->frame_size = -1;
+	}
+	if (ev_n == 0) {
+		return -1;
+	}
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = ev_n;
+	result->data = (char *)ev;
+	return SOCKET_FRAME;
+}
+
+// 从套接字读数据，返回SOCKET_DATA，分帧模式返回 SOCKET_FRAME
+// 读满了缓冲区时 *full 为 true，套接字中可能还有数据
 static int
-forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_message * result) {
+forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_message * result, bool *full) {
+	struct socket_poller *p = poller_of(ss, s->id);
 	int sz = s->p.size;
-	char * buffer = MALLOC(sz);
+	char * buffer = read_buffer_alloc(p, sz);
+	*full = false;
 	// 从套接字读数据
 	int n = (int)read(s->fd, buffer, sz);
 	if (n<0) {
 		// 出错关闭
-		FREE(buffer);
+		read_buffer_free(p, buffer, sz);
 		switch(errno) {
 		case EINTR:
 			break;
 		case AGAIN_WOULDBLOCK:
-			fprintf(stderr, "socket-server: EAGAIN capture.\n");
+			// readall 模式下读到 EAGAIN 是正常的结束
+			if (!ss->readall) {
+				fprintf(stderr, "socket-server: EAGAIN capture.\n");
+			}
 			break;
 		default:
 			// close when error
@@ -1156,31 +2346,76 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_me
 	}
 	if (n==0) {
 		// 无数据关闭
-		FREE(buffer);
+		read_buffer_free(p, buffer, sz);
 		force_close(ss, s, result);
 		return SOCKET_CLOSE;
 	}
 
 	if (s->type == SOCKET_TYPE_HALFCLOSE) {
 		// discard recv data
-		FREE(buffer);
+		read_buffer_free(p, buffer, sz);
 		return -1;
 	}
 
-	// 读缓冲区的大小动态变化
-	// ?
+	// 读缓冲区的大小动态变化，读满则加倍，不到一半则减半
 	if (n == sz) {
-		s->p.size *= 2;
+		*full = true;
+		if (sz < MAX_READ_BUFFER) {
+			s->p.size *= 2;
+		}
 	} else if (sz > MIN_READ_BUFFER && n*2 < sz) {
 		s->p.size /= 2;
 	}
 
+	stat_recv(p, s, n);
+	if (s->frame) {
+		int type = forward_frame(ss, s, buffer, n, result);
+		read_buffer_free(p, buffer, sz);
+		return type;
+	}
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = n;
+	result->data = buffer;
+	return SOCKET_DATA;
+}
+
+#ifdef SP_URING
+// io_uring 多次 recv 的完成事件，内核已经把数据读到 e->buffer 中，e->res 为长度或 -errno
+static int
+forward_message_uring(struct socket_server *ss, struct socket *s, struct event *e, struct socket_message * result) {
+	struct socket_poller *p = poller_of(ss, s->id);
+	char * buffer = e->buffer;
+	int n = e->res;
+	e->buffer = NULL;
+	if (n < 0) {
+		// close when error
+		force_close(ss, s, result);
+		result->data = strerror(-n);
+		return SOCKET_ERROR;
+	}
+	if (n == 0) {
+		force_close(ss, s, result);
+		return SOCKET_CLOSE;
+	}
+	if (s->type == SOCKET_TYPE_HALFCLOSE) {
+		// discard recv data
+		FREE(buffer);
+		return -1;
+	}
+	stat_recv(p, s, n);
+	if (s->frame) {
+		int type = forward_frame(ss, s, buffer, n, result);
+		FREE(buffer);
+		return type;
+	}
 	result->opaque = s->opaque;
 	result->id = s->id;
 	result->ud = n;
 	result->data = buffer;
 	return SOCKET_DATA;
 }
+#endif
 
 // 填充udp地址，返回地址长度
 // type(1) + port(2) + addr(4)
@@ -1208,7 +2443,8 @@ static int
 forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_message * result) {
 	union sockaddr_all sa;
 	socklen_t slen = sizeof(sa);
-	int n = recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
+	uint8_t * udpbuffer = poller_of(ss, s->id)->udpbuffer;
+	int n = recvfrom(s->fd, udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
 	if (n<0) {
 		switch(errno) {
 		case EINTR:
@@ -1234,8 +2470,9 @@ forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_me
 		data = MALLOC(n + 1 + 2 + 16);
 		gen_udp_address(PROTOCOL_UDPv6, &sa, data + n);
 	}
-	memcpy(data, ss->udpbuffer, n);
+	memcpy(data, udpbuffer, n);
 
+	stat_recv(poller_of(ss, s->id), s, n);
 	result->opaque = s->opaque;
 	result->id = s->id;
 	result->ud = n;
@@ -1244,6 +2481,94 @@ forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_me
 	return SOCKET_UDP;
 }
 
+#ifdef USE_MMSG
+// 用 recvmmsg 一次读入最多 udp_batch 个数据报
+// 只读到一个时和 forward_message_udp 的结果相同
+// 读到多个时合并为一条 SOCKET_UDP 消息，ud 为负的数据报个数，data 中依次为
+// uint32 size + data(size) + udp address (见 gen_udp_address)
+static int
+forward_message_udp_batch(struct socket_server *ss, struct socket *s, struct socket_message * result) {
+	struct socket_poller *p = poller_of(ss, s->id);
+	int batch = ss->udp_batch;
+	if (p->udpbatch == NULL) {
+		p->udpbatch = MALLOC(batch * MAX_UDP_PACKAGE);
+	}
+	struct mmsghdr msg[MAX_UDP_BATCH];
+	struct iovec iov[MAX_UDP_BATCH];
+	union sockaddr_all sa[MAX_UDP_BATCH];
+	int i;
+	for (i=0;i<batch;i++) {
+		iov[i].iov_base = p->udpbatch + i * MAX_UDP_PACKAGE;
+		iov[i].iov_len = MAX_UDP_PACKAGE;
+		memset(&msg[i].msg_hdr, 0, sizeof(msg[i].msg_hdr));
+		msg[i].msg_hdr.msg_name = &sa[i];
+		msg[i].msg_hdr.msg_namelen = sizeof(sa[i]);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	int n = recvmmsg(s->fd, msg, batch, 0, NULL);
+	if (n<0) {
+		switch(errno) {
+		case EINTR:
+		case AGAIN_WOULDBLOCK:
+			break;
+		default:
+			// close when error
+			force_close(ss, s, result);
+			result->data = strerror(errno);
+			return SOCKET_ERROR;
+		}
+		return -1;
+	}
+	int addrsz = (s->protocol == PROTOCOL_UDP) ? 1+2+4 : 1+2+16;
+	socklen_t slen = (s->protocol == PROTOCOL_UDP) ? sizeof(sa[0].v4) : sizeof(sa[0].v6);
+	int count = 0;
+	int last = 0;
+	size_t total = 0;
+	for (i=0;i<n;i++) {
+		// 丢弃协议不匹配的数据报
+		if (msg[i].msg_hdr.msg_namelen != slen) {
+			msg[i].msg_hdr.msg_namelen = 0;
+			continue;
+		}
+		++count;
+		last = i;
+		stat_recv(p, s, msg[i].msg_len);
+		total += sizeof(uint32_t) + msg[i].msg_len + addrsz;
+	}
+	if (count == 0) {
+		return -1;
+	}
+	uint8_t * data;
+	result->opaque = s->opaque;
+	result->id = s->id;
+	if (count == 1) {
+		int sz = msg[last].msg_len;
+		data = MALLOC(sz + addrsz);
+		memcpy(data, iov[last].iov_base, sz);
+		gen_udp_address(s->protocol, &sa[last], data + sz);
+		result->ud = sz;
+	} else {
+		data = MALLOC(total);
+		uint8_t * ptr = data;
+		for (i=0;i<n;i++) {
+			if (msg[i].msg_hdr.msg_namelen == 0)
+				continue;
+			uint32_t sz = msg[i].msg_len;
+			memcpy(ptr, &sz, sizeof(sz));
+			ptr += sizeof(sz);
+			memcpy(ptr, iov[i].iov_base, sz);
+			ptr += sz;
+			ptr += gen_udp_address(s->protocol, &sa[i], ptr);
+		}
+		result->ud = -count;
+	}
+	result->data = (char *)data;
+
+	return SOCKET_UDP;
+}
+#endif
+
 // 连接逻辑
 // 正常返回SOCKET_OPEN
 static int
@@ -1261,20 +2586,22 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_message
 	} else {
 		// 如果无错误，修改socket为CONNECTED类型
 		s->type = SOCKET_TYPE_CONNECTED;
+		uring_recv(ss, s);
 		result->opaque = s->opaque;
 		result->id = s->id;
 		result->ud = 0;
 		if (send_buffer_empty(s)) {
 			// 如果链表缓冲区为空，关闭事件循环中fd的可写权限
-			sp_write(ss->event_fd, s->fd, s, false);
+			sp_write(poller_of(ss, s->id)->event_fd, s->fd, s, false);
 		}
 		union sockaddr_all u;
 		socklen_t slen = sizeof(u);
 		if (getpeername(s->fd, &u.s, &slen) == 0) {
 			// 连接对等方ip地址写入result->data
 			void * sin_addr = (u.s.sa_family == AF_INET) ? (void*)&u.v4.sin_addr : (void *)&u.v6.sin6_addr;
-			if (inet_ntop(u.s.sa_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
-				result->data = ss->buffer;
+			char * buffer = poller_of(ss, s->id)->buffer;
+			if (inet_ntop(u.s.sa_family, sin_addr, buffer, MAX_INFO)) {
+				result->data = buffer;
 				return SOCKET_OPEN;
 			}
 		}
@@ -1283,20 +2610,19 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_message
 	}
 }
 
+// 为 accept 得到的 client_fd 创建被动套接字，client_fd < 0 时为 -errno
 // return 0 when failed, or -1 when file limit
-// 
 static int
-report_accept(struct socket_server *ss, struct socket *s, struct socket_message *result) {
-	union sockaddr_all u;
-	socklen_t len = sizeof(u);
-	// 生成被动套接字
-	int client_fd = accept(s->fd, &u.s, &len);
+accept_socket(struct socket_server *ss, struct socket *s, int client_fd, union sockaddr_all *addr, socklen_t len, struct socket_message *result) {
+	struct socket_server_stat *stat = &poller_of(ss, s->id)->stat;
 	if (client_fd < 0) {
-		if (errno == EMFILE || errno == ENFILE) {
+		int err = -client_fd;
+		if (err == EMFILE || err == ENFILE) {
+			++stat->accept_error;
 			result->opaque = s->opaque;
 			result->id = s->id;
 			result->ud = 0;
-			result->data = strerror(errno);
+			result->data = strerror(err);
 			return -1;
 		} else {
 			return 0;
@@ -1305,43 +2631,100 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	// 分配id
 	int id = reserve_id(ss);
 	if (id < 0) {
+		++stat->accept_drop;
 		close(client_fd);
 		return 0;
 	}
+#ifndef __linux__
 	// 设置keepalive和非阻塞
 	socket_keepalive(client_fd);
 	sp_nonblocking(client_fd);
+#endif
 	// 创建socket实例
 	struct socket *ns = new_fd(ss, id, client_fd, PROTOCOL_TCP, s->opaque, false);
 	if (ns == NULL) {
+		++stat->accept_drop;
 		close(client_fd);
 		return 0;
 	}
+	++stat->accept;
+	// 监听套接字的 recv_packets 记录 accept 的连接数
+	stat_recv(poller_of(ss, s->id), s, 0);
 	// 设置socket类型为PACCEPT
 	ns->type = SOCKET_TYPE_PACCEPT;
+	// 继承监听套接字的合并和分帧设置
+	ns->coalesce = s->coalesce;
+	ns->frame = s->frame;
+	ns->frame_max = s->frame_max;
 	result->opaque = s->opaque;
 	result->id = s->id;			// 服务器套接字id
 	result->ud = id;			// 被动套接字id
 	result->data = NULL;		// 连接客户端ip地址:port端口
 
-	void * sin_addr = (u.s.sa_family == AF_INET) ? (void*)&u.v4.sin_addr : (void *)&u.v6.sin6_addr;
-	int sin_port = ntohs((u.s.sa_family == AF_INET) ? u.v4.sin_port : u.v6.sin6_port);
+	union sockaddr_all *u = addr;
+	if (u->s.sa_family == AF_UNIX) {
+		// 客户端一般没有绑定路径，用监听的路径表示连接来源
+		if (len <= offsetof(struct sockaddr_un, sun_path)) {
+			len = sizeof(*u);
+			getsockname(client_fd, &u->s, &len);
+		}
+		char * buffer = poller_of(ss, s->id)->buffer;
+		unix_name(&u->un, len, buffer, MAX_INFO);
+		result->data = buffer;
+		return 1;
+	}
+	void * sin_addr = (u->s.sa_family == AF_INET) ? (void*)&u->v4.sin_addr : (void *)&u->v6.sin6_addr;
+	int sin_port = ntohs((u->s.sa_family == AF_INET) ? u->v4.sin_port : u->v6.sin6_port);
 	char tmp[INET6_ADDRSTRLEN];
-	if (inet_ntop(u.s.sa_family, sin_addr, tmp, sizeof(tmp))) {
-		snprintf(ss->buffer, sizeof(ss->buffer), "%s:%d", tmp, sin_port);
-		result->data = ss->buffer;
+	if (inet_ntop(u->s.sa_family, sin_addr, tmp, sizeof(tmp))) {
+		char * buffer = poller_of(ss, s->id)->buffer;
+		snprintf(buffer, MAX_INFO, "%s:%d", tmp, sin_port);
+		result->data = buffer;
 	}
 
 	return 1;
 }
 
+// return 0 when failed, or -1 when file limit
+// 
+static int
+report_accept(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+	union sockaddr_all u;
+	socklen_t len = sizeof(u);
+	// 生成被动套接字
+#ifdef __linux__
+	// 一次系统调用同时设置非阻塞，keepalive 继承自监听套接字
+	int client_fd = accept4(s->fd, &u.s, &len, SOCK_NONBLOCK);
+#else
+	int client_fd = accept(s->fd, &u.s, &len);
+#endif
+	if (client_fd < 0) {
+		client_fd = -errno;
+	}
+	return accept_socket(ss, s, client_fd, &u, len, result);
+}
+
+#ifdef SP_URING
+// io_uring 多次 accept 已经得到了连接 (或 -errno)，只取地址
+static int
+report_accept_uring(struct socket_server *ss, struct socket *s, int client_fd, struct socket_message *result) {
+	union sockaddr_all u;
+	socklen_t len = sizeof(u);
+	memset(&u, 0, sizeof(u));
+	if (client_fd >= 0 && getpeername(client_fd, &u.s, &len) != 0) {
+		len = 0;
+	}
+	return accept_socket(ss, s, client_fd, &u, len, result);
+}
+#endif
+
 static inline void 
-clear_closed_event(struct socket_server *ss, struct socket_message * result, int type) {
+clear_closed_event(struct socket_poller *p, struct socket_message * result, int type) {
 	if (type == SOCKET_CLOSE || type == SOCKET_ERROR) {
 		int id = result->id;
 		int i;
-		for (i=ss->event_index; i<ss->event_n; i++) {
-			struct event *e = &ss->ev[i];
+		for (i=p->event_index; i<p->event_n; i++) {
+			struct event *e = &p->ev[i];
 			struct socket *s = e->s;
 			if (s) {
 				if (s->type == SOCKET_TYPE_INVALID && s->id == id) {
@@ -1353,46 +2736,148 @@ clear_closed_event(struct socket_server *ss, struct socket_message * result, int
 	}
 }
 
-// return type
-// 事件循环主函数
-int 
-socket_server_poll(struct socket_server *ss, struct socket_message * result, int * more) {
+// 暂存一个读到的数据，批次结束时合并发送，服务数超过 MAX_COALESCE 时返回 false
+static bool
+coalesce_push(struct socket_poller *p, struct socket_message *result) {
+	struct coalesce_buffer *cb = NULL;
+	int i;
+	for (i=0;i<p->coalesce_n;i++) {
+		if (p->coalesce[i].opaque == result->opaque) {
+			cb = &p->coalesce[i];
+			break;
+		}
+	}
+	if (cb == NULL) {
+		if (p->coalesce_n >= MAX_COALESCE) {
+			return false;
+		}
+		cb = &p->coalesce[p->coalesce_n++];
+		cb->opaque = result->opaque;
+		cb->n = 1;
+		cb->first.id = result->id;
+		cb->first.ud = result->ud;
+		cb->first.data = result->data;
+		return true;
+	}
+	if (cb->n >= cb->cap) {
+		// 第二个数据开始分配数组
+		int cap = cb->cap ? cb->cap * 2 : 16;
+		struct socket_event *ev = MALLOC(cap * sizeof(*ev));
+		if (cb->ev) {
+			memcpy(ev, cb->ev, cb->n * sizeof(*ev));
+			FREE(cb->ev);
+		} else {
+			ev[0] = cb->first;
+		}
+		cb->ev = ev;
+		cb->cap = cap;
+	}
+	struct socket_event *e = &cb->ev[cb->n++];
+	e->id = result->id;
+	e->ud = result->ud;
+	e->data = result->data;
+	return true;
+}
+
+// 取出第 i 个服务的合并数据，只有一个数据时返回 SOCKET_DATA
+// SOCKET_BATCH 的 ud 为数据个数，data 为 struct socket_event 数组
+static int
+coalesce_pop(struct socket_poller *p, int i, struct socket_message *result) {
+	struct coalesce_buffer *cb = &p->coalesce[i];
+	int type;
+	result->opaque = cb->opaque;
+	if (cb->ev == NULL) {
+		result->id = cb->first.id;
+		result->ud = cb->first.ud;
+		result->data = cb->first.data;
+		type = SOCKET_DATA;
+	} else {
+		result->id = cb->ev[0].id;
+		result->ud = cb->n;
+		result->data = (char *)cb->ev;
+		type = SOCKET_BATCH;
+	}
+	*cb = p->coalesce[--p->coalesce_n];
+	p->coalesce[p->coalesce_n].ev = NULL;
+	p->coalesce[p->coalesce_n].cap = 0;
+	return type;
+}
+
+// 查找发给服务 opaque 的合并数据，没有返回 -1
+static int
+coalesce_find(struct socket_poller *p, uintptr_t opaque) {
+	int i;
+	for (i=0;i<p->coalesce_n;i++) {
+		if (p->coalesce[i].opaque == opaque) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int
+poll_socket(struct socket_server *ss, struct socket_poller *p, struct socket_message * result, int * more) {
 	for (;;) {
 		// 如果需要监测指令
-		if (ss->checkctrl) {
+		if (p->checkctrl) {
+			if (p->broadcast) {
+				// 先处理完上一条广播指令，保证发送顺序
+				int type = broadcast_socket(ss, p, p->broadcast, result);
+				if (type != -1) {
+					clear_closed_event(p, result, type);
+					return type;
+				}
+				continue;
+			}
 			// 如果有指令输入
-			if (has_cmd(ss)) {
+			if (has_cmd(p)) {
 				// 读入指令并执行对应逻辑
-				int type = ctrl_cmd(ss, result);
+				int type = ctrl_cmd(ss, p, result);
 				if (type != -1) {
 					// 正常执行
-					clear_closed_event(ss, result, type);
+					clear_closed_event(p, result, type);
 					return type;
 				} else
 					continue;
 			} else {
-				ss->checkctrl = 0;
+				p->checkctrl = 0;
 			}
 		}
-		if (ss->event_index == ss->event_n) {
+		if (p->event_index == p->event_n) {
+			if (p->coalesce_n > 0) {
+				// 这一批事件处理完，等待之前先发出合并的数据
+				return coalesce_pop(p, p->coalesce_n - 1, result);
+			}
 			// 如果事件循环无可读事件，等待新的事件产生
 			// 同时打开指令监测标识
-			ss->event_n = sp_wait(ss->event_fd, ss->ev, MAX_EVENT);
-			ss->checkctrl = 1;
+			if (p->read_refill) {
+				read_pool_refill(p);
+			}
+			p->event_n = sp_wait(p->event_fd, p->ev, ss->max_event);
+			p->now = monotonic_ms();
+			p->checkctrl = 1;
 			if (more) {
 				*more = 0;
 			}
-			ss->event_index = 0;
-			if (ss->event_n <= 0) {
-				ss->event_n = 0;
+			p->event_index = 0;
+			if (p->event_n <= 0) {
+				p->event_n = 0;
 				return -1;
 			}
 		}
 		// 读取一个事件
-		struct event *e = &ss->ev[ss->event_index++];
+		struct event *e = &p->ev[p->event_index++];
 		struct socket *s = e->s;
-		if (s == NULL) {
+		if (s == NULL || s->type == SOCKET_TYPE_INVALID) {
 			// dispatch pipe message at beginning
+			// 已经关闭的套接字，丢弃 io_uring 读到的数据
+			if (e->done) {
+				FREE(e->buffer);
+				e->buffer = NULL;
+			}
+			if (s) {
+				fprintf(stderr, "socket-server: invalid socket\n");
+			}
 			continue;
 		}
 		switch (s->type) {
@@ -1400,32 +2885,73 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 			// 返回 SOCKET_OPEN，修改socket为CONNECTED类型
 			return report_connect(ss, s, result);
 		case SOCKET_TYPE_LISTEN: {
+#ifdef SP_URING
+			if (e->done) {
+				// 内核已经 accept 了连接，一个完成事件一个连接
+				int ok = report_accept_uring(ss, s, e->res, result);
+				if (ok > 0)
+					return SOCKET_ACCEPT;
+				if (ok < 0)
+					return SOCKET_ERROR;
+				break;
+			}
+#endif
 			// 返回 SOCKET_ACCEPT，生成被动套接字
 			int ok = report_accept(ss, s, result);
 			if (ok > 0) {
+				if (++p->accept_n < ACCEPT_BUDGET) {
+					// 下一次继续 accept 这个监听套接字，直到 EAGAIN 或者用完预算
+					--p->event_index;
+				} else {
+					// 用完预算，先处理其他事件，剩余的连接下一次 sp_wait 还会报告
+					p->accept_n = 0;
+				}
 				return SOCKET_ACCEPT;
-			} if (ok < 0 ) {
+			}
+			p->accept_n = 0;
+			if (ok < 0 ) {
 				return SOCKET_ERROR;
 			}
 			// when ok == 0, retry
 			break;
 		}
-		case SOCKET_TYPE_INVALID:
-			fprintf(stderr, "socket-server: invalid socket\n");
-			break;
 		default:
+#ifdef SP_URING
+			if (e->done) {
+				int type = forward_message_uring(ss, s, e, result);
+				if (type == -1)
+					break;
+				if (type == SOCKET_DATA && s->coalesce && coalesce_push(p, result))
+					break;
+				return type;
+			}
+#endif
 			// 读取数据
 			if (e->read) {
 				// 如果事件可读
 				int type;
 				// forward_message_tcp/udp 正常返回 SOCKET_DATA
 				if (s->protocol == PROTOCOL_TCP) {
-					type = forward_message_tcp(ss, s, result);
+					bool full;
+					type = forward_message_tcp(ss, s, result, &full);
+					if (full && ss->readall && type != SOCKET_ERROR) {
+						// 读满了缓冲区，下一次继续读这个套接字，直到 EAGAIN
+						// 分帧模式下可能还没有完整的包 (type == -1)
+						--p->event_index;
+						if (type == -1 || (type == SOCKET_DATA && s->coalesce && coalesce_push(p, result)))
+							break;
+						return type;
+					}
 				} else {
+#ifdef USE_MMSG
+					if (ss->udp_batch > 1) {
+						type = forward_message_udp_batch(ss, s, result);
+					} else
+#endif
 					type = forward_message_udp(ss, s, result);
 					if (type == SOCKET_UDP) {
 						// try read again
-						--ss->event_index;
+						--p->event_index;
 						return SOCKET_UDP;
 					}
 				}
@@ -1433,19 +2959,26 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 					// 如果同时可写，回滚索引关闭可写标识，等待下一次循环进入可写逻辑
 					// Try to dispatch write message next step if write flag set.
 					e->read = false;
-					--ss->event_index;
+					--p->event_index;
 				}
 				if (type == -1)
-					break;				
+					break;
+				if (type == SOCKET_DATA && s->coalesce && coalesce_push(p, result))
+					break;
 				return type;
 			}
 			// 写入数据
 			if (e->write) {
 				// 如果事件可写
 				// 发送链表缓冲区数据
+				socket_lock_write(ss, s);
 				int type = send_buffer(ss, s, result);
-				if (type == -1)
-					break;
+				socket_unlock_write(s);
+				if (type == -1) {
+					type = check_low_watermark(s, result);
+					if (type == -1)
+						break;
+				}
 				return type;
 			}
 			break;
@@ -1453,25 +2986,75 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 	}
 }
 
-// 发送请求，往管道里写入命令数据
+// return type
+// 事件循环主函数，thread 为事件循环编号，每个socket线程调用自己的事件循环
+int 
+socket_server_poll_thread(struct socket_server *ss, int thread, struct socket_message * result, int * more) {
+	struct socket_poller *p = &ss->poller[thread];
+	if (p->deferred_type >= 0) {
+		int type = p->deferred_type;
+		*result = p->deferred;
+		p->deferred_type = -1;
+		return type;
+	}
+	int type = poll_socket(ss, p, result, more);
+	if (p->coalesce_n > 0) {
+		// 同一个服务还有合并的数据没有发出，先发出数据，这条消息推迟到下一次返回
+		int i = coalesce_find(p, result->opaque);
+		if (i >= 0) {
+			p->deferred = *result;
+			p->deferred_type = type;
+			return coalesce_pop(p, i, result);
+		}
+	}
+	return type;
+}
+
+// 只有一个事件循环时的旧接口，等同于轮询事件循环0
+int 
+socket_server_poll(struct socket_server *ss, struct socket_message * result, int * more) {
+	return socket_server_poll_thread(ss, 0, result, more);
+}
+
+// 发送请求，把命令数据写入 id 所属事件循环的指令队列
+// 只有队列从空变为非空时才写一次管道唤醒socket线程
 static void
-send_request(struct socket_server *ss, struct request_package *request, char type, int len) {
+send_request(struct socket_server *ss, int id, struct request_package *request, char type, int len) {
+	struct socket_poller *p = poller_of(ss, id);
+	struct cmd_queue *q = &p->queue;
 	// 填充request头部
 	request->header[6] = (uint8_t)type;
 	request->header[7] = (uint8_t)len;
-	for (;;) {
-		// 往管道写入数据
-		// 偏移后header前6个字节被忽略
-		int n = write(ss->sendctrl_fd, &request->header[6], len+2);
-		if (n<0) {
-			// 如果没有写任何数据之前被信号中断则继续循环写入
-			if (errno != EINTR) {
-				fprintf(stderr, "socket-server : send ctrl command error %s.\n", strerror(errno));
+	int sz = len + 2;
+	SPIN_LOCK(q)
+	if (q->size + sz > q->cap) {
+		int cap = q->cap * 2;
+		while (q->size + sz > cap) {
+			cap *= 2;
+		}
+		q->buffer = skynet_realloc(q->buffer, cap);
+		q->cap = cap;
+	}
+	// 偏移后header前6个字节被忽略
+	memcpy(q->buffer + q->size, &request->header[6], sz);
+	q->size += sz;
+	int wakeup = !q->signaled;
+	q->signaled = 1;
+	SPIN_UNLOCK(q)
+	if (wakeup) {
+		for (;;) {
+			char c = 0;
+			int n = write(p->sendctrl_fd, &c, 1);
+			if (n<0) {
+				if (errno == EINTR)
+					continue;
+				// EAGAIN 说明管道中已经有唤醒数据
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					fprintf(stderr, "socket-server : send ctrl command error %s.\n", strerror(errno));
+				}
 			}
-			continue;
+			return;
 		}
-		assert(n == len+2);
-		return;
 	}
 }
 
@@ -1499,10 +3082,26 @@ open_request(struct socket_server *ss, struct request_package *req, uintptr_t op
 int 
 socket_server_connect(struct socket_server *ss, uintptr_t opaque, const char * addr, int port) {
 	struct request_package request;
+	const char * path = unix_path(addr);
+	if (path) {
+		int len = unix_address(path, &request.u.open_unix.addr);
+		if (len < 0) {
+			fprintf(stderr, "socket-server : Invalid unix socket path %s.\n", path);
+			return -1;
+		}
+		int id = reserve_id(ss);
+		if (id < 0)
+			return -1;
+		request.u.open_unix.opaque = opaque;
+		request.u.open_unix.id = id;
+		request.u.open_unix.len = len;
+		send_request(ss, id, &request, 'N', sizeof(request.u.open_unix));
+		return id;
+	}
 	int len = open_request(ss, &request, opaque, addr, port);
 	if (len < 0)
 		return -1;
-	send_request(ss, &request, 'O', sizeof(request.u.open) + len);
+	send_request(ss, request.u.open.id, &request, 'O', sizeof(request.u.open) + len);
 	return request.u.open.id;
 }
 
@@ -1513,47 +3112,195 @@ free_buffer(struct socket_server *ss, const void * buffer, int sz) {
 	so.free_func((void *)buffer);
 }
 
+// 工作线程是否可以直接写入：已连接的tcp套接字，发送缓冲区为空，并且没有未处理的发送请求
+static inline bool
+can_direct_write(struct socket *s, int id) {
+	return s->id == id && s->type == SOCKET_TYPE_CONNECTED && s->protocol == PROTOCOL_TCP
+		&& send_buffer_empty(s) && s->dw_buffer == NULL && s->sending == 0;
+}
+
+// 在工作线程中直接写入套接字，没有写完的部分交给socket线程
+// 成功返回 true
+static bool
+direct_write(struct socket_server *ss, struct socket *s, int id, const void * buffer, int sz) {
+	if (!can_direct_write(s, id) || !spinlock_trylock(&s->dw_lock)) {
+		return false;
+	}
+	// 加锁后再检查一次，socket线程可能刚刚关闭了它
+	if (!can_direct_write(s, id)) {
+		spinlock_unlock(&s->dw_lock);
+		return false;
+	}
+	++s->dw_packets;
+	struct send_object so;
+	send_object_init(ss, &so, (void *)buffer, sz);
+	int n = write(s->fd, so.buffer, so.sz);
+	if (n < 0) {
+		// 出错时交给socket线程重试并处理错误
+		n = 0;
+	} else {
+		ATOM_INC(&ss->direct_syscall);
+		ATOM_ADD(&ss->direct_bytes, n);
+		s->dw_bytes += n;
+	}
+	if (n == so.sz) {
+		spinlock_unlock(&s->dw_lock);
+		so.free_func((void *)buffer);
+		return true;
+	}
+	struct request_send rs;
+	rs.id = id;
+	rs.sz = sz;
+	rs.buffer = (char *)buffer;
+	struct wb_list tmp;
+	clear_wb_list(&tmp);
+	s->dw_buffer = append_sendbuffer_(ss, &tmp, &rs, SIZEOF_TCPBUFFER, n);
+	spinlock_unlock(&s->dw_lock);
+
+	// 通知socket线程接管剩余数据，打开可写事件
+	struct request_package request;
+	request.u.send.id = id;
+	request.u.send.sz = 0;
+	request.u.send.buffer = NULL;
+	send_request(ss, id, &request, 'W', sizeof(request.u.send));
+	return true;
+}
+
+// 同一份数据发送给多个socket，数据不复制，所有目标共享一个引用计数
+// 目标按socket线程分组，每个socket线程一条指令；buffer 交给 socket_server 释放
+// 返回加入发送队列的目标数量
+int
+socket_server_broadcast(struct socket_server *ss, const int *id, int n, const void * buffer, int sz) {
+	struct socket_broadcast *b = MALLOC(sizeof(*b));
+	b->object = (void *)buffer;
+	send_object_init(ss, &b->so, (void *)buffer, sz);
+	// 分发期间持有一个引用，防止socket线程提前释放
+	b->ref = 1;
+	int thread = ss->thread;
+	int count[thread];
+	struct broadcast_list *list[thread];
+	int i;
+	memset(count, 0, sizeof(count));
+	for (i=0;i<n;i++) {
+		++count[(unsigned)id[i] % thread];
+	}
+	for (i=0;i<thread;i++) {
+		list[i] = NULL;
+		if (count[i] > 0) {
+			list[i] = MALLOC(sizeof(struct broadcast_list) + count[i] * sizeof(int));
+			list[i]->b = b;
+			list[i]->n = 0;
+			list[i]->index = 0;
+			list[i]->id = (int *)(list[i] + 1);
+		}
+	}
+	for (i=0;i<n;i++) {
+		struct socket * s = get_socket(ss, id[i]);
+		if (s->id != id[i] || s->type == SOCKET_TYPE_INVALID) {
+			continue;
+		}
+		if (ss->direct) {
+			// 处理完之前工作线程不能直接写入
+			ATOM_INC(&s->sending);
+		}
+		struct broadcast_list *l = list[(unsigned)id[i] % thread];
+		l->id[l->n++] = id[i];
+	}
+	int total = 0;
+	for (i=0;i<thread;i++) {
+		struct broadcast_list *l = list[i];
+		if (l == NULL) {
+			continue;
+		}
+		if (l->n == 0) {
+			FREE(l);
+			continue;
+		}
+		total += l->n;
+		ATOM_ADD(&b->ref, l->n);
+		struct request_package request;
+		request.u.broadcast.list = l;
+		send_request(ss, l->id[0], &request, 'R', sizeof(request.u.broadcast));
+	}
+	broadcast_release(b);
+	return total;
+}
+
 // return -1 when error
 // send_socket HIGH
 int64_t 
 socket_server_send(struct socket_server *ss, int id, const void * buffer, int sz) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
 		free_buffer(ss, buffer, sz);
 		return -1;
 	}
+	if (ss->direct) {
+		if (direct_write(ss, s, id, buffer, sz)) {
+			return s->wb_size;
+		}
+		ATOM_INC(&s->sending);
+	}
 
 	struct request_package request;
 	request.u.send.id = id;
 	request.u.send.sz = sz;
 	request.u.send.buffer = (char *)buffer;
 
-	send_request(ss, &request, 'D', sizeof(request.u.send));
+	send_request(ss, id, &request, 'D', sizeof(request.u.send));
 	return s->wb_size;
 }
 
+// 发送文件 fd 中从 offset 开始的 sz 字节，fd 由 socket_server 接管，发送完或者出错时关闭
+// 和 socket_server_send 的数据按调用顺序发送
+int
+socket_server_sendfile(struct socket_server *ss, int id, int fd, int64_t offset, int sz) {
+	struct socket * s = get_socket(ss, id);
+	if (s->id != id || s->type == SOCKET_TYPE_INVALID || sz < 0) {
+		close(fd);
+		return -1;
+	}
+	if (ss->direct) {
+		ATOM_INC(&s->sending);
+	}
+	struct request_package request;
+	request.u.sendfile.id = id;
+	request.u.sendfile.fd = fd;
+	request.u.sendfile.sz = sz;
+	request.u.sendfile.offset = offset;
+	send_request(ss, id, &request, 'F', sizeof(request.u.sendfile));
+	return 0;
+}
+
 // send_socket  LOW
 void 
 socket_server_send_lowpriority(struct socket_server *ss, int id, const void * buffer, int sz) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
 		free_buffer(ss, buffer, sz);
 		return;
 	}
+	if (ss->direct) {
+		ATOM_INC(&s->sending);
+	}
 
 	struct request_package request;
 	request.u.send.id = id;
 	request.u.send.sz = sz;
 	request.u.send.buffer = (char *)buffer;
 
-	send_request(ss, &request, 'P', sizeof(request.u.send));
+	send_request(ss, id, &request, 'P', sizeof(request.u.send));
 }
 
 // SOCKET_EXIT
 void
 socket_server_exit(struct socket_server *ss) {
 	struct request_package request;
-	send_request(ss, &request, 'X', 0);
+	int i;
+	// 每个事件循环都要退出
+	for (i=0;i<ss->thread;i++) {
+		send_request(ss, i, &request, 'X', 0);
+	}
 }
 
 // close_socket
@@ -1563,7 +3310,7 @@ socket_server_close(struct socket_server *ss, uintptr_t opaque, int id) {
 	request.u.close.id = id;
 	request.u.close.shutdown = 0;
 	request.u.close.opaque = opaque;
-	send_request(ss, &request, 'K', sizeof(request.u.close));
+	send_request(ss, id, &request, 'K', sizeof(request.u.close));
 }
 
 //  close_socket
@@ -1573,7 +3320,7 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 	request.u.close.id = id;
 	request.u.close.shutdown = 1;
 	request.u.close.opaque = opaque;
-	send_request(ss, &request, 'K', sizeof(request.u.close));
+	send_request(ss, id, &request, 'K', sizeof(request.u.close));
 }
 
 // return -1 means failed
@@ -1581,7 +3328,7 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 // 创建并绑定套接字
 // 返回套接字
 static int
-do_bind(const char *host, int port, int protocol, int *family) {
+do_bind(const char *host, int port, int protocol, int *family, int reuseport) {
 	int fd;
 	int status;
 	int reuse = 1;
@@ -1615,6 +3362,12 @@ do_bind(const char *host, int port, int protocol, int *family) {
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int))==-1) {
 		goto _failed;
 	}
+#ifdef SO_REUSEPORT
+	// 多个监听套接字可以绑定同一个端口，由内核把新连接分配给它们
+	if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(int))==-1) {
+		goto _failed;
+	}
+#endif
 	// 绑定套接字
 	status = bind(fd, (struct sockaddr *)ai_list->ai_addr, ai_list->ai_addrlen);
 	if (status != 0)
@@ -1629,12 +3382,53 @@ _failed_fd:
 	return -1;
 }
 
+// 路径上的套接字文件连接被拒绝，说明是之前的进程退出时残留的
+static bool
+unix_stale(union sockaddr_all *u, int len) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return false;
+	}
+	sp_nonblocking(fd);
+	bool stale = connect(fd, &u->s, len) != 0 && errno == ECONNREFUSED;
+	close(fd);
+	return stale;
+}
+
+// 创建并绑定 unix 流式套接字，残留的套接字文件删除后重新绑定
+static int
+do_bind_unix(const char *path) {
+	union sockaddr_all u;
+	int len = unix_address(path, &u.un);
+	if (len < 0) {
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (bind(fd, &u.s, len) != 0) {
+		if (errno != EADDRINUSE || u.un.sun_path[0] == '\0' || !unix_stale(&u, len)) {
+			goto _failed;
+		}
+		unlink(u.un.sun_path);
+		if (bind(fd, &u.s, len) != 0) {
+			goto _failed;
+		}
+	}
+	return fd;
+_failed:
+	close(fd);
+	return -1;
+}
+
 // 监听套接字
 static int
-do_listen(const char * host, int port, int backlog) {
+do_listen(const char * host, int port, int backlog, int reuseport) {
 	int family = 0;
 	// 创建并绑定套接字
-	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family);
+	const char * path = unix_path(host);
+	int listen_fd = path ? do_bind_unix(path) : do_bind(host, port, IPPROTO_TCP, &family, reuseport);
 	if (listen_fd < 0) {
 		return -1;
 	}
@@ -1643,13 +3437,21 @@ do_listen(const char * host, int port, int backlog) {
 		close(listen_fd);
 		return -1;
 	}
+	// 非阻塞，一个监听事件中循环 accept 直到 EAGAIN
+	sp_nonblocking(listen_fd);
+#ifdef __linux__
+	// linux 上 accept 的套接字会继承 SO_KEEPALIVE
+	if (path == NULL) {
+		socket_keepalive(listen_fd);
+	}
+#endif
 	return listen_fd;
 }
 
 // listen_socket
 int 
 socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
-	int fd = do_listen(addr, port, backlog);
+	int fd = do_listen(addr, port, backlog, ss->reuseport);
 	if (fd < 0) {
 		return -1;
 	}
@@ -1662,7 +3464,7 @@ socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * ad
 	request.u.listen.opaque = opaque;
 	request.u.listen.id = id;
 	request.u.listen.fd = fd;
-	send_request(ss, &request, 'L', sizeof(request.u.listen));
+	send_request(ss, id, &request, 'L', sizeof(request.u.listen));
 	return id;
 }
 
@@ -1676,7 +3478,7 @@ socket_server_bind(struct socket_server *ss, uintptr_t opaque, int fd) {
 	request.u.bind.opaque = opaque;
 	request.u.bind.id = id;
 	request.u.bind.fd = fd;
-	send_request(ss, &request, 'B', sizeof(request.u.bind));
+	send_request(ss, id, &request, 'B', sizeof(request.u.bind));
 	return id;
 }
 
@@ -1686,7 +3488,7 @@ socket_server_start(struct socket_server *ss, uintptr_t opaque, int id) {
 	struct request_package request;
 	request.u.start.id = id;
 	request.u.start.opaque = opaque;
-	send_request(ss, &request, 'S', sizeof(request.u.start));
+	send_request(ss, id, &request, 'S', sizeof(request.u.start));
 }
 
 // setopt_socket
@@ -1696,7 +3498,30 @@ socket_server_nodelay(struct socket_server *ss, int id) {
 	request.u.setopt.id = id;
 	request.u.setopt.what = TCP_NODELAY;
 	request.u.setopt.value = 1;
-	send_request(ss, &request, 'T', sizeof(request.u.setopt));
+	send_request(ss, id, &request, 'T', sizeof(request.u.setopt));
+}
+
+void
+socket_server_frame(struct socket_server *ss, int id, int header, int max) {
+	if (max <= 0) {
+		max = DEFAULT_FRAME_SIZE;
+	} else if (max > MAX_FRAME_SIZE) {
+		max = MAX_FRAME_SIZE;
+	}
+	struct request_package request;
+	request.u.frame.id = id;
+	request.u.frame.header = header;
+	request.u.frame.max = max;
+	send_request(ss, id, &request, 'H', sizeof(request.u.frame));
+}
+
+void
+socket_server_coalesce(struct socket_server *ss, int id, int enable) {
+	struct request_package request;
+	request.u.setopt.id = id;
+	request.u.setopt.what = 0;
+	request.u.setopt.value = enable;
+	send_request(ss, id, &request, 'G', sizeof(request.u.setopt));
 }
 
 void 
@@ -1704,6 +3529,227 @@ socket_server_userobject(struct socket_server *ss, struct socket_object_interfac
 	ss->soi = *soi;
 }
 
+void
+socket_server_reuseport(struct socket_server *ss, int enable) {
+	ss->reuseport = enable;
+}
+
+void
+socket_server_direct(struct socket_server *ss, int enable) {
+	ss->direct = enable;
+}
+
+void
+socket_server_readall(struct socket_server *ss, int enable) {
+	ss->readall = enable;
+}
+
+// 把事件循环换成 io_uring，只能在socket线程启动之前调用
+// 内核不支持时继续使用 epoll，返回 0
+int
+socket_server_uring(struct socket_server *ss, int enable) {
+	if (!enable) {
+		return 0;
+	}
+#ifdef SP_URING
+	int i;
+	for (i=0;i<ss->thread;i++) {
+		struct socket_poller *p = &ss->poller[i];
+		poll_fd efd = sp_create_uring();
+		if (sp_invalid(efd)) {
+			break;
+		}
+		if (sp_add(efd, p->recvctrl_fd, NULL)) {
+			sp_release(efd);
+			break;
+		}
+		sp_release(p->event_fd);
+		p->event_fd = efd;
+	}
+	if (i == ss->thread) {
+		return 1;
+	}
+	// 部分事件循环失败时，已经切换的也换回 epoll
+	while (--i >= 0) {
+		struct socket_poller *p = &ss->poller[i];
+		poll_fd efd = sp_create();
+		sp_add(efd, p->recvctrl_fd, NULL);
+		sp_release(p->event_fd);
+		p->event_fd = efd;
+	}
+#endif
+	fprintf(stderr, "socket-server: io_uring is not supported, fallback to default poller.\n");
+	return 0;
+}
+
+void
+socket_server_watermark(struct socket_server *ss, int id, int64_t high, int64_t low, int64_t limit) {
+	struct request_package request;
+	request.u.watermark.id = id;
+	request.u.watermark.high = high;
+	request.u.watermark.low = low;
+	request.u.watermark.limit = limit;
+	send_request(ss, id, &request, 'M', sizeof(request.u.watermark));
+}
+
+void
+socket_server_udp_batch(struct socket_server *ss, int batch) {
+	if (batch > MAX_UDP_BATCH) {
+		batch = MAX_UDP_BATCH;
+	}
+	ss->udp_batch = batch;
+}
+
+int
+socket_server_thread(struct socket_server *ss) {
+	return ss->thread;
+}
+
+// 汇总所有事件循环的写和accept统计，统计值由socket线程修改，这里的读取不加锁，只用于观察
+void
+socket_server_stat(struct socket_server *ss, struct socket_server_stat *stat) {
+	int i;
+	memset(stat, 0, sizeof(*stat));
+	for (i=0;i<ss->thread;i++) {
+		struct socket_server_stat *ps = &ss->poller[i].stat;
+		stat->write_syscall += ps->write_syscall;
+		stat->write_bytes += ps->write_bytes;
+		stat->accept += ps->accept;
+		stat->accept_error += ps->accept_error;
+		stat->accept_drop += ps->accept_drop;
+	}
+	stat->write_syscall += ss->direct_syscall;
+	stat->write_bytes += ss->direct_bytes;
+}
+
+static const char *
+socket_type_name(struct socket *s) {
+	switch (s->type) {
+	case SOCKET_TYPE_RESERVE:
+		return "reserve";
+	case SOCKET_TYPE_PLISTEN:
+	case SOCKET_TYPE_LISTEN:
+		return "listen";
+	case SOCKET_TYPE_CONNECTING:
+		return "connecting";
+	case SOCKET_TYPE_CONNECTED:
+		return s->protocol == PROTOCOL_TCP ? "tcp" : "udp";
+	case SOCKET_TYPE_HALFCLOSE:
+		return "halfclose";
+	case SOCKET_TYPE_PACCEPT:
+		return "accept";
+	case SOCKET_TYPE_BIND:
+		return "bind";
+	default:
+		return "invalid";
+	}
+}
+
+// 把地址格式化为 ip:port
+static void
+address_name(union sockaddr_all *u, socklen_t len, char *buffer, size_t sz) {
+	if (u->s.sa_family == AF_UNIX) {
+		unix_name(&u->un, len, buffer, sz);
+		return;
+	}
+	char tmp[INET6_ADDRSTRLEN];
+	void * sin_addr = (u->s.sa_family == AF_INET) ? (void*)&u->v4.sin_addr : (void *)&u->v6.sin6_addr;
+	int sin_port = ntohs((u->s.sa_family == AF_INET) ? u->v4.sin_port : u->v6.sin6_port);
+	if (inet_ntop(u->s.sa_family, sin_addr, tmp, sizeof(tmp))) {
+		snprintf(buffer, sz, "%s:%d", tmp, sin_port);
+	} else {
+		buffer[0] = '\0';
+	}
+}
+
+// 生成一个socket的统计快照，s->id != id 时返回 NULL
+// 持有 dw_lock，socket线程在此期间不会关闭fd
+static struct socket_info *
+query_info(struct socket *s, int id, uint64_t now) {
+	struct socket_info *si = NULL;
+	spinlock_lock(&s->dw_lock);
+	uint16_t type = s->type;
+	if (s->id != id || type == SOCKET_TYPE_INVALID || type == SOCKET_TYPE_RESERVE) {
+		spinlock_unlock(&s->dw_lock);
+		return NULL;
+	}
+	si = MALLOC(sizeof(*si));
+	memset(si, 0, sizeof(*si));
+	si->id = id;
+	si->type = socket_type_name(s);
+	si->opaque = s->opaque;
+	si->recv_bytes = s->recv_bytes;
+	si->recv_packets = s->recv_packets;
+	si->send_bytes = s->send_bytes + s->dw_bytes;
+	si->send_packets = s->send_packets + s->dw_packets;
+	si->wb_size = s->wb_size;
+	si->idle_ms = now > s->last_active ? now - s->last_active : 0;
+	union sockaddr_all u;
+	socklen_t slen = sizeof(u);
+	if (s->protocol == PROTOCOL_TCP) {
+		if (type == SOCKET_TYPE_CONNECTED || type == SOCKET_TYPE_HALFCLOSE || type == SOCKET_TYPE_PACCEPT) {
+			if (getpeername(s->fd, &u.s, &slen) == 0) {
+				address_name(&u, slen, si->name, sizeof(si->name));
+			}
+#ifdef TCP_INFO
+			struct tcp_info ti;
+			socklen_t tlen = sizeof(ti);
+			if (getsockopt(s->fd, IPPROTO_TCP, TCP_INFO, &ti, &tlen) == 0) {
+				si->tcp_info = 1;
+				si->rtt = ti.tcpi_rtt;
+				si->rttvar = ti.tcpi_rttvar;
+				si->retransmits = ti.tcpi_total_retrans;
+				si->cwnd = ti.tcpi_snd_cwnd;
+				si->unacked = ti.tcpi_unacked;
+			}
+#endif
+		} else if (type != SOCKET_TYPE_BIND && getsockname(s->fd, &u.s, &slen) == 0) {
+			address_name(&u, slen, si->name, sizeof(si->name));
+		}
+	} else if (getsockname(s->fd, &u.s, &slen) == 0) {
+		address_name(&u, slen, si->name, sizeof(si->name));
+	}
+	spinlock_unlock(&s->dw_lock);
+	return si;
+}
+
+// 查询socket的流量统计和 TCP_INFO，id < 0 时查询所有socket，返回链表
+// 计数由socket线程修改，这里的读取不加锁，只用于观察
+struct socket_info *
+socket_server_info(struct socket_server *ss, int id) {
+	uint64_t now = monotonic_ms();
+	if (id >= 0) {
+		return query_info(get_socket(ss, id), id, now);
+	}
+	spinlock_lock(&ss->slot_lock);
+	int page_n = ss->page_n;
+	spinlock_unlock(&ss->slot_lock);
+	struct socket_info *head = NULL;
+	struct socket_info **tail = &head;
+	int i,j;
+	for (i=0;i<page_n;i++) {
+		struct socket *page = ss->slot_page[i];
+		for (j=0;j<SLOT_PAGE_SIZE;j++) {
+			struct socket *s = &page[j];
+			struct socket_info *si = query_info(s, s->id, now);
+			if (si) {
+				*tail = si;
+				tail = &si->next;
+			}
+		}
+	}
+	return head;
+}
+
+void
+socket_info_release(struct socket_info *si) {
+	while (si) {
+		struct socket_info *next = si->next;
+		FREE(si);
+		si = next;
+	}
+}
+
 // UDP
 // 创建udp套接字
 int 
@@ -1713,7 +3759,7 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	if (port != 0 || addr != NULL) {
 		// bind
 		// 创建数据报套接字，并绑定端口
-		fd = do_bind(addr, port, IPPROTO_UDP, &family);
+		fd = do_bind(addr, port, IPPROTO_UDP, &family, 0);
 		if (fd < 0) {
 			return -1;
 		}
@@ -1742,13 +3788,13 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	request.u.udp.opaque = opaque;
 	request.u.udp.family = family;
 
-	send_request(ss, &request, 'U', sizeof(request.u.udp));	
+	send_request(ss, id, &request, 'U', sizeof(request.u.udp));	
 	return id;
 }
 
 int64_t 
 socket_server_udp_send(struct socket_server *ss, int id, const struct socket_udp_address *addr, const void *buffer, int sz) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
 		free_buffer(ss, buffer, sz);
 		return -1;
@@ -1775,7 +3821,7 @@ socket_server_udp_send(struct socket_server *ss, int id, const struct socket_udp
 
 	memcpy(request.u.send_udp.address, udp_address, addrsz);	
 
-	send_request(ss, &request, 'A', sizeof(request.u.send_udp.send)+addrsz);
+	send_request(ss, id, &request, 'A', sizeof(request.u.send_udp.send)+addrsz);
 	return s->wb_size;
 }
 
@@ -1813,14 +3859,18 @@ socket_server_udp_connect(struct socket_server *ss, int id, const char * addr, i
 
 	freeaddrinfo( ai_list );
 
-	send_request(ss, &request, 'C', sizeof(request.u.set_udp) - sizeof(request.u.set_udp.address) +addrsz);
+	send_request(ss, id, &request, 'C', sizeof(request.u.set_udp) - sizeof(request.u.set_udp.address) +addrsz);
 
 	return 0;
 }
 
 const struct socket_udp_address *
 socket_server_udp_address(struct socket_server *ss, struct socket_message *msg, int *addrsz) {
-	// ?
+	if (msg->ud < 0) {
+		// udp batch, read the address of each package from data
+		return NULL;
+	}
+	// 地址在数据之后
 	uint8_t * address = (uint8_t *)(msg->data + msg->ud);
 	int type = address[0];
 	switch(type) {
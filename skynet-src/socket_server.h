@@ -10,9 +10,49 @@
 #define SOCKET_ERROR 4
 #define SOCKET_EXIT 5
 #define SOCKET_UDP 6
+#define SOCKET_WARNING 7
+#define SOCKET_BATCH 8
+#define SOCKET_FRAME 9
 
 struct socket_server;
 
+struct socket_server_stat {
+	uint64_t write_syscall;	// write/writev calls on tcp sockets
+	uint64_t write_bytes;	// bytes written by them
+	uint64_t accept;	// connections accepted
+	uint64_t accept_error;	// accept failed by EMFILE / ENFILE
+	uint64_t accept_drop;	// accepted but closed at once because the socket table is full
+};
+
+// one data message in SOCKET_BATCH, or one package in SOCKET_FRAME
+struct socket_event {
+	int id;
+	int ud;		// size of data
+	char * data;
+};
+
+// snapshot of one socket, see socket_server_info
+struct socket_info {
+	int id;
+	const char * type;	// "tcp", "udp", "listen", "accept", "connecting", "halfclose", "bind"
+	uintptr_t opaque;
+	uint64_t recv_bytes;
+	uint64_t recv_packets;
+	uint64_t send_bytes;
+	uint64_t send_packets;
+	int64_t wb_size;	// bytes pending in the send buffer
+	uint64_t idle_ms;	// milliseconds since the last read or write
+	char name[128];		// peer address for a connection, local address for listen / udp
+	// TCP_INFO, only valid when tcp_info is 1
+	int tcp_info;
+	uint32_t rtt;		// smoothed rtt in microseconds
+	uint32_t rttvar;
+	uint32_t retransmits;	// total retransmits
+	uint32_t cwnd;		// congestion window in segments
+	uint32_t unacked;
+	struct socket_info * next;
+};
+
 struct socket_message {
 	// 分配id
 	int id;	
@@ -25,8 +65,16 @@ struct socket_message {
 };
 
 struct socket_server * socket_server_create();
+// thread is the number of event loops, socket id belongs to the event loop (id % thread)
+// max_socket is the capacity of the socket table (rounded up to power of 2, 0 for default 65536),
+// max_event is the number of events taken by one wait of the poller (0 for default 64)
+struct socket_server * socket_server_create_ex(int thread, int max_socket, int max_event);
 void socket_server_release(struct socket_server *);
+// poll the event loop 0, the only one of socket_server_create
 int socket_server_poll(struct socket_server *, struct socket_message *result, int *more);
+// poll the event loop [0, thread) , each event loop should be polled by only one thread
+int socket_server_poll_thread(struct socket_server *, int thread, struct socket_message *result, int *more);
+int socket_server_thread(struct socket_server *);
 
 void socket_server_exit(struct socket_server *);
 void socket_server_close(struct socket_server *, uintptr_t opaque, int id);
@@ -36,14 +84,36 @@ void socket_server_start(struct socket_server *, uintptr_t opaque, int id);
 // return -1 when error
 int64_t socket_server_send(struct socket_server *, int id, const void * buffer, int sz);
 void socket_server_send_lowpriority(struct socket_server *, int id, const void * buffer, int sz);
+// send sz bytes of file fd from offset by sendfile, in order with socket_server_send.
+// socket_server takes the ownership of fd and closes it after sending. return -1 when error
+int socket_server_sendfile(struct socket_server *, int id, int fd, int64_t offset, int sz);
+// send the same buffer to n sockets without copying it, the buffer is freed after all of them sent it.
+// returns the number of sockets queued
+int socket_server_broadcast(struct socket_server *, const int *id, int n, const void * buffer, int sz);
 
 // ctrl command below returns id
+// addr "unix:path" means an AF_UNIX stream socket (port is ignored), "unix:@name" is the linux abstract namespace
 int socket_server_listen(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
 int socket_server_connect(struct socket_server *, uintptr_t opaque, const char * addr, int port);
 int socket_server_bind(struct socket_server *, uintptr_t opaque, int fd);
 
 // for tcp
 void socket_server_nodelay(struct socket_server *, int id);
+// deliver the data read from socket id (and the sockets accepted by it) during one wait of the poller
+// as one SOCKET_BATCH message per opaque: ud is the number of data, data is an array of struct socket_event.
+// The array and each data should be freed by the receiver.
+void socket_server_coalesce(struct socket_server *, int id, int enable);
+// split the stream of socket id (and the sockets accepted by it) into packages by a big-endian length header
+// of 2 or 4 bytes (0 to disable) in the socket thread. The packages (header removed) of one read are delivered
+// as one SOCKET_FRAME message: ud is the number of packages, data is an array of struct socket_event.
+// A package longer than max (0 for the default 64K, at most 16M) closes the socket with SOCKET_ERROR.
+// The buffer of a package grows as its data arrives, so a header alone doesn't reserve max bytes.
+// Framed sockets don't take part in socket_server_coalesce.
+void socket_server_frame(struct socket_server *, int id, int header, int max);
+// send buffer watermark, SOCKET_WARNING (ud = K bytes) when the send buffer grows over high,
+// SOCKET_WARNING (ud = 0) when it drains to low after that. Close the socket when it grows over limit (0 for no limit).
+// The default is high = 1M, low = 0, limit = 0
+void socket_server_watermark(struct socket_server *, int id, int64_t high, int64_t low, int64_t limit);
 
 struct socket_udp_address;
 
@@ -67,4 +137,28 @@ struct socket_object_interface {
 // if you send package sz == -1, use soi.
 void socket_server_userobject(struct socket_server *, struct socket_object_interface *soi);
 
+// sum the stat of all event loops
+void socket_server_stat(struct socket_server *, struct socket_server_stat *);
+// snapshot the traffic counters (and TCP_INFO) of socket id, or all sockets when id < 0.
+// return a list linked by next (NULL when not found), release it by socket_info_release
+struct socket_info * socket_server_info(struct socket_server *, int id);
+void socket_info_release(struct socket_info *);
+
+// set SO_REUSEPORT for listen socket, so more than one listen socket can bind the same port
+void socket_server_reuseport(struct socket_server *, int enable);
+// let worker threads write to a tcp socket directly when its send buffer is empty,
+// the unsent part is handed to the socket thread
+void socket_server_direct(struct socket_server *, int enable);
+// keep reading a tcp socket while the read buffer is filled up, until EAGAIN
+void socket_server_readall(struct socket_server *, int enable);
+// use io_uring instead of epoll (linux only), call it before socket threads start.
+// When the kernel supports them, listen sockets use multishot accept and tcp connections use
+// multishot recv into a provided buffer ring, so reading takes no accept / read syscall.
+// return 0 when the kernel does not support it and the default poller is kept.
+int socket_server_uring(struct socket_server *, int enable);
+// receive / send at most batch udp packages by one recvmmsg / sendmmsg (linux only).
+// More than one packages received are delivered in one SOCKET_UDP message, ud is -(number of packages),
+// and data is a sequence of uint32 size + package + udp address.
+void socket_server_udp_batch(struct socket_server *, int batch);
+
 #endif
@@ -0,0 +1,630 @@
+#ifndef poll_socket_uring_h
+#define poll_socket_uring_h
+
+// io_uring 事件循环，只在 linux 下由 socket_epoll.h 包含
+// 用 IORING_OP_POLL_ADD 实现和 epoll 相同的就绪通知语义(水平触发)，socket_server 的读写逻辑不变
+// 好处是 sp_add / sp_del / sp_write 只是写入提交队列，和下一次 sp_wait 合并为一次 io_uring_enter 系统调用
+// 每个 fd 注册一次性的 poll，返回事件后在下一次 sp_wait 时重新注册，内核中条件仍然满足时会立刻再次返回，所以是水平触发
+// 内核不支持时 sp_create_uring 返回 -1，调用者继续使用 epoll
+//
+// 内核支持时 (5.19 以上注册 provided buffer ring，多次 recv 需要 6.0)，还可以把 fd 切换为完成模式:
+// sp_accept_uring 对监听套接字提交多次 accept (IORING_ACCEPT_MULTISHOT)，每个完成事件是一个新连接
+// sp_recv_uring 对 tcp 连接提交多次 recv (IORING_RECV_MULTISHOT)，内核把数据读到 buffer ring 中的缓冲区
+// 这两种完成事件的 done 为 true，读的路径上不再有 accept / read 系统调用，可写仍然用 poll 通知
+// 内核返回 EINVAL 时这个 fd 退回 poll，之后不再使用这种操作
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 4096		// 提交队列长度，完成队列为其2倍
+#define MAX_URING 256			// 最多同时存在的 io_uring 事件循环
+#define URING_BUFFERS 128		// buffer ring 中的缓冲区数，必须是2的幂
+#define URING_BUFFER_SIZE 0x4000	// buffer ring 中每个缓冲区的长度 16K
+#define URING_BGID 0			// buffer ring 的组号
+
+#define URING_UNREG 0			// fd 未注册
+#define URING_ARMED 1			// poll / accept / recv 已提交给内核
+#define URING_FIRED 2			// poll 已返回事件 (accept / recv 已结束)，等待下一次 sp_wait 重新注册
+#define URING_IDLE 3			// fd 已注册，但没有需要 poll 的事件
+
+// user_data 的最高2位为操作类型，中间30位为 tag，低32位为 fd
+#define URING_OP_POLL 0
+#define URING_OP_ACCEPT 1
+#define URING_OP_RECV 2
+#define URING_TAG_MASK 0x3fffffff
+
+struct uring_fd {
+	void * ud;
+	uint32_t tag;			// 每次注册/注销 poll 加一，丢弃已注销的 poll 的完成事件
+	uint32_t mask;			// POLLIN / POLLOUT，完成模式下没有 POLLIN
+	int state;			// poll 的状态
+	int op;				// URING_OP_POLL 为就绪模式，URING_OP_ACCEPT / URING_OP_RECV 为完成模式
+	uint32_t op_tag;		// 每次注册/注销 accept / recv 加一
+	int op_state;			// accept / recv 的状态
+};
+
+struct sp_uring {
+	int ring_fd;
+	// 提交队列
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	unsigned sq_local_tail;		// 已写入还未提交的 sqe 之后的位置
+	unsigned sq_submitted;		// 已提交给内核的位置
+	struct io_uring_sqe *sqes;
+	// 完成队列
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	void * ring;
+	size_t ring_sz;
+	size_t sqes_sz;
+	// provided buffer ring，注册失败时为 NULL，不能使用 recv
+	struct io_uring_buf_ring *br;
+	unsigned short br_tail;
+	char * buffers[URING_BUFFERS];	// 按 bid 索引
+	int no_accept;			// 内核不支持多次 accept
+	int no_recv;			// 内核不支持多次 recv
+	// 按 fd 索引的注册信息
+	struct uring_fd *fds;
+	int fds_cap;
+	// 上一次 sp_wait 返回事件 (或结束了 accept / recv) 的 fd，需要重新注册
+	int *fired;
+	int fired_n;
+	int fired_cap;
+};
+
+// io_uring 事件循环的 poll_fd 为 -2 - 索引，和 epoll 的 fd 区分
+static struct sp_uring * URING[MAX_URING];
+
+static inline int
+uring_is(int efd) {
+	return efd <= -2;
+}
+
+static inline struct sp_uring *
+uring_get(int efd) {
+	return URING[-2 - efd];
+}
+
+static int
+uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// 提交已写入的 sqe，min_complete > 0 时等待完成事件
+static int
+uring_submit(struct sp_uring *u, unsigned min_complete) {
+	__atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+	unsigned to_submit = u->sq_local_tail - u->sq_submitted;
+	if (to_submit == 0 && min_complete == 0) {
+		return 0;
+	}
+	int ret = uring_enter(u->ring_fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+	if (ret < 0) {
+		return -1;
+	}
+	u->sq_submitted += ret;
+	return ret;
+}
+
+// 取一个空闲的 sqe，提交队列满时先提交
+static struct io_uring_sqe *
+uring_sqe(struct sp_uring *u) {
+	while (u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+		if (uring_submit(u, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			return NULL;
+		}
+	}
+	unsigned index = u->sq_local_tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[index] = index;
+	++u->sq_local_tail;
+	return sqe;
+}
+
+static inline uint64_t
+uring_userdata(int op, uint32_t tag, int fd) {
+	return ((uint64_t)op << 62) | ((uint64_t)tag << 32) | (uint32_t)fd;
+}
+
+static void
+uring_poll_add(struct sp_uring *u, int fd, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL) {
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = f->mask;
+	sqe->user_data = uring_userdata(URING_OP_POLL, f->tag, fd);
+	f->state = URING_ARMED;
+}
+
+static void
+uring_poll_remove(struct sp_uring *u, int fd, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL) {
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = uring_userdata(URING_OP_POLL, f->tag, fd);
+	sqe->user_data = 0;	// 忽略 POLL_REMOVE 本身的完成事件
+}
+
+// 有需要 poll 的事件时注册，否则进入 URING_IDLE
+static inline void
+uring_poll_arm(struct sp_uring *u, int fd, struct uring_fd *f) {
+	if (f->mask) {
+		uring_poll_add(u, fd, f);
+	} else {
+		f->state = URING_IDLE;
+	}
+}
+
+// 提交多次 accept 或者多次 recv
+static void
+uring_op_add(struct sp_uring *u, int fd, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL) {
+		return;
+	}
+	sqe->fd = fd;
+	sqe->user_data = uring_userdata(f->op, f->op_tag, fd);
+	if (f->op == URING_OP_ACCEPT) {
+		// 不取地址，多个完成事件会覆盖同一个地址缓冲区，由调用者 getpeername
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_NONBLOCK;
+	} else {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BGID;
+	}
+	f->op_state = URING_ARMED;
+}
+
+static void
+uring_op_cancel(struct sp_uring *u, int fd, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL) {
+		return;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = uring_userdata(f->op, f->op_tag, fd);
+	sqe->user_data = 0;
+}
+
+static inline uint32_t
+uring_nexttag(uint32_t tag) {
+	tag = (tag + 1) & URING_TAG_MASK;
+	return tag ? tag : 1;
+}
+
+static inline void
+uring_newtag(struct uring_fd *f) {
+	f->tag = uring_nexttag(f->tag);
+}
+
+static void
+uring_fired(struct sp_uring *u, int fd) {
+	if (u->fired_n >= u->fired_cap) {
+		int cap = u->fired_cap ? u->fired_cap * 2 : 64;
+		u->fired = realloc(u->fired, cap * sizeof(int));
+		u->fired_cap = cap;
+	}
+	u->fired[u->fired_n++] = fd;
+}
+
+// 把缓冲区 bid 放回 buffer ring
+static void
+uring_buffer_add(struct sp_uring *u, int bid) {
+	struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUFFERS - 1)];
+	b->addr = (uint64_t)(uintptr_t)u->buffers[bid];
+	b->len = URING_BUFFER_SIZE;
+	b->bid = bid;
+	++u->br_tail;
+	__atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+// 注册 provided buffer ring，失败时不使用 recv
+static void
+uring_buffer_init(struct sp_uring *u) {
+	size_t sz = URING_BUFFERS * sizeof(struct io_uring_buf);
+	void * br = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (br == MAP_FAILED) {
+		return;
+	}
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)br;
+	reg.ring_entries = URING_BUFFERS;
+	reg.bgid = URING_BGID;
+	if (syscall(__NR_io_uring_register, u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		munmap(br, sz);
+		return;
+	}
+	u->br = br;
+	u->br_tail = 0;
+	int i;
+	for (i=0;i<URING_BUFFERS;i++) {
+		u->buffers[i] = malloc(URING_BUFFER_SIZE);
+		uring_buffer_add(u, i);
+	}
+}
+
+// recv 读到了缓冲区 bid 中，返回交给调用者的数据
+// 数据少时复制出来，缓冲区原样放回；否则直接交出缓冲区，buffer ring 中补一个新的
+static char *
+uring_buffer_take(struct sp_uring *u, int bid, int sz) {
+	char * buffer = u->buffers[bid];
+	if (sz <= URING_BUFFER_SIZE / 4) {
+		char * data = malloc(sz);
+		memcpy(data, buffer, sz);
+		uring_buffer_add(u, bid);
+		return data;
+	}
+	u->buffers[bid] = malloc(URING_BUFFER_SIZE);
+	uring_buffer_add(u, bid);
+	return buffer;
+}
+
+static void
+sp_release_uring(int efd) {
+	struct sp_uring *u = uring_get(efd);
+	URING[-2 - efd] = NULL;
+	munmap(u->sqes, u->sqes_sz);
+	munmap(u->ring, u->ring_sz);
+	close(u->ring_fd);
+	if (u->br) {
+		munmap(u->br, URING_BUFFERS * sizeof(struct io_uring_buf));
+		int i;
+		for (i=0;i<URING_BUFFERS;i++) {
+			free(u->buffers[i]);
+		}
+	}
+	free(u->fds);
+	free(u->fired);
+	free(u);
+}
+
+// 创建 io_uring 事件循环，内核不支持时返回 -1
+static int
+sp_create_uring() {
+	int slot;
+	for (slot=0;slot<MAX_URING;slot++) {
+		if (URING[slot] == NULL)
+			break;
+	}
+	if (slot == MAX_URING) {
+		return -1;
+	}
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (fd < 0) {
+		return -1;
+	}
+	// 需要 5.5 以上的内核: 完成队列溢出时不丢弃事件，提交队列和完成队列共用一次 mmap
+	if (!(p.features & IORING_FEAT_NODROP) || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		close(fd);
+		return -1;
+	}
+	size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	size_t ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+	void *ring = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	size_t sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes = mmap(NULL, sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		munmap(ring, ring_sz);
+		close(fd);
+		return -1;
+	}
+	struct sp_uring *u = malloc(sizeof(*u));
+	memset(u, 0, sizeof(*u));
+	u->ring_fd = fd;
+	u->ring = ring;
+	u->ring_sz = ring_sz;
+	u->sqes = sqes;
+	u->sqes_sz = sqes_sz;
+	u->sq_head = (unsigned *)((char *)ring + p.sq_off.head);
+	u->sq_tail = (unsigned *)((char *)ring + p.sq_off.tail);
+	u->sq_mask = (unsigned *)((char *)ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)((char *)ring + p.sq_off.array);
+	u->sq_entries = p.sq_entries;
+	u->sq_local_tail = *u->sq_tail;
+	u->sq_submitted = u->sq_local_tail;
+	u->cq_head = (unsigned *)((char *)ring + p.cq_off.head);
+	u->cq_tail = (unsigned *)((char *)ring + p.cq_off.tail);
+	u->cq_mask = (unsigned *)((char *)ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)ring + p.cq_off.cqes);
+	uring_buffer_init(u);
+	URING[slot] = u;
+	return -2 - slot;
+}
+
+static struct uring_fd *
+uring_fd(struct sp_uring *u, int fd) {
+	if (fd >= u->fds_cap) {
+		int cap = u->fds_cap ? u->fds_cap : 1024;
+		while (cap <= fd) {
+			cap *= 2;
+		}
+		u->fds = realloc(u->fds, cap * sizeof(struct uring_fd));
+		memset(u->fds + u->fds_cap, 0, (cap - u->fds_cap) * sizeof(struct uring_fd));
+		u->fds_cap = cap;
+	}
+	return &u->fds[fd];
+}
+
+static int
+sp_add_uring(int efd, int sock, void *ud) {
+	struct sp_uring *u = uring_get(efd);
+	struct uring_fd *f = uring_fd(u, sock);
+	f->ud = ud;
+	f->mask = POLLIN;
+	f->op = URING_OP_POLL;
+	f->op_state = URING_UNREG;
+	uring_newtag(f);
+	uring_poll_add(u, sock, f);
+	return 0;
+}
+
+static void
+sp_del_uring(int efd, int sock) {
+	struct sp_uring *u = uring_get(efd);
+	if (sock >= u->fds_cap) {
+		return;
+	}
+	struct uring_fd *f = &u->fds[sock];
+	if (f->state == URING_ARMED) {
+		uring_poll_remove(u, sock, f);
+	}
+	if (f->op_state == URING_ARMED) {
+		uring_op_cancel(u, sock, f);
+	}
+	f->state = URING_UNREG;
+	f->op_state = URING_UNREG;
+	f->op = URING_OP_POLL;
+	f->ud = NULL;
+	uring_newtag(f);
+	f->op_tag = uring_nexttag(f->op_tag);
+}
+
+// 已经 sp_add 的 fd 从 poll 可读切换为 accept / recv 完成事件，不支持时返回 0，fd 继续使用 poll
+static int
+uring_switch(struct sp_uring *u, int sock, int op) {
+	if (sock >= u->fds_cap) {
+		return 0;
+	}
+	struct uring_fd *f = &u->fds[sock];
+	if (f->state == URING_UNREG || f->op != URING_OP_POLL) {
+		return 0;
+	}
+	f->op = op;
+	f->op_tag = uring_nexttag(f->op_tag);
+	uring_op_add(u, sock, f);
+	f->mask &= ~POLLIN;
+	if (f->state == URING_ARMED) {
+		uring_poll_remove(u, sock, f);
+		uring_newtag(f);
+		uring_poll_arm(u, sock, f);
+	}
+	return 1;
+}
+
+static int
+sp_accept_uring(int efd, int sock) {
+	struct sp_uring *u = uring_get(efd);
+	if (u->no_accept) {
+		return 0;
+	}
+	return uring_switch(u, sock, URING_OP_ACCEPT);
+}
+
+static int
+sp_recv_uring(int efd, int sock) {
+	struct sp_uring *u = uring_get(efd);
+	if (u->br == NULL || u->no_recv) {
+		return 0;
+	}
+	return uring_switch(u, sock, URING_OP_RECV);
+}
+
+static void
+sp_write_uring(int efd, int sock, void *ud, bool enable) {
+	struct sp_uring *u = uring_get(efd);
+	if (sock >= u->fds_cap) {
+		return;
+	}
+	struct uring_fd *f = &u->fds[sock];
+	uint32_t mask = (f->op == URING_OP_POLL ? POLLIN : 0) | (enable ? POLLOUT : 0);
+	f->ud = ud;
+	if (f->mask == mask || f->state == URING_UNREG) {
+		f->mask = mask;
+		return;
+	}
+	f->mask = mask;
+	if (f->state == URING_ARMED) {
+		// 内核中的 poll 不能修改，先移除再用新的 mask 注册
+		uring_poll_remove(u, sock, f);
+		uring_newtag(f);
+		uring_poll_arm(u, sock, f);
+	} else if (f->state == URING_IDLE) {
+		uring_poll_arm(u, sock, f);
+	}
+	// URING_FIRED 的 fd 会在下一次 sp_wait 时用新的 mask 注册
+}
+
+// 内核不支持这种操作，fd 退回 poll 可读，下一次 sp_wait 时注册
+static void
+uring_fallback(struct sp_uring *u, int fd, struct uring_fd *f) {
+	if (f->op == URING_OP_ACCEPT) {
+		u->no_accept = 1;
+	} else {
+		u->no_recv = 1;
+	}
+	f->op = URING_OP_POLL;
+	f->op_state = URING_UNREG;
+	f->mask |= POLLIN;
+	if (f->state == URING_ARMED) {
+		uring_poll_remove(u, fd, f);
+		uring_newtag(f);
+	}
+	f->state = URING_FIRED;
+	uring_fired(u, fd);
+}
+
+// 处理一个 accept / recv 的完成事件，返回 1 表示填写了 e
+static int
+uring_op_complete(struct sp_uring *u, struct io_uring_cqe *cqe, int op, int fd, uint32_t tag, struct event *e) {
+	int res = cqe->res;
+	char * buffer = NULL;
+	int bid = -1;
+	if (op == URING_OP_RECV && (cqe->flags & IORING_CQE_F_BUFFER)) {
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	}
+	struct uring_fd *f = fd < u->fds_cap ? &u->fds[fd] : NULL;
+	if (f == NULL || f->op != op || f->op_state != URING_ARMED || f->op_tag != tag) {
+		// 已注销，accept 到的连接要关闭，用到的缓冲区放回
+		if (op == URING_OP_ACCEPT && res >= 0) {
+			close(res);
+		}
+		if (bid >= 0) {
+			uring_buffer_add(u, bid);
+		}
+		return 0;
+	}
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		// 多次操作已经结束，下一次 sp_wait 重新提交
+		f->op_state = URING_FIRED;
+		uring_fired(u, fd);
+	}
+	if (res == -EINVAL) {
+		uring_fallback(u, fd, f);
+		return 0;
+	}
+	if (res == -ENOBUFS || res == -ECANCELED || res == -EINTR || res == -EAGAIN) {
+		// 缓冲区用完时数据留在套接字中，重新提交后再读
+		return 0;
+	}
+	if (bid >= 0) {
+		if (res > 0) {
+			buffer = uring_buffer_take(u, bid, res);
+		} else {
+			uring_buffer_add(u, bid);
+		}
+	}
+	e->s = f->ud;
+	e->read = true;
+	e->write = false;
+	e->done = true;
+	e->res = res;
+	e->buffer = buffer;
+	return 1;
+}
+
+static void
+uring_rearm(struct sp_uring *u) {
+	int i;
+	int fired_n = u->fired_n;
+	u->fired_n = 0;
+	for (i=0;i<fired_n;i++) {
+		int fd = u->fired[i];
+		struct uring_fd *f = &u->fds[fd];
+		if (f->state == URING_FIRED) {
+			uring_poll_arm(u, fd, f);
+		}
+		if (f->op_state == URING_FIRED) {
+			uring_op_add(u, fd, f);
+		}
+	}
+}
+
+static int
+sp_wait_uring(int efd, struct event *e, int max) {
+	struct sp_uring *u = uring_get(efd);
+	int n = 0;
+	while (n == 0) {
+		// 重新注册上一次返回事件的 fd，没有返回事件时也要重新提交结束了的 accept / recv
+		uring_rearm(u);
+		unsigned head = *u->cq_head;
+		if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			// 提交和等待合并为一次系统调用
+			if (uring_submit(u, 1) < 0) {
+				if (errno == EAGAIN || errno == EBUSY || errno == EINTR)
+					continue;
+				return -1;
+			}
+		} else {
+			uring_submit(u, 0);
+		}
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		while (n < max && head != tail) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+			++head;
+			uint64_t data = cqe->user_data;
+			if (data == 0) {
+				continue;
+			}
+			int fd = (int)(uint32_t)data;
+			uint32_t tag = (uint32_t)(data >> 32) & URING_TAG_MASK;
+			int op = (int)(data >> 62);
+			if (op != URING_OP_POLL) {
+				n += uring_op_complete(u, cqe, op, fd, tag, &e[n]);
+				continue;
+			}
+			if (fd >= u->fds_cap) {
+				continue;
+			}
+			struct uring_fd *f = &u->fds[fd];
+			if (f->state != URING_ARMED || f->tag != tag) {
+				// 已注销或者已重新注册
+				continue;
+			}
+			int res = cqe->res;
+			if (f->op != URING_OP_POLL && (res < 0 || !(res & POLLOUT))) {
+				// 完成模式下 poll 只用于可写，出错和断开由 accept / recv 的完成事件报告
+				f->state = URING_IDLE;
+				continue;
+			}
+			f->state = URING_FIRED;
+			uring_fired(u, fd);
+			e[n].s = f->ud;
+			e[n].done = false;
+			if (res < 0) {
+				// 交给读逻辑处理错误
+				e[n].read = true;
+				e[n].write = false;
+			} else {
+				e[n].read = f->op == URING_OP_POLL && (res & (POLLIN | POLLERR | POLLHUP)) != 0;
+				e[n].write = (res & POLLOUT) != 0;
+			}
+			++n;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return n;
+}
+
+#endif
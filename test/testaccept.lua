@@ -0,0 +1,44 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- 大量客户端同时连接，检查 accept 统计
+
+local PORT = 8008
+local N = 2000	-- 连接数
+local BACKLOG = 4096
+
+skynet.start(function()
+	local before = socket.stat()
+	local accepted = 0
+	local listen_id = socket.listen("127.0.0.1", PORT, BACKLOG)
+	socket.start(listen_id, function(id)
+		accepted = accepted + 1
+		socket.close_fd(id)
+	end)
+	local co = coroutine.running()
+	local connected = 0
+	local ti = skynet.now()
+	for i = 1, N do
+		skynet.fork(function()
+			local c = socket.open("127.0.0.1", PORT)
+			if c then
+				socket.close(c)
+			end
+			connected = connected + 1
+			if connected == N then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+	while accepted < N do
+		skynet.sleep(1)
+	end
+	local stat = socket.stat()
+	print("accept", stat.accept - before.accept, "error", stat.accept_error - before.accept_error,
+		"drop", stat.accept_drop - before.accept_drop, "time", skynet.now() - ti)
+	print("listen", socket.info(listen_id).recv_packets)
+	assert(stat.accept - before.accept == N)
+	socket.close(listen_id)
+	skynet.exit()
+end)
@@ -0,0 +1,96 @@
+local skynet = require "skynet"
+
+-- gateserver.broadcast 把同一份数据发给所有连接，对比逐个 write 的耗时
+
+local mode = ...
+local PORT = 8012
+local N = 500	-- 连接数
+local M = 20	-- 广播次数
+
+if mode == "gate" then
+	local netpack = require "netpack"
+	local gateserver = require "snax.gateserver"
+	local socketdriver = require "socketdriver"
+
+	local connected = 0
+	local clients = {}
+	local handler = {}
+
+	function handler.connect(fd)
+		connected = connected + 1
+		clients[fd] = true
+		gateserver.openclient(fd)
+	end
+
+	function handler.message(fd, msg, sz)
+		netpack.tostring(msg, sz)
+	end
+
+	local CMD = {}
+
+	function CMD.connected()
+		return connected
+	end
+
+	function CMD.broadcast(msg)
+		return gateserver.broadcast(nil, netpack.pack(msg))
+	end
+
+	function CMD.write(msg)
+		local n = 0
+		for fd in pairs(clients) do
+			socketdriver.send(fd, netpack.pack(msg))
+			n = n + 1
+		end
+		return n
+	end
+
+	function handler.command(cmd, source, ...)
+		return CMD[cmd](...)
+	end
+
+	gateserver.start(handler)
+	return
+end
+
+-- socket 库会注册 socket 协议，gate 中不能加载
+local socket = require "socket"
+require "skynet.manager"	-- skynet.kill
+
+local function read_all(clients, msg)
+	for i = 1, #clients do
+		local sz = socket.header(assert(socket.read(clients[i], 2)))
+		assert(socket.read(clients[i], sz) == msg, "broadcast message")
+	end
+end
+
+local function test(gate, clients, cmd)
+	local t = skynet.now()
+	for j = 1, M do
+		local msg = cmd .. " " .. j .. " " .. string.rep("x", j * 50)
+		assert(skynet.call(gate, "lua", cmd, msg) == N)
+		read_all(clients, msg)
+	end
+	print(cmd, "messages", N * M, "time", skynet.now() - t)
+end
+
+skynet.start(function()
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = PORT, maxclient = N })
+	local clients = {}
+	for i = 1, N do
+		clients[i] = assert(socket.open("127.0.0.1", PORT))
+	end
+	while skynet.call(gate, "lua", "connected") < N do
+		skynet.sleep(10)
+	end
+	test(gate, clients, "write")
+	test(gate, clients, "broadcast")
+	for i = 1, N do
+		socket.close(clients[i])
+	end
+	skynet.send(gate, "lua", "close")
+	skynet.kill(gate)
+	print("BROADCAST OK")
+	skynet.exit()
+end)
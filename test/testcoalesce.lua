@@ -0,0 +1,79 @@
+local skynet = require "skynet"
+
+-- 对比 coalesce 前后，gateserver 收到的 socket 消息数，并检查每个连接的包顺序
+
+local mode, port, coalesce = ...
+local N = 200	-- 连接数
+local M = 50	-- 每个连接发送的包数
+
+if mode == "gate" then
+	local netpack = require "netpack"
+	local gateserver = require "snax.gateserver"
+
+	-- 统计 socket 消息数
+	local messages = 0
+	local filter = netpack.filter
+	netpack.filter = function(...)
+		messages = messages + 1
+		return filter(...)
+	end
+
+	local last = {}
+	local packets = 0
+	local handler = {}
+
+	function handler.connect(fd)
+		last[fd] = 0
+		gateserver.openclient(fd)
+	end
+
+	function handler.message(fd, msg, sz)
+		local n = tonumber(netpack.tostring(msg, sz))
+		assert(n == last[fd] + 1, "out of order")
+		last[fd] = n
+		packets = packets + 1
+	end
+
+	function handler.command(cmd)
+		assert(cmd == "result")
+		return packets, messages
+	end
+
+	gateserver.start(handler)
+	return
+end
+
+-- socket 库会注册 socket 协议，gate 中不能加载
+local socket = require "socket"
+require "skynet.manager"	-- skynet.kill
+
+local function test(port, coalesce)
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = port, coalesce = coalesce, maxclient = N })
+	local clients = {}
+	for i = 1, N do
+		clients[i] = assert(socket.open("127.0.0.1", port))
+	end
+	for j = 1, M do
+		for i = 1, N do
+			socket.write(clients[i], string.pack(">s2", tostring(j)))
+		end
+	end
+	local packets, messages
+	repeat
+		skynet.sleep(10)
+		packets, messages = skynet.call(gate, "lua", "result")
+	until packets == N * M
+	print(coalesce and "coalesce" or "nocoalesce", "packets", packets, "socket messages", messages)
+	for i = 1, N do
+		socket.close(clients[i])
+	end
+	skynet.send(gate, "lua", "close")
+	skynet.kill(gate)
+end
+
+skynet.start(function()
+	test(8010, false)
+	test(8011, true)
+	skynet.exit()
+end)
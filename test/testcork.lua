@@ -0,0 +1,58 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- 对比 cork 前后，同一条消息中多次 socket.write 产生的写系统调用次数
+
+local PORT = 8006
+local N = 100	-- 回合数
+local M = 20	-- 每回合写入次数
+
+local function server(id, cork)
+	socket.start(id)
+	if cork then
+		socket.cork(id)
+	end
+	while true do
+		local line = socket.readline(id)
+		if not line then
+			break
+		end
+		for i = 1, M do
+			socket.write(id, line .. ":" .. i .. "\n")
+		end
+	end
+	socket.close(id)
+end
+
+local function test(cork)
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id)
+		skynet.fork(server, id, cork)
+	end)
+	local c = socket.open("127.0.0.1", PORT)
+	local before = socket.stat().write_syscall
+	for i = 1, N do
+		socket.write(c, tostring(i) .. "\n")
+		for j = 1, M do
+			assert(socket.readline(c) == i .. ":" .. j)
+		end
+	end
+	local syscall = socket.stat().write_syscall - before
+	print(cork and "cork" or "nocork", "write syscall", syscall)
+	socket.close(c)
+	socket.close(listen_id)
+end
+
+skynet.start(function()
+	-- socket.cork 装上 dispatch_finish 后，之前装的钩子仍要被调用
+	local finished = 0
+	skynet.dispatch_finish(function()
+		finished = finished + 1
+	end)
+	test(false)
+	test(true)
+	local n = finished
+	skynet.sleep(0)
+	assert(finished > n)
+	skynet.exit()
+end)
@@ -0,0 +1,122 @@
+local skynet = require "skynet"
+
+-- socket线程分包 (gateserver conf.frame)，包头和包体被拆开发送时检查包的内容和顺序
+
+local mode, port, frame = ...
+local N = 20	-- 连接数
+local M = 200	-- 每个连接发送的包数
+
+local function payload(i, j)
+	-- 包括空包和接近 64K 的大包
+	if j % 50 == 0 then
+		return string.rep(string.char(65 + i % 26), 60000) .. j
+	elseif j % 37 == 0 then
+		return ""
+	end
+	return string.format("%d:%d", i, j)
+end
+
+if mode == "gate" then
+	local netpack = require "netpack"
+	local gateserver = require "snax.gateserver"
+
+	local client = {}
+	local packets = 0
+	local handler = {}
+
+	function handler.connect(fd)
+		gateserver.openclient(fd)
+	end
+
+	function handler.message(fd, msg, sz)
+		local str = netpack.tostring(msg, sz)
+		local c = client[fd]
+		if c == nil then
+			-- 第一个包是客户端编号
+			client[fd] = { id = tonumber(str), n = 0 }
+		else
+			c.n = c.n + 1
+			assert(str == payload(c.id, c.n), "bad package")
+			packets = packets + 1
+		end
+	end
+
+	function handler.command(cmd)
+		assert(cmd == "result")
+		return packets
+	end
+
+	gateserver.start(handler)
+	return
+end
+
+local socket = require "socket"
+require "skynet.manager"	-- skynet.kill
+
+local function test(port, frame)
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = port, frame = frame, maxclient = N })
+	local co = coroutine.running()
+	local done = 0
+	for i = 1, N do
+		skynet.fork(function()
+			local c = assert(socket.open("127.0.0.1", port))
+			local t = { string.pack(">s2", tostring(i)) }
+			for j = 1, M do
+				table.insert(t, string.pack(">s2", payload(i, j)))
+			end
+			local data = table.concat(t)
+			local offset = 1
+			while offset <= #data do
+				-- 切成长短不一的片段，让包头和包体跨越多次读
+				local sz = (offset % 7 == 0) and 4096 or (offset % 5 + 1)
+				socket.write(c, data:sub(offset, offset + sz - 1))
+				offset = offset + sz
+				if offset % 3 == 0 then
+					skynet.yield()
+				end
+			end
+			done = done + 1
+			if done == N then
+				skynet.wakeup(co)
+			end
+			skynet.sleep(100)
+			socket.close(c)
+		end)
+	end
+	skynet.wait(co)
+	local packets
+	repeat
+		skynet.sleep(10)
+		packets = skynet.call(gate, "lua", "result")
+	until packets == N * M
+	print(frame and "frame" or "noframe", "packets", packets)
+	skynet.send(gate, "lua", "close")
+	skynet.sleep(150)
+	skynet.kill(gate)
+end
+
+-- 超过 frame_max 的包关闭连接，只发来包头时连接保持
+local function test_max(port)
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = port, frame = true, frame_max = 1000 })
+	local big = assert(socket.open("127.0.0.1", port))
+	local partial = assert(socket.open("127.0.0.1", port))
+	socket.write(big, string.pack(">I2", 2000))
+	socket.write(partial, string.pack(">I2", 1000) .. "x")
+	assert(socket.read(big) == false, "frame too large")
+	skynet.sleep(10)
+	assert(not socket.invalid(partial), "partial frame")
+	socket.close(partial)
+	print("frame_max ok")
+	skynet.send(gate, "lua", "close")
+	skynet.sleep(10)
+	skynet.kill(gate)
+end
+
+skynet.start(function()
+	test(8014, false)
+	test(8015, true)
+	test_max(8016)
+	skynet.exit()
+end)
@@ -0,0 +1,83 @@
+local skynet = require "skynet"
+
+-- gateserver 的空闲超时和限速：空闲的连接和发包过快的连接被关闭，正常的连接保持
+
+local mode = ...
+local PORT = 8013
+
+if mode == "gate" then
+	local netpack = require "netpack"
+	local gateserver = require "snax.gateserver"
+
+	local received = 0
+	local handler = {}
+
+	function handler.connect(fd)
+		gateserver.openclient(fd)
+	end
+
+	function handler.message(fd, msg, sz)
+		netpack.tostring(msg, sz)
+		received = received + 1
+	end
+
+	function handler.command(cmd)
+		assert(cmd == "received")
+		return received
+	end
+
+	gateserver.start(handler)
+	return
+end
+
+-- socket 库会注册 socket 协议，gate 中不能加载
+local socket = require "socket"
+require "skynet.manager"	-- skynet.kill
+
+local function pack(msg)
+	return string.pack(">s2", msg)
+end
+
+-- 连接被对端关闭时返回 true
+local function closed(fd)
+	return socket.read(fd) == false
+end
+
+skynet.start(function()
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", {
+		address = "127.0.0.1",
+		port = PORT,
+		timeout = 2,		-- 2 秒没有收到数据就关闭
+		packet_rate = 10,	-- 每秒最多 10 个包
+		byte_rate = 4096,	-- 每秒最多 4K 字节
+	})
+	local idle = assert(socket.open("127.0.0.1", PORT))
+	local spam = assert(socket.open("127.0.0.1", PORT))
+	local flood = assert(socket.open("127.0.0.1", PORT))
+	local good = assert(socket.open("127.0.0.1", PORT))
+
+	local msg = pack "hello"
+	socket.write(spam, string.rep(msg, 100))
+	socket.write(flood, pack(string.rep("x", 8000)))
+	local result = {}
+	skynet.fork(function() result.idle = closed(idle) end)
+	skynet.fork(function() result.spam = closed(spam) end)
+	skynet.fork(function() result.flood = closed(flood) end)
+	for i = 1, 20 do
+		socket.write(good, msg)
+		skynet.sleep(20)
+	end
+	assert(result.idle, "idle connection should be closed")
+	assert(result.spam, "spam connection should be closed")
+	assert(result.flood, "flood connection should be closed")
+	assert(not socket.invalid(good), "good connection should be alive")
+	local n = skynet.call(gate, "lua", "received")
+	print("received", n)
+	assert(n >= 20 and n <= 32, "received")
+	socket.close(good)
+	skynet.send(gate, "lua", "close")
+	skynet.kill(gate)
+	print("GATELIMIT OK")
+	skynet.exit()
+end)
@@ -0,0 +1,14 @@
+local skynet = require "skynet"
+
+-- 配合 logbuffer / logrotatesize / logbacklog 配置测试批量日志、滚动和丢弃
+local N = ...
+N = tonumber(N) or 100000
+
+skynet.start(function()
+	local ti = skynet.now()
+	for i = 1, N do
+		skynet.error("log line", i)
+	end
+	skynet.error(string.format("%d lines in %.2f sec", N, (skynet.now() - ti) / 100))
+	skynet.exit()
+end)
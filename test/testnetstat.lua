@@ -0,0 +1,54 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- 检查 socket.info 的流量统计
+
+local PORT = 8007
+local N = 100
+
+local function dump(info)
+	local keys = {}
+	for k in pairs(info) do
+		table.insert(keys, k)
+	end
+	table.sort(keys)
+	for _, k in ipairs(keys) do
+		print("", k, info[k])
+	end
+end
+
+skynet.start(function()
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id)
+		socket.start(id)
+		while true do
+			local line = socket.readline(id)
+			if not line then
+				break
+			end
+			socket.write(id, line .. "\n")
+		end
+		socket.close(id)
+	end)
+	local c = socket.open("127.0.0.1", PORT)
+	local bytes = 0
+	for i = 1, N do
+		local line = tostring(i) .. "\n"
+		bytes = bytes + #line
+		socket.write(c, line)
+		assert(socket.readline(c) == tostring(i))
+	end
+	local info = socket.info(c)
+	dump(info)
+	assert(info.type == "tcp")
+	assert(info.send_bytes == bytes and info.send_packets == N)
+	assert(info.recv_bytes == bytes)
+	print("all sockets")
+	for _, v in ipairs(socket.info()) do
+		print("", v.id, v.type, skynet.address(v.address), v.peer, v.recv_bytes, v.send_bytes)
+	end
+	socket.close(c)
+	socket.close(listen_id)
+	assert(socket.info(c) == nil)
+	skynet.exit()
+end)
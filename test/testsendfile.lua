@@ -0,0 +1,39 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- socket.sendfile 和 socket.write 交替发送，检查接收的顺序和内容
+
+local PORT = 8005
+
+skynet.start(function()
+	local filename = os.tmpname()
+	local parts = {}
+	for i = 1, 200000 do
+		parts[i] = string.format("%07d\n", i)
+	end
+	local content = table.concat(parts)
+	local f = assert(io.open(filename, "wb"))
+	f:write(content)
+	f:close()
+
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id)
+		socket.start(id)
+		socket.write(id, "HEAD")
+		print("sendfile", socket.sendfile(id, filename))
+		socket.write(id, "MID")
+		print("sendfile", socket.sendfile(id, filename, 8, 16))
+		socket.write(id, "TAIL")
+		print("sendfile (not exist)", socket.sendfile(id, filename .. ".notexist"))
+		socket.close(id)
+	end)
+
+	local c = socket.open("127.0.0.1", PORT)
+	local r = socket.readall(c)
+	local expect = "HEAD" .. content .. "MID" .. content:sub(9, 24) .. "TAIL"
+	print("recv", #r, r == expect)
+	socket.close(c)
+	socket.close(listen_id)
+	os.remove(filename)
+	skynet.exit()
+end)
@@ -0,0 +1,66 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- loopback 回显压测，比较 epoll 和 io_uring 两种事件循环
+-- 分别用 socket_uring = false / true 的配置启动，比较输出的 roundtrip/s
+-- skynet.newservice("testsocketbench", clients, seconds, size)
+
+local mode, arg1, arg2 = ...
+local PORT = 8004
+
+if mode == "server" then
+	skynet.start(function()
+		local id = socket.listen("127.0.0.1", PORT)
+		socket.start(id, function(fd)
+			skynet.fork(function()
+				socket.start(fd)
+				while true do
+					local str = socket.read(fd)
+					if not str then
+						break
+					end
+					socket.write(fd, str)
+				end
+				socket.close(fd)
+			end)
+		end)
+	end)
+	return
+end
+
+local clients = tonumber(mode) or 64
+local seconds = tonumber(arg1) or 5
+local size = tonumber(arg2) or 64
+
+skynet.start(function()
+	skynet.newservice(SERVICE_NAME, "server")
+	local payload = string.rep("x", size)
+	local stop = false
+	local count = 0
+	local done = 0
+	for i = 1, clients do
+		skynet.fork(function()
+			local fd = assert(socket.open("127.0.0.1", PORT))
+			while not stop do
+				socket.write(fd, payload)
+				socket.read(fd, size)
+				count = count + 1
+			end
+			socket.close(fd)
+			done = done + 1
+		end)
+	end
+	local start = skynet.now()
+	skynet.sleep(seconds * 100)
+	stop = true
+	local elapsed = (skynet.now() - start) / 100
+	local backend = skynet.getenv "socket_uring" == "true" and "io_uring" or "epoll"
+	print(string.format("backend %s : %d clients, %d bytes, %d roundtrips in %.2fs, %.0f roundtrip/s",
+		backend, clients, size, count, elapsed, count / elapsed))
+	local stat = socket.stat()
+	print(string.format("write syscall %d, write bytes %d", stat.write_syscall, stat.write_bytes))
+	while done < clients do
+		skynet.sleep(10)
+	end
+	skynet.exit()
+end)
@@ -0,0 +1,36 @@
+local skynet = require "skynet"
+
+-- run with tracefile = "./trace.log" in config
+
+local mode = ...
+
+if mode == "SLAVE" then
+
+local db = {}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, key, value)
+		if cmd == "set" then
+			db[key] = value
+			skynet.ret(skynet.pack(true))
+		else
+			skynet.ret(skynet.pack(db[key]))
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local slave = skynet.newservice(SERVICE_NAME, "SLAVE")
+	skynet.fork(function()
+		local trace, span = skynet.trace()
+		print("trace", trace, "span", span)
+		skynet.call(slave, "lua", "set", "hello", "world")
+		-- the response continue the trace
+		print("tracecontext", skynet.tracecontext())
+		print(skynet.call(slave, "lua", "get", "hello"))
+	end)
+end)
+
+end
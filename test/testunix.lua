@@ -0,0 +1,52 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- 通过 AF_UNIX 流式套接字收发，同一台机器上的节点不经过 tcp 协议栈
+
+local ADDR = "unix:/tmp/skynet_testunix.sock"
+local N = 1000
+
+local function echo_server(addr)
+	local listen_id = assert(socket.listen(addr))
+	socket.start(listen_id, function(id, peer)
+		print("connect from", peer, id)
+		socket.start(id)
+		while true do
+			local line = socket.readline(id)
+			if not line then
+				break
+			end
+			socket.write(id, line .. "\n")
+		end
+		socket.close(id)
+	end)
+	return listen_id
+end
+
+local function echo_client(addr)
+	local c = assert(socket.open(addr))
+	for i = 1, N do
+		socket.write(c, tostring(i) .. "\n")
+		assert(socket.readline(c) == tostring(i))
+	end
+	local info = socket.info(c)
+	print("client", info.type, info.peer, info.send_packets, info.recv_bytes)
+	socket.close(c)
+end
+
+skynet.start(function()
+	local listen_id = echo_server(ADDR)
+	echo_client(ADDR)
+	socket.close(listen_id)
+	-- 上一个监听套接字残留的文件可以重新监听
+	listen_id = echo_server(ADDR)
+	echo_client(ADDR)
+	socket.close(listen_id)
+	-- linux 抽象命名空间
+	listen_id = echo_server("unix:@skynet_testunix")
+	echo_client("unix:@skynet_testunix")
+	socket.close(listen_id)
+	assert(not socket.open("unix:/tmp/skynet_testunix_none.sock"))
+	print("UNIX OK")
+	skynet.exit()
+end)
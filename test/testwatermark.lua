@@ -0,0 +1,63 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- 服务端向一个暂不读取的客户端持续发送，观察发送缓冲区的暂停/恢复通知以及硬上限
+
+local PORT = 8003
+local CHUNK = string.rep("x", 16 * 1024)
+
+local function server(id)
+	socket.start(id)
+	socket.watermark(id, 256 * 1024, 64 * 1024, 4 * 1024 * 1024)
+	local paused = false
+	socket.warning(id, function(id, size)
+		if size > 0 then
+			print("server pause", id, size .. "K")
+			paused = true
+		else
+			print("server resume", id)
+			paused = false
+		end
+	end)
+	local n = 0
+	-- 暂停之前一直发送
+	while not paused do
+		socket.write(id, CHUNK)
+		n = n + 1
+		skynet.yield()
+	end
+	print("server paused after", n, "chunks")
+	-- 等待客户端读取之后恢复
+	while paused do
+		skynet.sleep(10)
+	end
+	-- 无视暂停通知继续发送，超过硬上限后连接被关闭
+	while socket.write(id, CHUNK) do
+		skynet.yield()
+	end
+	print("server closed by limit")
+end
+
+skynet.start(function()
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id, addr)
+		skynet.fork(server, id)
+	end)
+
+	local c = socket.open("127.0.0.1", PORT)
+	-- 客户端先不读，让服务端的发送缓冲区堆积
+	skynet.sleep(100)
+	local total = 0
+	for i = 1, 64 do
+		local r = socket.read(c, #CHUNK)
+		if not r then
+			break
+		end
+		total = total + #r
+	end
+	print("client read", total)
+	skynet.sleep(100)
+	socket.close(c)
+	socket.close(listen_id)
+	skynet.exit()
+end)
@@ -0,0 +1,53 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- 发送队列中有长度为 0 的写入时，writev 不能让 socket 线程空转
+
+local mode = ...
+local PORT = 8014
+local SIZE = 4 * 1024 * 1024	-- 足够大，使得内核缓冲区写满，后面的写入进入发送队列
+
+if mode == "server" then
+	skynet.start(function()
+		local id = socket.listen("127.0.0.1", PORT)
+		socket.start(id, function(fd)
+			skynet.fork(function()
+				socket.start(fd)
+				-- 先不读，让对端的数据积压在发送队列中
+				skynet.sleep(50)
+				local n = 0
+				while true do
+					local str = socket.read(fd)
+					if not str then
+						break
+					end
+					n = n + #str
+					if n == SIZE * 2 + 3 then
+						socket.write(fd, "ok")
+					end
+				end
+				socket.close(fd)
+			end)
+		end)
+	end)
+	return
+end
+
+skynet.start(function()
+	skynet.newservice(SERVICE_NAME, "server")
+	local fd = assert(socket.open("127.0.0.1", PORT))
+	socket.write(fd, "")	-- 发送队列为空
+	socket.write(fd, string.rep("a", SIZE))
+	socket.write(fd, "")	-- 排在未发送完的数据后面
+	socket.write(fd, {})
+	socket.write(fd, string.rep("b", SIZE))
+	socket.write(fd, {})
+	socket.write(fd, "end")
+	socket.write(fd, "")	-- 最后只剩长度为 0 的缓冲区
+	assert(socket.read(fd, 2) == "ok")
+	-- socket 线程仍然正常工作
+	socket.write(fd, "")
+	socket.close(fd)
+	print("WRITEV OK")
+	skynet.exit()
+end)
@@ -0,0 +1,81 @@
+-- Decode the binary service log written by LOGON (See skynet-src/skynet_log.h)
+-- usage: ./3rd/lua/lua tools/logdump.lua logfile [handle]
+-- The output is the same as the text log of older version.
+-- If handle (hex, such as :0000000a) is given, only the messages from this source are dumped.
+
+local filename, filter = ...
+if not filename then
+	print "usage: lua logdump.lua logfile [handle]"
+	return
+end
+if filter then
+	filter = assert(tonumber(filter:match "^:?(%x+)$", 16), "Invalid handle")
+end
+
+local PTYPE_SOCKET = 6
+local LOG_OPEN = -1
+local LOG_CLOSE = -2
+
+local RECORD = "=I4I4i4i4I4"	-- size source type session time
+local RECORD_SIZE = string.packsize(RECORD)
+
+local function hex(s)
+	return (s:gsub(".", function(c) return string.format("%02x", c:byte()) end))
+end
+
+-- udp address: BYTE protocol (1 ipv4, 2 ipv6), WORD port (big-endian), ip (4 or 16 bytes)
+local function udp_address(addr)
+	local protocol, port, pos = string.unpack(">BI2", addr)
+	local ip = addr:sub(pos)
+	if protocol == 1 and #ip == 4 then
+		local a, b, c, d = ip:byte(1, 4)
+		return string.format("%d.%d.%d.%d:%d", a, b, c, d, port)
+	elseif #ip == 16 then
+		return string.format("[%s]:%d", string.format(string.rep("%x", 8, ":"), string.unpack(">I2I2I2I2I2I2I2I2", ip)), port)
+	end
+	return hex(addr)
+end
+
+local f = assert(io.open(filename, "rb"))
+local data = f:read "a"
+f:close()
+
+local output = io.write
+local starttime = 0
+local pos = 1
+while pos + RECORD_SIZE - 1 <= #data do
+	local size, source, type, session, ti = string.unpack(RECORD, data, pos)
+	pos = pos + RECORD_SIZE
+	local msg = data:sub(pos, pos + size - 1)
+	if #msg ~= size then
+		io.stderr:write(string.format("Truncated record at %d\n", pos - RECORD_SIZE))
+		break
+	end
+	pos = pos + size
+	if filter and type ~= LOG_OPEN and type ~= LOG_CLOSE and source ~= filter then
+		-- skip
+	elseif type == LOG_OPEN then
+		starttime = string.unpack("=I4", msg)
+		output(string.format("open time: %u %s\n", ti, os.date("%c", starttime + ti // 100)))
+	elseif type == LOG_CLOSE then
+		output(string.format("close time: %u\n", ti))
+	elseif type == PTYPE_SOCKET then
+		local stype, id, ud, offset = string.unpack("=i4i4i4", msg)
+		local payload = msg:sub(offset)
+		output(string.format("[socket] %d %d %d ", stype, id, ud))
+		if stype == 6 then	-- SKYNET_SOCKET_TYPE_UDP, one record per datagram, udp address follows the data
+			output(hex(payload:sub(1, ud)))
+			if #payload > ud then
+				output(" " .. udp_address(payload:sub(ud + 1)))
+			end
+		elseif stype == 1 or stype == 8 or stype == 9 then
+			-- SKYNET_SOCKET_TYPE_DATA, or one event of SKYNET_SOCKET_TYPE_BATCH / SKYNET_SOCKET_TYPE_FRAME (id is the event id)
+			output(hex(payload))
+		else
+			output("[" .. payload .. "]")
+		end
+		output "\n"
+	else
+		output(string.format(":%08x %d %d %u %s\n", source, type, session, ti, hex(msg)))
+	end
+end